@@ -0,0 +1,294 @@
+// Reproducible end-to-end benchmark of the renderer. Every mesh (procedural
+// ones in several sizes, plus any OBJ given on the command line) is loaded
+// through Scene::load_mesh and rendered along the same turntable orbit of a
+// CameraController. Per-stage timings (OBJ read, normals, primitives, BVH
+// build, then trace, shade and string assembly of every frame) are written as
+// JSON with percentiles, so results of two commits can be diffed.
+//
+// Procedural meshes are written to a temporary OBJ first, so the OBJ reader
+// is timed for them too.
+//
+// Usage: render_benchmark [mesh.obj ...] [--frames N] [--resolution W]
+//                         [--threads T] [--sizes 1|2|3] [--no-synthetic]
+//                         [--glyphs charset|shapes|braille|blocks] [--shadows]
+//                         [--output results.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+#include "ASCIIRenderer.h"
+#include "Camera.h"
+#include "CameraController.h"
+#include "Scene.h"
+#include "synthetic_meshes.h"
+
+struct BenchmarkMesh {
+    std::string name;
+    // "synthetic" or the OBJ path
+    std::string source;
+    // Writes the procedural mesh (empty for OBJ files)
+    std::function<void(Eigen::MatrixXd&, Eigen::MatrixXi&)> generate;
+};
+
+struct BenchmarkOptions {
+    int frames = 36;
+    int resolution = 160;
+    int threads = 0;
+    GlyphMode glyph_mode = GlyphMode::CHARSET;
+    bool shadows = false;
+};
+
+// Milliseconds of one stage over all frames
+struct StageSamples {
+    std::vector<double> ms;
+
+    // Nearest-rank percentile of the sorted samples
+    static double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0.0;
+        const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+
+    std::string json() const {
+        std::vector<double> sorted = ms;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double v : sorted) sum += v;
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer),
+            "{\"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f}",
+            sorted.empty() ? 0.0 : sorted.front(), percentile(sorted, 50), percentile(sorted, 90),
+            percentile(sorted, 99), sorted.empty() ? 0.0 : sorted.back(),
+            sorted.empty() ? 0.0 : sum / sorted.size());
+        return buffer;
+    }
+};
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Load, build and render one mesh; returns its JSON object (empty on failure)
+std::string run_mesh(const BenchmarkMesh& mesh, const BenchmarkOptions& options) {
+    std::string path = mesh.source;
+    if (mesh.generate) {
+        Eigen::MatrixXd V;
+        Eigen::MatrixXi F;
+        mesh.generate(V, F);
+        path = (std::filesystem::temp_directory_path() / ("render_benchmark_" + mesh.name + ".obj")).string();
+        if (!write_obj(path, V, F)) {
+            std::fprintf(stderr, "Failed to write %s\n", path.c_str());
+            return "";
+        }
+    }
+
+    Scene scene;
+    scene.bvh_options.num_threads = options.threads;
+    // Always measure the full load, never a cached one
+    scene.use_cache = false;
+    scene.load_mesh(path);
+    if (mesh.generate) std::filesystem::remove(path);
+    if (scene.bvh.empty()) {
+        std::fprintf(stderr, "Failed to load %s\n", mesh.source.c_str());
+        return "";
+    }
+
+    // Turntable orbit framed like the interactive viewer, slightly from above
+    const BoundingBox box = scene.bvh.box();
+    CameraController controller;
+    controller.auto_rotate = false;
+    controller.set_target_and_fit(box.center().transpose(), (box.max_corner - box.min_corner).maxCoeff() * 0.8);
+    controller.theta = M_PI / 2.0 - 0.3;
+
+    ASCIIRenderer renderer;
+    renderer.resolution = options.resolution;
+    renderer.num_threads = options.threads;
+    renderer.glyph_mode = options.glyph_mode;
+    renderer.shadows = options.shadows;
+    renderer.ambient_strength = 0.2;
+    renderer.light.intensity = 0.7;
+
+    StageSamples trace, shade, assembly, total;
+    long primary_rays = 0, shadow_rays = 0;
+    std::string frame;
+    // Frame -1 warms up caches and the thread pool and is not recorded
+    for (int k = -1; k < options.frames; k++) {
+        Camera camera;
+        controller.phi = 2.0 * M_PI * std::max(k, 0) / options.frames;
+        controller.apply_to_camera(camera);
+        // Camera-space light, as in the GUI
+        const double theta = 120.0 * M_PI / 180.0, phi = 150.0 * M_PI / 180.0;
+        renderer.light.direction = (std::sin(theta) * std::cos(phi) * camera.u +
+                                    std::cos(theta) * camera.v -
+                                    std::sin(theta) * std::sin(phi) * camera.w).normalized();
+        renderer.invalidate();
+        const auto start = std::chrono::steady_clock::now();
+        renderer.render(scene, camera, frame);
+        const double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (k < 0) continue;
+        const RenderTimings& t = renderer.last_timings;
+        trace.ms.push_back(t.trace_seconds * 1000.0);
+        shade.ms.push_back(t.shade_seconds * 1000.0);
+        assembly.ms.push_back(t.assembly_seconds * 1000.0);
+        total.ms.push_back(ms);
+        primary_rays += renderer.primary_rays_traced;
+        shadow_rays += renderer.shadow_rays_traced;
+    }
+
+    const SceneLoadStats& load = scene.load_stats;
+    const double frames = std::max(options.frames, 1);
+    char buffer[1024];
+    std::string json = "    {\n";
+    json += "      \"name\": " + json_string(mesh.name) + ",\n";
+    json += "      \"source\": " + json_string(mesh.source) + ",\n";
+    std::snprintf(buffer, sizeof(buffer),
+        "      \"vertices\": %d,\n"
+        "      \"triangles\": %d,\n"
+        "      \"load_ms\": {\"obj_read\": %.4f, \"normals\": %.4f, \"primitives\": %.4f, \"bvh_build\": %.4f},\n"
+        "      \"bvh\": {\"nodes\": %d, \"depth\": %d, \"sah_cost\": %.4f},\n"
+        "      \"rays_per_frame\": {\"primary\": %.1f, \"shadow\": %.1f},\n",
+        static_cast<int>(scene.V.rows()), static_cast<int>(scene.F.rows()),
+        load.read_seconds * 1000.0, load.normals_seconds * 1000.0,
+        load.primitives_seconds * 1000.0, load.bvh_seconds * 1000.0,
+        scene.bvh_stats.num_nodes, scene.bvh_stats.max_depth, scene.bvh_stats.sah_cost,
+        primary_rays / frames, shadow_rays / frames);
+    json += buffer;
+    json += "      \"frame_ms\": {\n";
+    json += "        \"trace\": " + trace.json() + ",\n";
+    json += "        \"shade\": " + shade.json() + ",\n";
+    json += "        \"assembly\": " + assembly.json() + ",\n";
+    json += "        \"total\": " + total.json() + "\n";
+    json += "      }\n    }";
+
+    std::sort(total.ms.begin(), total.ms.end());
+    std::printf("%-20s %8d tris  read %8.1f ms  bvh %8.1f ms  frame p50 %8.2f ms  p99 %8.2f ms\n",
+        mesh.name.c_str(), static_cast<int>(scene.F.rows()), load.read_seconds * 1000.0,
+        load.bvh_seconds * 1000.0, StageSamples::percentile(total.ms, 50),
+        StageSamples::percentile(total.ms, 99));
+    return json;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    int sizes = 3;
+    bool synthetic = true;
+    std::string output_path = "bench_results.json";
+    std::vector<BenchmarkMesh> meshes;
+    const char* glyph_names[] = {"charset", "shapes", "braille", "blocks"};
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--frames") == 0 && has_value) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--resolution") == 0 && has_value) {
+            options.resolution = std::max(2, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            options.threads = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--sizes") == 0 && has_value) {
+            sizes = std::clamp(std::atoi(argv[++i]), 1, 3);
+        } else if (std::strcmp(argv[i], "--no-synthetic") == 0) {
+            synthetic = false;
+        } else if (std::strcmp(argv[i], "--glyphs") == 0 && has_value) {
+            const char* name = argv[++i];
+            const auto found = std::find_if(std::begin(glyph_names), std::end(glyph_names),
+                [name](const char* g) { return std::strcmp(g, name) == 0; });
+            if (found == std::end(glyph_names)) {
+                std::fprintf(stderr, "Unknown glyph mode: %s\n", name);
+                return 1;
+            }
+            options.glyph_mode = static_cast<GlyphMode>(found - std::begin(glyph_names));
+        } else if (std::strcmp(argv[i], "--shadows") == 0) {
+            options.shadows = true;
+        } else if (std::strcmp(argv[i], "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            std::fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        } else {
+            meshes.push_back({std::filesystem::path(argv[i]).stem().string(), argv[i], nullptr});
+        }
+    }
+
+    if (synthetic) {
+        // Small, medium and large variants of each generator
+        const int sphere_subdivisions[] = {3, 5, 7};
+        const int terrain_resolutions[] = {64, 256, 512};
+        const int thin_triangle_counts[] = {1000, 16000, 128000};
+        std::vector<BenchmarkMesh> generated;
+        for (int s = 0; s < sizes; s++) {
+            const int subdivisions = sphere_subdivisions[s];
+            generated.push_back({"sphere_s" + std::to_string(subdivisions), "synthetic",
+                [subdivisions](Eigen::MatrixXd& V, Eigen::MatrixXi& F) {
+                    subdivided_sphere(subdivisions, V, F);
+                }});
+            const int resolution = terrain_resolutions[s];
+            generated.push_back({"terrain_" + std::to_string(resolution), "synthetic",
+                [resolution](Eigen::MatrixXd& V, Eigen::MatrixXi& F) {
+                    noisy_terrain(resolution, 1, V, F);
+                }});
+            const int count = thin_triangle_counts[s];
+            generated.push_back({"thin_" + std::to_string(count), "synthetic",
+                [count](Eigen::MatrixXd& V, Eigen::MatrixXi& F) {
+                    random_thin_triangles(count, 1, V, F);
+                }});
+        }
+        meshes.insert(meshes.begin(), generated.begin(), generated.end());
+    }
+    if (meshes.empty()) {
+        std::fprintf(stderr, "No meshes to benchmark\n");
+        return 1;
+    }
+
+    std::vector<std::string> results;
+    for (const BenchmarkMesh& mesh : meshes) {
+        const std::string json = run_mesh(mesh, options);
+        if (!json.empty()) results.push_back(json);
+    }
+
+    FILE* file = std::fopen(output_path.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "Failed to write %s\n", output_path.c_str());
+        return 1;
+    }
+    int grid_width, grid_height;
+    ASCIIRenderer renderer;
+    renderer.resolution = options.resolution;
+    renderer.get_grid_size(grid_width, grid_height);
+    std::fprintf(file,
+        "{\n"
+        "  \"config\": {\"frames\": %d, \"grid\": [%d, %d], \"threads\": %d, \"glyphs\": \"%s\", \"shadows\": %s},\n"
+        "  \"meshes\": [\n",
+        options.frames, grid_width, grid_height,
+        options.threads > 0 ? options.threads : ThreadPool::hardware_threads(),
+        glyph_names[static_cast<int>(options.glyph_mode)], options.shadows ? "true" : "false");
+    for (size_t i = 0; i < results.size(); i++) {
+        std::fprintf(file, "%s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    std::fclose(file);
+    std::printf("Results written to %s\n", output_path.c_str());
+    return results.size() == meshes.size() ? 0 : 1;
+}
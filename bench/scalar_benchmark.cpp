@@ -0,0 +1,165 @@
+// Compare the double and float instantiations of the geometry pipeline
+// (normals, MeshTriangleT, AABBTreeT, ray-box and ray-triangle kernels) on one
+// mesh: geometry memory, build time and the time to trace primary-ray frames
+// of a turntable orbit.
+//
+// Usage: scalar_benchmark mesh.obj [double|float|both] [frames] [width] [height]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+#include "AABBTree.h"
+#include "Camera.h"
+#include "CameraController.h"
+#include "MeshTriangle.h"
+#include "per_vertex_normals.h"
+#include "read_obj.h"
+#include "viewing_ray.h"
+
+struct BenchmarkResult {
+    size_t geometry_bytes = 0;
+    double build_seconds = 0;
+    std::vector<double> frame_seconds;
+    // Hit object (or -1) of every pixel of every frame
+    std::vector<int> hits;
+};
+
+template <typename Scalar>
+BenchmarkResult run_benchmark(
+    const Eigen::MatrixXd& V_double,
+    const Eigen::MatrixXi& F,
+    const std::vector<Camera>& cameras,
+    const int width,
+    const int height)
+{
+    using MatrixX = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using Object = ObjectT<Scalar>;
+    using Clock = std::chrono::high_resolution_clock;
+    BenchmarkResult result;
+
+    auto start = Clock::now();
+    const MatrixX V = V_double.cast<Scalar>();
+    MatrixX N;
+    per_vertex_normals(V, F, N);
+    // Triangles refer to the mesh through maps
+    const typename MeshTriangleT<Scalar>::MatrixXMap V_map(V.data(), V.rows(), V.cols());
+    const typename MeshTriangleT<Scalar>::FacesMap F_map(F.data(), F.rows(), F.cols());
+    const typename MeshTriangleT<Scalar>::MatrixXMap N_map(N.data(), N.rows(), N.cols());
+    std::vector<std::shared_ptr<Object>> objects;
+    objects.reserve(F.rows());
+    for (int i = 0; i < F.rows(); ++i) {
+        objects.push_back(std::make_shared<MeshTriangleT<Scalar>>(V_map, F_map, i, &N_map));
+    }
+    BVHBuildOptions options;
+    options.leaf_block_size = 1;
+    auto tree = std::make_shared<AABBTreeT<Scalar>>(objects, 0, options);
+    result.build_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // make_shared keeps each object next to its control block (~16 bytes)
+    const BVHStats stats = tree->stats();
+    result.geometry_bytes =
+        (V.size() + N.size()) * sizeof(Scalar) +
+        objects.size() * (sizeof(MeshTriangleT<Scalar>) + 16 + sizeof(std::shared_ptr<Object>)) +
+        stats.num_nodes * (sizeof(AABBTreeT<Scalar>) + 16);
+
+    result.hits.reserve(cameras.size() * width * height);
+    for (const Camera& camera : cameras) {
+        auto frame_start = Clock::now();
+        for (int i = 0; i < height; ++i) {
+            for (int j = 0; j < width; ++j) {
+                Ray ray;
+                viewing_ray(camera, i, j, width, height, ray);
+                RayT<Scalar> scalar_ray;
+                scalar_ray.origin = ray.origin.cast<Scalar>();
+                scalar_ray.direction = ray.direction.cast<Scalar>();
+                Scalar t;
+                std::shared_ptr<Object> descendant;
+                int hit = -1;
+                if (tree->ray_intersect(scalar_ray, Scalar(VIEWING_RAY_MIN_T), std::numeric_limits<Scalar>::infinity(), t, descendant)) {
+                    const auto* tri = dynamic_cast<const MeshTriangleT<Scalar>*>(descendant.get());
+                    hit = tri ? tri->f : -1;
+                }
+                result.hits.push_back(hit);
+            }
+        }
+        result.frame_seconds.push_back(std::chrono::duration<double>(Clock::now() - frame_start).count());
+    }
+    return result;
+}
+
+void print_result(const char* name, BenchmarkResult result) {
+    std::sort(result.frame_seconds.begin(), result.frame_seconds.end());
+    double total = 0;
+    for (double s : result.frame_seconds) total += s;
+    const size_t n = result.frame_seconds.size();
+    std::printf("%-6s geometry %8.2f MB  build %8.1f ms  frame mean %7.2f ms  median %7.2f ms  max %7.2f ms\n",
+        name,
+        result.geometry_bytes / (1024.0 * 1024.0),
+        result.build_seconds * 1000.0,
+        n ? total / n * 1000.0 : 0.0,
+        n ? result.frame_seconds[n / 2] * 1000.0 : 0.0,
+        n ? result.frame_seconds.back() * 1000.0 : 0.0);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr,
+            "Usage: %s mesh.obj [double|float|both] [frames] [width] [height]\n", argv[0]);
+        return 1;
+    }
+    const std::string scalar = argc > 2 ? argv[2] : "both";
+    const int frames = argc > 3 ? std::max(1, std::atoi(argv[3])) : 36;
+    const int width = argc > 4 ? std::max(1, std::atoi(argv[4])) : 120;
+    const int height = argc > 5 ? std::max(1, std::atoi(argv[5])) : 60;
+    if (scalar != "double" && scalar != "float" && scalar != "both") {
+        std::fprintf(stderr, "Unknown scalar type: %s\n", scalar.c_str());
+        return 1;
+    }
+
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    if (!read_obj(argv[1], V, F) || F.rows() == 0) {
+        std::fprintf(stderr, "Failed to load %s\n", argv[1]);
+        return 1;
+    }
+    std::printf("%s: %d vertices, %d triangles, %d frames of %dx%d\n",
+        argv[1], (int)V.rows(), (int)F.rows(), frames, width, height);
+
+    // Turntable orbit framed like the interactive viewer
+    const Eigen::RowVector3d lo = V.colwise().minCoeff();
+    const Eigen::RowVector3d hi = V.colwise().maxCoeff();
+    const Eigen::RowVector3d center = 0.5 * (lo + hi);
+    CameraController controller;
+    controller.set_target_and_fit(center.transpose(), (hi - lo).maxCoeff() * 0.8);
+    std::vector<Camera> cameras(frames);
+    for (int k = 0; k < frames; ++k) {
+        controller.phi = 2.0 * M_PI * k / frames;
+        controller.apply_to_camera(cameras[k], 0.5);
+    }
+
+    BenchmarkResult result_double, result_float;
+    if (scalar != "float") {
+        result_double = run_benchmark<double>(V, F, cameras, width, height);
+        print_result("double", result_double);
+    }
+    if (scalar != "double") {
+        result_float = run_benchmark<float>(V, F, cameras, width, height);
+        print_result("float", result_float);
+    }
+    if (scalar == "both") {
+        size_t same = 0;
+        for (size_t i = 0; i < result_double.hits.size(); ++i) {
+            same += result_double.hits[i] == result_float.hits[i];
+        }
+        std::printf("pixels with the same hit: %.3f%%\n",
+            100.0 * same / std::max<size_t>(1, result_double.hits.size()));
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "synthetic_meshes.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+#include <Eigen/Geometry>
+
+namespace {
+    // Uniform double in [0, 1) from the top 53 bits of two draws
+    double uniform(std::mt19937& rng) {
+        const uint64_t hi = rng() >> 5;
+        const uint64_t lo = rng() >> 6;
+        return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+    }
+
+    // Hash of a lattice point and seed to [0, 1)
+    double lattice_value(int x, int y, uint32_t seed) {
+        uint32_t h = seed ^ 0x9E3779B9u;
+        h ^= static_cast<uint32_t>(x) * 0x85EBCA6Bu;
+        h = (h << 13) | (h >> 19);
+        h ^= static_cast<uint32_t>(y) * 0xC2B2AE35u;
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h * (1.0 / 4294967296.0);
+    }
+
+    // Smoothly interpolated lattice values at (x, y)
+    double value_noise(double x, double y, uint32_t seed) {
+        const int x0 = static_cast<int>(std::floor(x));
+        const int y0 = static_cast<int>(std::floor(y));
+        double u = x - x0, v = y - y0;
+        u = u * u * (3.0 - 2.0 * u);
+        v = v * v * (3.0 - 2.0 * v);
+        const double a = lattice_value(x0, y0, seed), b = lattice_value(x0 + 1, y0, seed);
+        const double c = lattice_value(x0, y0 + 1, seed), d = lattice_value(x0 + 1, y0 + 1, seed);
+        return (a * (1 - u) + b * u) * (1 - v) + (c * (1 - u) + d * u) * v;
+    }
+}
+
+void subdivided_sphere(int subdivisions, Eigen::MatrixXd& V, Eigen::MatrixXi& F) {
+    const double t = (1.0 + std::sqrt(5.0)) / 2.0;
+    std::vector<Eigen::Vector3d> vertices = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+    for (Eigen::Vector3d& v : vertices) v.normalize();
+    std::vector<Eigen::Vector3i> faces = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+
+    for (int s = 0; s < subdivisions; s++) {
+        // Midpoint vertex of every edge, shared by its two faces
+        std::map<std::pair<int, int>, int> midpoints;
+        auto midpoint = [&](int a, int b) {
+            const std::pair<int, int> key(std::min(a, b), std::max(a, b));
+            auto found = midpoints.find(key);
+            if (found != midpoints.end()) return found->second;
+            vertices.push_back((vertices[a] + vertices[b]).normalized());
+            midpoints.emplace(key, static_cast<int>(vertices.size()) - 1);
+            return static_cast<int>(vertices.size()) - 1;
+        };
+        std::vector<Eigen::Vector3i> split;
+        split.reserve(faces.size() * 4);
+        for (const Eigen::Vector3i& f : faces) {
+            const int ab = midpoint(f[0], f[1]);
+            const int bc = midpoint(f[1], f[2]);
+            const int ca = midpoint(f[2], f[0]);
+            split.emplace_back(f[0], ab, ca);
+            split.emplace_back(f[1], bc, ab);
+            split.emplace_back(f[2], ca, bc);
+            split.emplace_back(ab, bc, ca);
+        }
+        faces.swap(split);
+    }
+
+    V.resize(vertices.size(), 3);
+    for (size_t i = 0; i < vertices.size(); i++) V.row(i) = vertices[i].transpose();
+    F.resize(faces.size(), 3);
+    for (size_t i = 0; i < faces.size(); i++) F.row(i) = faces[i].transpose();
+}
+
+void noisy_terrain(int resolution, uint32_t seed, Eigen::MatrixXd& V, Eigen::MatrixXi& F) {
+    const int n = std::max(resolution, 2);
+    V.resize(n * n, 3);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            const double x = -1.0 + 2.0 * j / (n - 1);
+            const double z = -1.0 + 2.0 * i / (n - 1);
+            // Four octaves of noise, 4 lattice cells across at the coarsest
+            double height = 0.0, amplitude = 0.3, frequency = 2.0;
+            for (int octave = 0; octave < 4; octave++) {
+                height += amplitude * (value_noise(x * frequency, z * frequency, seed + octave) - 0.5);
+                amplitude *= 0.5;
+                frequency *= 2.0;
+            }
+            V.row(i * n + j) << x, height, z;
+        }
+    }
+
+    F.resize(2 * (n - 1) * (n - 1), 3);
+    int f = 0;
+    for (int i = 0; i + 1 < n; i++) {
+        for (int j = 0; j + 1 < n; j++) {
+            const int a = i * n + j, b = a + 1, c = a + n, d = c + 1;
+            F.row(f++) << a, c, b;
+            F.row(f++) << b, c, d;
+        }
+    }
+}
+
+void random_thin_triangles(int count, uint32_t seed, Eigen::MatrixXd& V, Eigen::MatrixXi& F) {
+    std::mt19937 rng(seed);
+    V.resize(3 * count, 3);
+    F.resize(count, 3);
+    for (int k = 0; k < count; k++) {
+        const Eigen::Vector3d p(
+            2.0 * uniform(rng) - 1.0, 2.0 * uniform(rng) - 1.0, 2.0 * uniform(rng) - 1.0);
+        // Random direction (rejection sampled in the unit ball)
+        Eigen::Vector3d d;
+        do {
+            d = Eigen::Vector3d(
+                2.0 * uniform(rng) - 1.0, 2.0 * uniform(rng) - 1.0, 2.0 * uniform(rng) - 1.0);
+        } while (d.squaredNorm() > 1.0 || d.squaredNorm() < 1e-6);
+        d.normalize();
+        const Eigen::Vector3d side = d.unitOrthogonal();
+        const double length = 0.1 + 0.4 * uniform(rng);
+        const double width = 1e-3 * length;
+        V.row(3 * k) = p.transpose();
+        V.row(3 * k + 1) = (p + length * d).transpose();
+        V.row(3 * k + 2) = (p + 0.5 * length * d + width * side).transpose();
+        F.row(k) << 3 * k, 3 * k + 1, 3 * k + 2;
+    }
+}
+
+bool write_obj(const std::string& filename, const Eigen::MatrixXd& V, const Eigen::MatrixXi& F) {
+    FILE* file = std::fopen(filename.c_str(), "w");
+    if (!file) return false;
+    for (int i = 0; i < V.rows(); i++) {
+        std::fprintf(file, "v %.17g %.17g %.17g\n", V(i, 0), V(i, 1), V(i, 2));
+    }
+    for (int i = 0; i < F.rows(); i++) {
+        std::fprintf(file, "f %d %d %d\n", F(i, 0) + 1, F(i, 1) + 1, F(i, 2) + 1);
+    }
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,48 @@
+#ifndef SYNTHETIC_MESHES_H
+#define SYNTHETIC_MESHES_H
+
+#include <cstdint>
+#include <string>
+#include <Eigen/Core>
+
+// Procedural meshes for benchmarks. Every generator is deterministic: the
+// same arguments give bit-identical meshes on every platform (random numbers
+// come from std::mt19937 without the implementation-defined distributions).
+
+// Unit sphere made by recursively splitting the faces of an icosahedron.
+//
+// Inputs:
+//   subdivisions  number of times every triangle is split into 4
+// Outputs:
+//   V  #V by 3 list of vertex positions
+//   F  20 * 4^subdivisions by 3 list of triangle indices (outward facing)
+void subdivided_sphere(int subdivisions, Eigen::MatrixXd& V, Eigen::MatrixXi& F);
+
+// Height field over [-1, 1]^2 in the xz plane with fractal value noise
+// heights (a few octaves, amplitude about 0.3).
+//
+// Inputs:
+//   resolution  vertices along each side (at least 2)
+//   seed  noise seed
+// Outputs:
+//   V  resolution^2 by 3 list of vertex positions
+//   F  2 * (resolution - 1)^2 by 3 list of triangle indices
+void noisy_terrain(int resolution, uint32_t seed, Eigen::MatrixXd& V, Eigen::MatrixXi& F);
+
+// Long, thin triangles scattered with random orientations in [-1, 1]^3, a
+// worst case for bounding-box hierarchies.
+//
+// Inputs:
+//   count  number of triangles
+//   seed  random seed
+// Outputs:
+//   V  3 * count by 3 list of vertex positions
+//   F  count by 3 list of triangle indices
+void random_thin_triangles(int count, uint32_t seed, Eigen::MatrixXd& V, Eigen::MatrixXi& F);
+
+// Write a triangle mesh as an OBJ file (positions and faces only).
+//
+// Returns true on success.
+bool write_obj(const std::string& filename, const Eigen::MatrixXd& V, const Eigen::MatrixXi& F);
+
+#endif
@@ -2,6 +2,8 @@
 #define AABBTREE_H
 
 #include "BoundingBox.h"
+#include "BVHBuildOptions.h"
+#include "BVHStats.h"
 #include "Object.h"
 #include <Eigen/Core>
 #include <memory>
@@ -11,41 +13,63 @@
 // Implementation
 #include "ray_intersect_box.h"
 
-struct AABBTree : public Object, public std::enable_shared_from_this<AABBTree>
+// Pointer-based bounding volume hierarchy over Objects, in double (AABBTree)
+// or single (AABBTreef) precision
+template <typename Scalar>
+struct AABBTreeT : public ObjectT<Scalar>, public std::enable_shared_from_this<AABBTreeT<Scalar> >
 {
+  using Object = ObjectT<Scalar>;
+  using Ray = RayT<Scalar>;
+  using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+  using RowVector3 = Eigen::Matrix<Scalar, 1, 3>;
+  using ObjectT<Scalar>::box;
+
   // Pointers to left and right subtree branches. These could be another
   // AABBTree (internal node) or a leaf (primitive Object like MeshTriangle, or
   // CloudPoint)
   std::shared_ptr<Object> left;
   std::shared_ptr<Object> right;
+  // Objects stored directly in a leaf built by the SAH builder with
+  // max_leaf_size > 1 (left and right are then both null)
+  std::vector<std::shared_ptr<Object> > leaf_objects;
   // For debugging, keep track of the depth (root has depth == 0)
   int depth;
   // For debugging, keep track of the number leaf, descendants 
   int num_leaves;
-  // Construct a axis-aligned bounding box tree given a list of objects. Use the
-  // midpoint along the longest axis of the box containing the given objects to
-  // determine the left-right split.
+  // Construct a axis-aligned bounding box tree given a list of objects. The
+  // left-right split is either the midpoint along the longest axis of the box
+  // containing the given objects or the cheapest binned SAH split, depending
+  // on options.method.
   //
   // Inputs:
   //   objects  list of objects to store in this AABBTree
   //   Optional inputs:
   //     depth  depth of this tree (usually set by constructor of parent as
   //       their depth+1)
+  //     options  builder selection and SAH parameters
   // Side effects: num_leaves is set to objects.size() and left/right pointers
-  // set to subtrees or leaf Objects accordingly.
-  AABBTree(
+  // (or leaf_objects) set to subtrees or leaf Objects accordingly.
+  AABBTreeT(
     const std::vector<std::shared_ptr<Object> > & objects, 
-    int depth=0);
+    int depth=0,
+    const BVHBuildOptions & options = BVHBuildOptions());
+  // Compute quality metrics of this tree.
+  //
+  // Inputs:
+  //   traversal_cost  cost of visiting an internal node relative to one object
+  //     intersection test
+  // Returns node counts, depth and SAH cost of the tree rooted here
+  BVHStats stats(const double traversal_cost = 1.0) const;
   // Object implementations (see Object.h for API)
   bool intersect(
     const Ray & ray, 
-    const double min_t, 
-    double & t, 
-    Eigen::Vector3d & n) const override
+    const Scalar min_t, 
+    Scalar & t, 
+    Vector3 & n) const override
   {
     // Simple wrapper around ray_intersect
     std::shared_ptr<Object> descendant;
-    bool hit = ray_intersect(ray, min_t, std::numeric_limits<double>::infinity(), t, descendant);
+    bool hit = ray_intersect(ray, min_t, std::numeric_limits<Scalar>::infinity(), t, descendant);
     if (hit && descendant) {
       // Get normal from the descendant object
       descendant->intersect(ray, min_t, t, n);
@@ -53,22 +77,42 @@ struct AABBTree : public Object, public std::enable_shared_from_this<AABBTree>
     return hit;
   }
   
+  // (Hit records come from the defaults in Object.h)
+  using Object::ray_intersect;
   bool ray_intersect(
     const Ray& ray,
-    const double min_t,
-    const double max_t,
-    double & t,
+    const Scalar min_t,
+    const Scalar max_t,
+    Scalar & t,
+    std::shared_ptr<Object> & descendant) const override;
+  bool ray_intersect(
+    const PreparedRayT<Scalar> & ray,
+    const Scalar min_t,
+    const Scalar max_t,
+    Scalar & t,
     std::shared_ptr<Object> & descendant) const override;
+  // Any hit: returns as soon as one leaf object blocks the ray
+  bool ray_occluded(
+    const Ray & ray,
+    const Scalar min_t,
+    const Scalar max_t) const override;
+  bool ray_occluded(
+    const PreparedRayT<Scalar> & ray,
+    const Scalar min_t,
+    const Scalar max_t) const override;
+  // Best-first search: subtrees and leaf objects wait in a priority queue
+  // keyed by the squared distance to their boxes, so the closest candidates
+  // are examined first and everything farther than the best distance found
+  // so far is pruned. descendant is set to the closest leaf object.
   bool point_squared_distance(
-    const Eigen::RowVector3d & query,
-    const double min_sqrd,
-    const double max_sqrd,
-    double & sqrd,
-    std::shared_ptr<Object> & descendant) const override
-  {
-    assert(false && "Do not use recursive DFS for AABBTree distance");
-    return false;
-  }
+    const RowVector3 & query,
+    const Scalar min_sqrd,
+    const Scalar max_sqrd,
+    Scalar & sqrd,
+    std::shared_ptr<Object> & descendant) const override;
 };
 
+using AABBTree = AABBTreeT<double>;
+using AABBTreef = AABBTreeT<float>;
+
 #endif
@@ -1,6 +1,8 @@
 #ifndef ASCII_RENDERER_H
 #define ASCII_RENDERER_H
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <Eigen/Core>
@@ -8,23 +10,149 @@
 #include "Camera.h"
 #include "Light.h"
 #include "Ray.h"
+#include "ThreadPool.h"
+#include "TraceZones.h"
+#include "TraversalStats.h"
 #include "viewing_ray.h"
 
+// Result of the primary ray of one character cell, kept between frames so
+// lighting changes can be reshaded without tracing again
+struct GBufferCell {
+    bool hit = false;
+    // Parametric distance of the hit along the cell's viewing ray
+    double depth = 0.0;
+    // Shading normal at the hit
+    Eigen::Vector3d normal = Eigen::Vector3d::Zero();
+    // Index into Scene::F of the triangle hit (-1 if none)
+    int primitive = -1;
+    // Whether the light was blocked at the hit (for the light direction the
+    // cell was last shaded with)
+    bool shadowed = false;
+    // Traversal work of the sample's primary ray (TraversalStats::cost;
+    // rays of a packet share its work evenly). 0 for interpolated samples
+    // and without TRAVERSAL_STATS.
+    uint32_t cost = 0;
+};
+
+// How much of the previous frame the last render() had to redo
+enum class FrameInvalidation {
+    // Nothing changed: the previous frame was reused as is
+    NONE,
+    // Lighting or charset changed: the G-buffer was reshaded (casting shadow
+    // rays again only if the light direction changed)
+    RESHADE,
+    // Camera, scene or tracing options changed: every ray was traced again
+    RETRACE
+};
+
+// Wall-clock time (seconds) of the stages of one render() call
+struct RenderTimings {
+    // Primary rays into the G-buffer (0 unless the frame was retraced)
+    double trace_seconds = 0;
+    // G-buffer to characters, including shadow rays cast while shading
+    double shade_seconds = 0;
+    // Characters to the output string
+    double assembly_seconds = 0;
+};
+
+// How the samples of a character cell are turned into a character
+enum class GlyphMode {
+    // One sample per cell, mapped onto the charset by brightness
+    CHARSET,
+    // 2x4 samples per cell: covered cells are mapped by brightness, cells on
+    // a silhouette get the ASCII glyph whose shape best matches the samples
+    // that hit
+    SHAPES,
+    // 2x4 samples per cell drawn as Unicode Braille dots (one dot per sample,
+    // dithered by brightness)
+    BRAILLE,
+    // 2x2 samples per cell drawn as Unicode quadrant and half blocks
+    BLOCKS
+};
+
 class ASCIIRenderer {
 public:
+    // Columns of the character grid
     int resolution;
+    // Rows of the character grid; 0 uses resolution / 2 (a square view for
+    // characters twice as tall as wide)
+    int grid_rows;
     double ambient_strength;
     DirectionalLight light;
     
     int charset_type;
     std::vector<std::string> charsets;
+    // Sub-sampling and characters of the output. The Unicode modes encode
+    // each cell as UTF-8 (3 bytes) and ignore the charset.
+    GlyphMode glyph_mode;
     double aspect_ratio_correction;
+    // Trace prepared rays with the watertight triangle test (no stray
+    // background characters along shared edges); false uses the plain
+    // Ray path
+    bool use_prepared_rays;
+    // Primary rays traced together per packet: 1 (one ray at a time), 4, 8
+    // or 16 (tiles of 2x2, 4x2 or 4x4 cells, always with prepared rays)
+    int packet_size;
+    // Threads rendering tiles of the frame (0 = one per hardware thread)
+    int num_threads;
+    // Cast a shadow ray towards the light from every lit hit point
+    bool shadows;
+    // Adaptive sampling: 1 traces every cell. 2, 4 or 8 (at most
+    // MAX_ADAPTIVE_STEP; other values trace every cell) first traces every
+    // adaptive_step-th cell of every adaptive_step-th row, then traces the
+    // cells of a block between four such samples only if the samples
+    // disagree (hit/miss, shading, shadow) and interpolates them otherwise.
+    int adaptive_step;
+    // Quality knob of adaptive sampling: largest difference (in characters
+    // of the charset) between the samples of a block that is interpolated
+    int adaptive_tolerance;
+    // Also trace blocks whose samples hit different triangles (exact
+    // creases on coarse meshes; on dense meshes nearly every block)
+    bool adaptive_refine_primitives;
+    // Draw the traversal cost of every sample (GBufferCell::cost) instead of
+    // its shading, from blank (no work) to the last character of the charset
+    // (heatmap_max_cost or more). Needs TRAVERSAL_STATS; blank without it.
+    bool heatmap;
+    // Cost drawn at full brightness in the heatmap (0 = the largest cost of
+    // the frame)
+    int heatmap_max_cost;
+    
+    // What the last render() call redid, and the rays it traced
+    FrameInvalidation last_invalidation;
+    int primary_rays_traced;
+    int shadow_rays_traced;
+    RenderTimings last_timings;
+    // Traversal work of the rays of the last render() call, primary and
+    // shadow (all zero without TRAVERSAL_STATS)
+    TraversalStats last_traversal_stats;
+    
+    // Cells per render tile (one task each); multiples of every packet tile
+    static constexpr int TILE_WIDTH = 32;
+    static constexpr int TILE_HEIGHT = 16;
+    // Largest adaptive_step used (larger steps trace every cell)
+    static constexpr int MAX_ADAPTIVE_STEP = 8;
     
     ASCIIRenderer() 
         : resolution(80)
+        , grid_rows(0)
         , ambient_strength(0.2)
         , charset_type(0)
+        , glyph_mode(GlyphMode::CHARSET)
         , aspect_ratio_correction(1.0)
+        , use_prepared_rays(true)
+        , packet_size(16)
+        , num_threads(0)
+        , shadows(false)
+        , adaptive_step(1)
+        , adaptive_tolerance(0)
+        , adaptive_refine_primitives(false)
+        , heatmap(false)
+        , heatmap_max_cost(0)
+        , last_invalidation(FrameInvalidation::RETRACE)
+        , primary_rays_traced(0)
+        , shadow_rays_traced(0)
+        , shadow_bias(0.0)
+        , heatmap_scale(1.0)
     {
         charsets.push_back(" .:-=+*#%@");
         charsets.push_back(" .'`^\",:;Il!i><~+_-?][}{1)(|\\/tfjrxnuvczXYUJCLQ0OZmwqpdbkhao*#MW&8%B@$");
@@ -33,14 +161,161 @@ public:
     }
     
     std::string render(const Scene& scene, const Camera& camera);
-    char trace_ray(const Scene& scene, const Ray& ray, const std::string& charset);
-    double calculate_brightness(const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir);
+    // Render into `output`, reusing its storage: grid_height rows of
+    // grid_width characters, each followed by '\n'. Tiles are rendered in
+    // parallel; the result does not depend on the number of threads.
+    //
+    // Rays are traced on the sample grid (get_sample_grid_size), which
+    // splits every character cell into the sub-samples of glyph_mode.
+    //
+    // Primary hits of the samples are cached in a G-buffer: a frame with the same scene
+    // (pointer and Scene::version), camera and tracing options as the
+    // previous one is only reshaded, or copied as is if the lighting and
+    // charset did not change either (see last_invalidation). Reshading keeps
+    // the blocks adaptive sampling chose to interpolate.
+    void render(const Scene& scene, const Camera& camera, std::string& output);
+    // Force the next render() to trace every ray again
+    void invalidate();
+    // Trace the samples [row, row + rows) x [col, col + cols) into the
+    // G-buffer
+    void render_tile(const Scene& scene, const Camera& camera, int row, int col,
+                     int rows, int cols);
+    void trace_ray(const Scene& scene, const Ray& ray, GBufferCell& cell);
+    // Trace the samples [row, row + rows) x [col, col + cols) as one packet
+    // into the G-buffer
+    void trace_tile(const Scene& scene, const Camera& camera, int row, int col,
+                    int rows, int cols);
+    // Shade the character cells [row, row + rows) x [col, col + cols) from
+    // their G-buffer samples into `glyphs` (grid_height rows of grid_width
+    // code points), casting the samples' shadow rays again if `cast_shadows`
+    // (otherwise their shadowed flags are reused). Returns the number of
+    // shadow rays cast.
+    int shade_tile(const Scene& scene, const Camera& camera, int row, int col,
+                   int rows, int cols, bool cast_shadows, const std::string& charset,
+                   std::vector<char32_t>& glyphs);
+    // Ambient plus the directional light's diffuse term on the side of the
+    // surface facing the viewer; the diffuse term is dropped when `in_shadow`
+    double calculate_brightness(const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir,
+                                bool in_shadow = false);
+    // Whether `shadows` is on and something blocks the light from the hit
+    // point `point` seen along `view_dir` (only lit points cast a ray)
+    bool in_shadow(const Scene& scene, const Eigen::Vector3d& point,
+                   const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir) const;
     char brightness_to_char(double brightness, const std::string& charset);
+    // Character of a cell in glyph_mode, from the brightness of its samples
+    // (row-major within the cell) and a mask of the samples that hit
+    char32_t cell_glyph(unsigned coverage, const double* brightness, const std::string& charset) const;
     
     void get_grid_size(int& width, int& height) const {
         width = resolution;
-        height = resolution / 2;
+        height = grid_rows > 0 ? grid_rows : resolution / 2;
     }
+    // Samples per character cell along x and y in glyph_mode
+    void get_subsamples(int& x, int& y) const {
+        x = glyph_mode == GlyphMode::CHARSET ? 1 : 2;
+        y = glyph_mode == GlyphMode::CHARSET ? 1 : glyph_mode == GlyphMode::BLOCKS ? 2 : 4;
+    }
+    // Grid of the primary rays: every cell of the character grid split
+    // into its sub-samples
+    void get_sample_grid_size(int& width, int& height) const {
+        int x, y;
+        get_grid_size(width, height);
+        get_subsamples(x, y);
+        width *= x;
+        height *= y;
+    }
+    
+private:
+    // Everything the G-buffer depends on (width and height are those of the
+    // sample grid)
+    struct TraceState {
+        const Scene* scene = nullptr;
+        uint64_t scene_version = 0;
+        Camera camera;
+        int width = 0;
+        int height = 0;
+        bool use_prepared_rays = false;
+        int packet_size = 0;
+        int adaptive_step = 1;
+        int adaptive_tolerance = 0;
+        bool adaptive_refine_primitives = false;
+        // Light direction shadows were settled for while tracing (zero if
+        // they are left to shading)
+        Eigen::Vector3d shadow_direction = Eigen::Vector3d::Zero();
+        
+        bool operator==(const TraceState& other) const;
+    };
+    // Everything shading the G-buffer depends on
+    struct ShadeState {
+        DirectionalLight light;
+        double ambient_strength = 0.0;
+        std::string charset;
+        GlyphMode glyph_mode = GlyphMode::CHARSET;
+        bool shadows = false;
+        bool heatmap = false;
+        int heatmap_max_cost = 0;
+        
+        bool operator==(const ShadeState& other) const;
+    };
+    
+    // Rays traced for part of a frame and the traversal work they did
+    struct RayCount {
+        int primary = 0;
+        int shadow = 0;
+        TraversalStats traversal;
+        
+        RayCount& operator+=(const RayCount& other) {
+            primary += other.primary;
+            shadow += other.shadow;
+            traversal += other.traversal;
+            return *this;
+        }
+    };
+    
+    // Pool of num_threads threads (recreated when num_threads changes)
+    ThreadPool& get_thread_pool();
+    // Run fn(row, col, rows, cols) for every render tile, in parallel, and
+    // add up the RayCounts it returns (with the traversal work each task did
+    // on its thread). Every task is a trace zone named `zone`.
+    template <typename Fn>
+    RayCount for_each_tile(const char* zone, int grid_width, int grid_height, const Fn& fn);
+    // Trace the n <= RAY_PACKET_MAX_SIZE samples with indices `cells` (row *
+    // sample grid width + column) into the G-buffer as one packet
+    void trace_packet(const Scene& scene, const Camera& camera, const int* cells, int n);
+    // Trace n samples into the G-buffer, in packets of packet_size
+    void trace_cells(const Scene& scene, const Camera& camera, const int* cells, int n);
+    // Whether adaptive sampling is on (adaptive_step divides the tile size)
+    bool adaptive() const;
+    // Whether sample (i, j) is traced in the first pass of adaptive sampling
+    bool is_sample(int i, int j) const;
+    // First pass of adaptive sampling over a tile: trace its samples
+    RayCount trace_samples(const Scene& scene, const Camera& camera, int row, int col,
+                           int rows, int cols);
+    // Second pass: trace or interpolate the other cells of the tile
+    RayCount refine_tile(const Scene& scene, const Camera& camera, int row, int col,
+                         int rows, int cols, const std::string& charset);
+    // Set the shadowed flag of n samples; returns the number of rays cast
+    int update_shadows(const Scene& scene, const Camera& camera, const int* cells, int n);
+    // Set cell.shadowed for the hit of `view_ray`; returns whether a shadow
+    // ray was cast (not for misses, unlit points, or with shadows off)
+    bool update_shadow(const Scene& scene, const Ray& view_ray, GBufferCell& cell) const;
+    
+    std::shared_ptr<ThreadPool> thread_pool;
+    // Offset of shadow ray origins off the surface, set per frame from the
+    // size of the scene
+    double shadow_bias;
+    // Cost drawn at full brightness by the heatmap, set per frame
+    double heatmap_scale;
+    
+    // One cell per sample of the sample grid
+    std::vector<GBufferCell> gbuffer;
+    // Characters of the last frame, one per cell
+    std::vector<char32_t> glyphs;
+    // Last rendered frame (UTF-8) and the state it was traced and shaded with
+    std::string frame;
+    bool frame_valid = false;
+    TraceState traced;
+    ShadeState shaded;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef ANSI_FRAME_WRITER_H
+#define ANSI_FRAME_WRITER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Turns a sequence of rendered frames into output for an ANSI terminal. The
+// first frame is drawn in full; every later frame of the same size only
+// redraws the runs of cells that changed since the previous one, each behind
+// a cursor-positioning escape, so the bytes written per frame follow what
+// changed rather than the size of the frame.
+//
+// Frames are rows of UTF-8 characters, each row ended by '\n', as
+// ASCIIRenderer::render produces them (one character per terminal cell).
+class AnsiFrameWriter {
+public:
+    // Screen row the frame starts on (1-based)
+    int top_row = 1;
+
+    // Append to `output` the escape sequences and characters that turn the
+    // screen from the previously written frame into `frame`. Frames with a
+    // different size (or rows of different lengths) are drawn in full after
+    // clearing the screen.
+    void write(const std::string& frame, std::string& output);
+    // Draw the next frame in full (e.g. after the terminal was resized or
+    // cleared by someone else)
+    void reset();
+
+    // Cells drawn by the last write (all of them for a full redraw)
+    int changed_cells = 0;
+
+private:
+    // Split `frame` into cells: byte offset of every cell, row by row, and
+    // the grid size. Returns false if the rows are not all the same length.
+    static bool split_cells(const std::string& frame, std::vector<size_t>& offsets,
+                            int& width, int& height);
+
+    // Previously written frame and its cells
+    std::string previous;
+    std::vector<size_t> previous_offsets;
+    int width = 0;
+    int height = 0;
+    bool valid = false;
+
+    // Cells of the frame being written
+    std::vector<size_t> offsets;
+};
+
+#endif
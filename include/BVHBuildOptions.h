@@ -0,0 +1,58 @@
+#ifndef BVH_BUILD_OPTIONS_H
+#define BVH_BUILD_OPTIONS_H
+
+#include "LoadProgress.h"
+#include "TriangleBlock.h"
+
+// Strategy used to divide a set of objects between the two children of a BVH
+// node.
+enum class BVHSplitMethod
+{
+  // Split at the midpoint of the longest axis of the node's box (falls back to
+  // an even split in input order if everything lands on one side)
+  MIDPOINT,
+  // Binned surface area heuristic (SAH) over the object centroids
+  SAH,
+  // SAH that may also split space, referencing an object from both children
+  // when that is cheaper (spatial-split BVH). Only LinearBVH supports it;
+  // AABBTree treats it as SAH.
+  SBVH
+};
+
+// Parameters controlling BVH construction.
+struct BVHBuildOptions
+{
+  BVHSplitMethod method = BVHSplitMethod::SAH;
+  // Number of equal-width centroid bins per axis evaluated by the SAH builder
+  int num_bins = 16;
+  // Largest number of objects the SAH builder may keep in a single leaf.
+  // (The midpoint builder always splits down to one object per leaf.)
+  int max_leaf_size = 8;
+  // Number of objects a leaf intersects at once (WideBVH tests triangles a
+  // TriangleBlock at a time; use 1 for the binary LinearBVH traversal). The
+  // SAH charges a leaf of n objects ceil(n / leaf_block_size) intersection
+  // tests. AABBTree ignores this.
+  int leaf_block_size = TRIANGLE_BLOCK_WIDTH;
+  // Cost of visiting an internal node relative to one object intersection
+  // test (the SAH traversal/intersection cost ratio)
+  double traversal_cost = 1.0;
+  // Number of threads used by LinearBVH construction (0 = one per hardware
+  // thread, 1 = serial; SBVH builds are always serial)
+  int num_threads = 0;
+  // SBVH: extra object references the build may create, as a fraction of the
+  // number of objects (0.3 = up to 30% more references than objects)
+  double max_reference_growth = 0.3;
+  // SBVH: spatial splits are only tried in nodes whose object-split children
+  // overlap by more than this fraction of the root's surface area
+  double spatial_split_alpha = 1e-5;
+  // Branching factor of the hierarchy used for traversal: 2 (the binary
+  // LinearBVH itself), 4 or 8 (a WideBVH collapsed from it)
+  int branching_factor = 4;
+  // If set, LinearBVH construction counts the objects it places into leaves
+  // in objects_placed, and when it is cancelled finishes every remaining
+  // subtree as a single leaf (the result is valid but not worth keeping).
+  // AABBTree ignores this.
+  LoadProgress * progress = nullptr;
+};
+
+#endif
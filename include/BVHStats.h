@@ -0,0 +1,19 @@
+#ifndef BVH_STATS_H
+#define BVH_STATS_H
+
+// Quality metrics of a built BVH, used to compare builders on the same mesh.
+struct BVHStats
+{
+  // Total number of nodes (internal + leaf)
+  int num_nodes = 0;
+  // Number of leaf nodes (nodes that hold objects directly)
+  int num_leaf_nodes = 0;
+  // Depth of the deepest node (root has depth == 0)
+  int max_depth = 0;
+  // Expected cost of a random ray hitting the root according to the surface
+  // area heuristic: traversal_cost * sum of internal node areas plus number of
+  // objects times area for every leaf, all relative to the root area.
+  double sah_cost = 0;
+};
+
+#endif
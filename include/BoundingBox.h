@@ -1,24 +1,36 @@
 #ifndef BOUNDING_BOX_H
 #define BOUNDING_BOX_H
 #include <Eigen/Core>
+#include <limits>
 
 // Should change this name to AABB or AlignedBox
-struct BoundingBox
+template <typename Scalar>
+struct BoundingBoxT
 {
-  Eigen::RowVector3d min_corner;
-  Eigen::RowVector3d max_corner;
-  BoundingBox(
-    Eigen::RowVector3d a_min_corner = 
-      Eigen::RowVector3d::Constant(1,3, std::numeric_limits<double>::infinity()),
-    Eigen::RowVector3d a_max_corner = 
-      Eigen::RowVector3d::Constant(1,3,-std::numeric_limits<double>::infinity()))
+  using RowVector3 = Eigen::Matrix<Scalar, 1, 3>;
+  RowVector3 min_corner;
+  RowVector3 max_corner;
+  BoundingBoxT(
+    RowVector3 a_min_corner = 
+      RowVector3::Constant(1,3, std::numeric_limits<Scalar>::infinity()),
+    RowVector3 a_max_corner = 
+      RowVector3::Constant(1,3,-std::numeric_limits<Scalar>::infinity()))
     :
       min_corner(std::move(a_min_corner)),
       max_corner(std::move(a_max_corner))
   { }
-  Eigen::RowVector3d center()
+  RowVector3 center() const
   {
-    return 0.5*(max_corner + min_corner);
+    return Scalar(0.5)*(max_corner + min_corner);
+  }
+  // Surface area of the box (0 for an empty box)
+  Scalar surface_area() const
+  {
+    const RowVector3 d = (max_corner - min_corner).cwiseMax(Scalar(0));
+    return Scalar(2)*(d(0)*d(1) + d(1)*d(2) + d(2)*d(0));
   }
 };
+
+using BoundingBox = BoundingBoxT<double>;
+using BoundingBoxf = BoundingBoxT<float>;
 #endif
@@ -0,0 +1,23 @@
+#ifndef HIT_RECORD_H
+#define HIT_RECORD_H
+
+// Closest hit of a ray, as returned by the BVH traversals: plain values, so
+// leaf tests write it without allocating or touching reference counts.
+template <typename Scalar>
+struct HitRecordT
+{
+  // Parametric distance of the hit: ray.origin + t * ray.direction
+  Scalar t = 0;
+  // Barycentric coordinates of the hit on a triangle (A, B, C):
+  //   p = (1 - u - v) A + u B + v C
+  // (0 for objects that are not triangles)
+  Scalar u = 0;
+  Scalar v = 0;
+  // Index (into the list the BVH was built from) of the object hit, or -1
+  int primitive = -1;
+};
+
+using HitRecord = HitRecordT<double>;
+using HitRecordf = HitRecordT<float>;
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "AABBTree.h"
+#include "BVHBuildOptions.h"
+#include "BVHStats.h"
+#include "BoundingBox.h"
+#include "MappedVector.h"
+#include "Object.h"
+#include "PreparedRay.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// One node of a LinearBVH. Nodes are stored depth-first so the first child of
+// an internal node always immediately follows it.
+struct LinearBVHNode
+{
+  // Bounds rounded outward to single precision so they stay conservative
+  float min_corner[3];
+  float max_corner[3];
+  // Leaf: index of the first object in LinearBVH::primitives
+  // Internal: index of the second child
+  int32_t offset;
+  // Number of objects in a leaf (0 for internal nodes)
+  uint16_t count;
+  // Split axis of an internal node, used to visit the nearer child first
+  uint8_t axis;
+  uint8_t pad;
+
+  // Set the bounds to box rounded outward to float
+  void set_box(const BoundingBox & box);
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+
+// Pointer-free bounding volume hierarchy stored as a flat array of nodes.
+// Leaves reference contiguous runs of objects. The objects themselves are not
+// owned: the list the BVH was built from must outlive it. Nodes and
+// primitive_indices may view a mapped scene cache (see MappedVector.h).
+struct LinearBVH
+{
+  MappedVector<LinearBVHNode> nodes;
+  // Objects in leaf order
+  std::vector<const Object *> primitives;
+  // primitive_indices[i] is the index of primitives[i] in the object list the
+  // BVH was built from
+  MappedVector<int> primitive_indices;
+  // Depth of the deepest node (root has depth == 0)
+  int max_depth = 0;
+  // Bytes of scratch and output memory held at the peak of the build that
+  // produced this BVH
+  size_t build_peak_bytes = 0;
+
+  LinearBVH() {}
+  // Build directly from a list of objects. Subtrees over large ranges are
+  // built as parallel tasks on a ThreadPool of options.num_threads threads,
+  // partitioning a single array of object indices in place.
+  //
+  // Inputs:
+  //   objects  list of objects to store in the BVH
+  //   options  builder selection and SAH parameters (see BVHBuildOptions.h)
+  LinearBVH(
+    const std::vector<std::shared_ptr<Object> > & objects,
+    const BVHBuildOptions & options = BVHBuildOptions());
+  // Flatten an existing AABBTree. The tree's topology is kept as is.
+  //
+  // Inputs:
+  //   tree  tree built over (a subset of) objects
+  //   objects  list of objects the tree was built from
+  LinearBVH(
+    const AABBTree & tree,
+    const std::vector<std::shared_ptr<Object> > & objects);
+
+  // Spatial-split build used by the constructor when options.method is SBVH.
+  // Objects straddling a split plane may be referenced from several leaves,
+  // so primitives can be longer than objects.
+  void build_spatial_split(
+    const std::vector<std::shared_ptr<Object> > & objects,
+    const BVHBuildOptions & options);
+
+  bool empty() const { return nodes.empty(); }
+  // Bounding box of the whole hierarchy
+  BoundingBox box() const;
+  // Bytes used by nodes and primitive lists
+  size_t memory_bytes() const;
+  // Compute quality metrics (see BVHStats.h).
+  BVHStats stats(const double traversal_cost = 1.0) const;
+  // Recompute all node bounds bottom-up from the objects' current boxes,
+  // keeping the topology (e.g. after the mesh's vertices moved).
+  //
+  // Inputs:
+  //   pool  threads to refit with
+  //   traversal_cost  see BVHBuildOptions::traversal_cost
+  // Returns the SAH cost of the refit hierarchy (see BVHStats::sah_cost)
+  double refit(ThreadPool & pool, const double traversal_cost = 1.0);
+
+  // Find the closest object hit by a ray. Traversal is iterative, visits the
+  // nearer child first and shrinks max_t as hits are found.
+  //
+  // Inputs:
+  //   ray  ray to intersect with
+  //   min_t  minimum parametric distance to consider
+  //   max_t  maximum parametric distance to consider
+  // Outputs:
+  //   hit  distance and barycentric coordinates of the closest hit, and the
+  //     index (into the list the BVH was built from) of the object hit as
+  //     hit.primitive (see HitRecord.h)
+  // Returns true iff there is an intersection
+  bool ray_intersect(
+    const Ray & ray,
+    const double min_t,
+    const double max_t,
+    HitRecord & hit) const;
+  // Same as above for a prepared ray; leaf objects are tested with their
+  // prepared-ray (watertight for MeshTriangle) ray_intersect.
+  bool ray_intersect(
+    const PreparedRay & ray,
+    const double min_t,
+    const double max_t,
+    HitRecord & hit) const;
+  // Is the ray blocked by any object in [min_t, max_t]? Stops at the first
+  // hit found (not necessarily the closest), e.g. for shadow rays.
+  //
+  // Inputs:
+  //   ray  ray to test
+  //   min_t  minimum parametric distance to consider
+  //   max_t  maximum parametric distance to consider
+  // Returns true iff some object is hit
+  bool ray_occluded(
+    const Ray & ray,
+    const double min_t,
+    const double max_t) const;
+  // Same as above for a prepared ray (watertight for MeshTriangle)
+  bool ray_occluded(
+    const PreparedRay & ray,
+    const double min_t,
+    const double max_t) const;
+  // Find the object closest to a point. Best-first search: nodes wait in a
+  // priority queue keyed by the squared distance to their boxes, and the
+  // search stops once the nearest waiting box is farther than the closest
+  // object found.
+  //
+  // Inputs:
+  //   query  query point
+  //   min_sqrd  minimum squared distance to consider
+  //   max_sqrd  maximum squared distance to consider
+  // Outputs:
+  //   sqrd  squared distance to the closest object
+  //   hit_index  index (into the list the BVH was built from) of that object
+  // Returns true iff some object is within [min_sqrd, max_sqrd]
+  bool point_squared_distance(
+    const Eigen::RowVector3d & query,
+    const double min_sqrd,
+    const double max_sqrd,
+    double & sqrd,
+    int & hit_index) const;
+  // Find the closest hit of every ray of a packet (prepared-ray tests). The
+  // rays descend together with a mask of the rays that hit each node. The
+  // packet's frustum (RayPacket::classify_box) decides a node for all rays
+  // at once when it can: missed by all, or hit by all. Otherwise each ray is
+  // tested on its own, so rays that diverge drop out of the mask and the
+  // packet degrades gracefully to single-ray traversal.
+  //
+  // Inputs:
+  //   packet  rays to intersect with
+  //   min_t  minimum parametric distance to consider
+  //   max_t  maximum parametric distance to consider
+  // Outputs:
+  //   hits  packet.size closest hits (only those of rays that hit are set)
+  // Returns mask of the rays that hit something (bit i for packet.rays[i])
+  unsigned ray_intersect_packet(
+    const RayPacket & packet,
+    const double min_t,
+    const double max_t,
+    HitRecord * hits) const;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef LOAD_PROGRESS_H
+#define LOAD_PROGRESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// Stages of a scene load, in order
+enum class LoadStage
+{
+  READING,
+  NORMALS,
+  PRIMITIVES,
+  BUILDING_BVH,
+  DONE,
+  FAILED,
+  CANCELLED
+};
+
+inline const char * load_stage_name(const LoadStage stage)
+{
+  switch (stage) {
+    case LoadStage::READING: return "Reading";
+    case LoadStage::NORMALS: return "Normals";
+    case LoadStage::PRIMITIVES: return "Primitives";
+    case LoadStage::BUILDING_BVH: return "Building BVH";
+    case LoadStage::DONE: return "Done";
+    case LoadStage::FAILED: return "Failed";
+    case LoadStage::CANCELLED: return "Cancelled";
+  }
+  return "";
+}
+
+// Progress of a scene load running on another thread, and the flag that
+// cancels it. The loading threads update the counters and poll the flag;
+// any thread may read them (relaxed: the values are only displayed).
+struct LoadProgress
+{
+  std::atomic<LoadStage> stage{LoadStage::READING};
+  // OBJ bytes parsed so far, of bytes_total (the file size)
+  std::atomic<uint64_t> bytes_parsed{0};
+  std::atomic<uint64_t> bytes_total{0};
+  // Object references placed into BVH leaves so far, of objects_total (a
+  // spatial-split build may place more references than there are objects)
+  std::atomic<uint64_t> objects_placed{0};
+  std::atomic<uint64_t> objects_total{0};
+  std::atomic<bool> cancel_requested{false};
+
+  // Ask the load to stop as soon as possible; its result is to be discarded
+  void cancel() { cancel_requested.store(true, std::memory_order_relaxed); }
+  bool cancelled() const { return cancel_requested.load(std::memory_order_relaxed); }
+
+  void add_bytes_parsed(const uint64_t bytes)
+  {
+    bytes_parsed.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  void add_objects_placed(const uint64_t objects)
+  {
+    objects_placed.fetch_add(objects, std::memory_order_relaxed);
+  }
+
+  // Fraction in [0, 1] of the current stage that is done, where it is known
+  float fraction() const
+  {
+    const LoadStage current = stage.load(std::memory_order_relaxed);
+    uint64_t done = 0, total = 0;
+    if (current == LoadStage::READING) {
+      done = bytes_parsed.load(std::memory_order_relaxed);
+      total = bytes_total.load(std::memory_order_relaxed);
+    } else if (current == LoadStage::BUILDING_BVH) {
+      done = objects_placed.load(std::memory_order_relaxed);
+      total = objects_total.load(std::memory_order_relaxed);
+    } else {
+      return current == LoadStage::DONE ? 1.0f : 0.0f;
+    }
+    return total == 0 ? 0.0f : std::min(1.0f, static_cast<float>(done) / total);
+  }
+};
+
+#endif
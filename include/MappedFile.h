@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file: memory-mapped where available (so
+// processes mapping the same file share its pages), read into memory
+// otherwise
+class MappedFile
+{
+public:
+  // Inputs:
+  //   filename  file to map
+  //   sequential  whether the file will be read front to back (the kernel
+  //     then reads ahead aggressively); otherwise all of it is prefetched
+  explicit MappedFile(const std::string & filename, const bool sequential = true);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  // Whether the file could be opened and mapped (an empty file maps to
+  // data() == nullptr, size() == 0)
+  bool is_open() const { return opened; }
+  // First byte of the file, aligned to at least 64 bytes
+  const char * data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  bool opened = false;
+  const char * bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  std::vector<char> buffer;
+#endif
+};
+
+#endif
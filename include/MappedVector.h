@@ -0,0 +1,74 @@
+#ifndef MAPPED_VECTOR_H
+#define MAPPED_VECTOR_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Array that either owns its elements (a std::vector) or views read-only
+// elements it does not own, e.g. a section of a mapped scene cache, so they
+// are used in place. Reads work the same either way. Anything that writes
+// (the non-const operator[], resize, push_back, owned(), ...) first copies
+// viewed elements into owned storage, so a view is only copied once it is
+// modified. Viewed elements must outlive the view and its copies.
+template <typename T>
+class MappedVector
+{
+public:
+  MappedVector() {}
+  MappedVector(std::vector<T> elements)
+  : storage(std::move(elements))
+  {}
+  MappedVector & operator=(std::vector<T> elements)
+  {
+    storage = std::move(elements);
+    mapped = nullptr;
+    mapped_size = 0;
+    return *this;
+  }
+
+  // View `size` elements at `data` instead of the owned ones
+  void view(const T * data, const size_t size)
+  {
+    storage = std::vector<T>();
+    mapped = data;
+    mapped_size = size;
+  }
+  // Whether the elements are viewed rather than owned
+  bool is_view() const { return mapped != nullptr; }
+
+  size_t size() const { return mapped ? mapped_size : storage.size(); }
+  bool empty() const { return size() == 0; }
+  // Elements held, viewed or allocated
+  size_t capacity() const { return mapped ? mapped_size : storage.capacity(); }
+  const T * data() const { return mapped ? mapped : storage.data(); }
+  const T * begin() const { return data(); }
+  const T * end() const { return data() + size(); }
+  const T & operator[](const size_t i) const { return data()[i]; }
+
+  // Writable owned elements (copies of the viewed ones, if any)
+  std::vector<T> & owned()
+  {
+    if (mapped) {
+      storage.assign(mapped, mapped + mapped_size);
+      mapped = nullptr;
+      mapped_size = 0;
+    }
+    return storage;
+  }
+  T & operator[](const size_t i) { return owned()[i]; }
+  void push_back(const T & value) { owned().push_back(value); }
+  template <typename... Args>
+  void emplace_back(Args &&... args) { owned().emplace_back(std::forward<Args>(args)...); }
+  void resize(const size_t size) { owned().resize(size); }
+  void reserve(const size_t size) { owned().reserve(size); }
+  void shrink_to_fit() { owned().shrink_to_fit(); }
+  void clear() { *this = std::vector<T>(); }
+
+private:
+  std::vector<T> storage;
+  const T * mapped = nullptr;
+  size_t mapped_size = 0;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MESH_ANIMATION_H
+#define MESH_ANIMATION_H
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+// Vertex animation of a mesh with fixed topology: a list of keyframes of
+// vertex positions, each with a time stamp.
+struct MeshAnimation
+{
+  // Keyframe vertex positions, each #V by 3
+  std::vector<Eigen::MatrixXd> frames;
+  // Time (in seconds) of each keyframe, increasing
+  std::vector<double> times;
+  // Interpolate linearly between keyframes (otherwise hold the last one)
+  bool interpolate = true;
+  // Wrap time around at the end of the animation
+  bool loop = true;
+
+  bool empty() const { return frames.empty(); }
+  // Time of the last keyframe
+  double duration() const { return times.empty() ? 0.0 : times.back(); }
+
+  // Load a sequence of OBJ files sharing the same faces. Frames are read
+  // from printf-style `pattern` (e.g. "walk_%03d.obj") with increasing
+  // numbers, starting at 0 or 1, until a file is missing.
+  //
+  // Inputs:
+  //   pattern  printf-style path pattern with one integer conversion
+  //   frames_per_second  playback rate of the sequence
+  // Outputs:
+  //   F  #F by 3 faces of the first frame
+  // Returns true iff at least one frame was loaded and every frame has the
+  // same number of vertices and the same faces
+  bool load_obj_sequence(
+    const std::string & pattern,
+    const double frames_per_second,
+    Eigen::MatrixXi & F);
+
+  // Vertex positions at a given time.
+  //
+  // Inputs:
+  //   time  time in seconds
+  // Outputs:
+  //   V  #V by 3 vertex positions
+  void sample(const double time, Eigen::MatrixXd & V) const;
+};
+
+#endif
@@ -6,15 +6,30 @@
 #include <memory>
 #include <cassert>
 
-struct MeshTriangle : public Object
+// Triangle of an indexed mesh, in double (MeshTriangle) or single
+// (MeshTrianglef) precision
+template <typename Scalar>
+struct MeshTriangleT : public ObjectT<Scalar>
 {
   public:
+    using Object = ObjectT<Scalar>;
+    using Ray = RayT<Scalar>;
+    using BoundingBox = BoundingBoxT<Scalar>;
+    using MatrixX = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    // Meshes are referenced through maps, so they may live in owned
+    // matrices or in a mapped scene cache alike
+    using MatrixXMap = Eigen::Map<const MatrixX>;
+    using FacesMap = Eigen::Map<const Eigen::MatrixXi>;
+    using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+    using RowVector3 = Eigen::Matrix<Scalar, 1, 3>;
+    using ObjectT<Scalar>::box;
+
     // Pointer to mesh vertex position list
-    const Eigen::MatrixXd & V;
+    const MatrixXMap & V;
     // Pointer to mesh indices list
-    const Eigen::MatrixXi & F;
+    const FacesMap & F;
     // Pointer to vertex normals (optional, can be nullptr)
-    const Eigen::MatrixXd * N;
+    const MatrixXMap * N;
     // face index
     int f;
     
@@ -27,55 +42,104 @@ struct MeshTriangle : public Object
     //   f  index of triangle in _F
     //   N  optional pointer to vertex normals
     // Side effects: inserts this triangle into .box (see Object.h)
-    inline MeshTriangle(
-      const Eigen::MatrixXd & V,
-      const Eigen::MatrixXi & F,
+    inline MeshTriangleT(
+      const MatrixXMap & V,
+      const FacesMap & F,
       const int f,
-      const Eigen::MatrixXd * N = nullptr);
+      const MatrixXMap * N = nullptr);
       
     // Get normal at a point (can use face normal or interpolated vertex normals)
-    inline Eigen::Vector3d get_normal(const Eigen::Vector3d & p) const;
+    inline Vector3 get_normal(const Vector3 & p) const;
     
     // Object implementations (see Object.h)
     inline bool intersect(
       const Ray & ray, 
-      const double min_t, 
-      double & t, 
-      Eigen::Vector3d & n) const override;
+      const Scalar min_t, 
+      Scalar & t, 
+      Vector3 & n) const override;
       
     inline bool ray_intersect(
       const Ray& ray,
-      const double min_t,
-      const double max_t,
-      double & t,
+      const Scalar min_t,
+      const Scalar max_t,
+      Scalar & t,
+      std::shared_ptr<Object> & descendant) const override;
+    // Watertight test (see ray_intersect_triangle.h)
+    inline bool ray_intersect(
+      const PreparedRayT<Scalar> & ray,
+      const Scalar min_t,
+      const Scalar max_t,
+      Scalar & t,
       std::shared_ptr<Object> & descendant) const override;
+    // Hit records carry the triangle's barycentric coordinates
+    inline bool ray_intersect(
+      const Ray & ray,
+      const Scalar min_t,
+      const Scalar max_t,
+      HitRecordT<Scalar> & hit) const override;
+    inline bool ray_intersect(
+      const PreparedRayT<Scalar> & ray,
+      const Scalar min_t,
+      const Scalar max_t,
+      HitRecordT<Scalar> & hit) const override;
+    inline bool ray_occluded(
+      const Ray & ray,
+      const Scalar min_t,
+      const Scalar max_t) const override;
+    inline bool ray_occluded(
+      const PreparedRayT<Scalar> & ray,
+      const Scalar min_t,
+      const Scalar max_t) const override;
       
+    // Exact distance (see point_triangle_squared_distance.h)
     inline bool point_squared_distance(
-      const Eigen::RowVector3d & query,
-      const double min_sqrd,
-      const double max_sqrd,
-      double & sqrd,
-      std::shared_ptr<Object> & descendant) const override
-    {
-      // Not implemented for this assignment
-      assert(false && "point_squared_distance not implemented for MeshTriangle");
-      return false;
-    }
+      const RowVector3 & query,
+      const Scalar min_sqrd,
+      const Scalar max_sqrd,
+      Scalar & sqrd,
+      std::shared_ptr<Object> & descendant) const override;
+
+    // Recompute box from the current vertex positions (see Object.h)
+    inline void update_box() override;
+
+    // Clips the triangle itself rather than its box (see Object.h)
+    inline void split_box(
+      const BoundingBox & region,
+      const int axis,
+      const Scalar position,
+      BoundingBox & left,
+      BoundingBox & right) const override;
 };
 
+using MeshTriangle = MeshTriangleT<double>;
+using MeshTrianglef = MeshTriangleT<float>;
+
 
 // Implementation
 
 #include "insert_triangle_into_box.h"
 #include "ray_intersect_triangle.h"
+#include "point_triangle_squared_distance.h"
 
-inline MeshTriangle::MeshTriangle(
-    const Eigen::MatrixXd & _V,
-    const Eigen::MatrixXi & _F,
+template <typename Scalar>
+inline MeshTriangleT<Scalar>::MeshTriangleT(
+    const MatrixXMap & _V,
+    const FacesMap & _F,
     const int _f,
-    const Eigen::MatrixXd * _N): V(_V), F(_F), f(_f), N(_N)
+    const MatrixXMap * _N): V(_V), F(_F), f(_f), N(_N)
+{
+  insert_triangle_into_box<Scalar>(
+    V.row(F(f,0)),
+    V.row(F(f,1)),
+    V.row(F(f,2)),
+    box);
+}
+
+template <typename Scalar>
+inline void MeshTriangleT<Scalar>::update_box()
 {
-  insert_triangle_into_box(
+  box = BoundingBox();
+  insert_triangle_into_box<Scalar>(
     V.row(F(f,0)),
     V.row(F(f,1)),
     V.row(F(f,2)),
@@ -83,19 +147,21 @@ inline MeshTriangle::MeshTriangle(
 }
 
 // Get normal at point p
-inline Eigen::Vector3d MeshTriangle::get_normal(const Eigen::Vector3d & p) const
+template <typename Scalar>
+inline typename MeshTriangleT<Scalar>::Vector3
+MeshTriangleT<Scalar>::get_normal(const Vector3 & p) const
 {
   // If we have vertex normals, we could interpolate them using barycentric coordinates
   // For now, just return face normal (simpler and sufficient for most cases)
-  Eigen::RowVector3d v0 = V.row(F(f,0));
-  Eigen::RowVector3d v1 = V.row(F(f,1));
-  Eigen::RowVector3d v2 = V.row(F(f,2));
+  RowVector3 v0 = V.row(F(f,0));
+  RowVector3 v1 = V.row(F(f,1));
+  RowVector3 v2 = V.row(F(f,2));
   
-  Eigen::RowVector3d edge1 = v1 - v0;
-  Eigen::RowVector3d edge2 = v2 - v0;
+  RowVector3 edge1 = v1 - v0;
+  RowVector3 edge2 = v2 - v0;
   
-  // Cross product for RowVector3d
-  Eigen::RowVector3d normal;
+  // Cross product for RowVector3
+  RowVector3 normal;
   normal(0) = edge1(1) * edge2(2) - edge1(2) * edge2(1);
   normal(1) = edge1(2) * edge2(0) - edge1(0) * edge2(2);
   normal(2) = edge1(0) * edge2(1) - edge1(1) * edge2(0);
@@ -104,14 +170,15 @@ inline Eigen::Vector3d MeshTriangle::get_normal(const Eigen::Vector3d & p) const
 }
 
 // Simple wrapper around `ray_intersect_triangle`
-inline bool MeshTriangle::ray_intersect(
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::ray_intersect(
   const Ray& ray,
-  const double min_t,
-  const double max_t,
-  double & t,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t,
   std::shared_ptr<Object> & descendant) const
 {
-  bool hit = ray_intersect_triangle(
+  bool hit = ray_intersect_triangle<Scalar>(
     ray,
     V.row(F(f,0)),
     V.row(F(f,1)),
@@ -128,20 +195,151 @@ inline bool MeshTriangle::ray_intersect(
   return hit;
 }
 
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::ray_intersect(
+  const PreparedRayT<Scalar> & ray,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t,
+  std::shared_ptr<Object> & descendant) const
+{
+  bool hit = ray_intersect_triangle<Scalar>(
+    ray,
+    V.row(F(f,0)),
+    V.row(F(f,1)),
+    V.row(F(f,2)),
+    min_t,
+    max_t,
+    t);
+  if (hit) {
+    descendant = nullptr;
+  }
+  return hit;
+}
+
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::ray_intersect(
+  const Ray & ray,
+  const Scalar min_t,
+  const Scalar max_t,
+  HitRecordT<Scalar> & hit) const
+{
+  return ray_intersect_triangle<Scalar>(
+    ray, V.row(F(f,0)), V.row(F(f,1)), V.row(F(f,2)), min_t, max_t,
+    hit.t, hit.u, hit.v);
+}
+
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::ray_intersect(
+  const PreparedRayT<Scalar> & ray,
+  const Scalar min_t,
+  const Scalar max_t,
+  HitRecordT<Scalar> & hit) const
+{
+  return ray_intersect_triangle<Scalar>(
+    ray, V.row(F(f,0)), V.row(F(f,1)), V.row(F(f,2)), min_t, max_t,
+    hit.t, hit.u, hit.v);
+}
+
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::ray_occluded(
+  const Ray & ray,
+  const Scalar min_t,
+  const Scalar max_t) const
+{
+  Scalar t;
+  return ray_intersect_triangle<Scalar>(
+    ray, V.row(F(f,0)), V.row(F(f,1)), V.row(F(f,2)), min_t, max_t, t);
+}
+
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::ray_occluded(
+  const PreparedRayT<Scalar> & ray,
+  const Scalar min_t,
+  const Scalar max_t) const
+{
+  Scalar t;
+  return ray_intersect_triangle<Scalar>(
+    ray, V.row(F(f,0)), V.row(F(f,1)), V.row(F(f,2)), min_t, max_t, t);
+}
+
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::point_squared_distance(
+  const RowVector3 & query,
+  const Scalar min_sqrd,
+  const Scalar max_sqrd,
+  Scalar & sqrd,
+  std::shared_ptr<Object> & descendant) const
+{
+  Scalar d;
+  RowVector3 p;
+  point_triangle_squared_distance<Scalar>(
+    query, V.row(F(f,0)), V.row(F(f,1)), V.row(F(f,2)), d, p);
+  if (d < min_sqrd || d > max_sqrd)
+    return false;
+  sqrd = d;
+  descendant = nullptr;
+  return true;
+}
+
+template <typename Scalar>
+inline void MeshTriangleT<Scalar>::split_box(
+  const BoundingBox & region,
+  const int axis,
+  const Scalar position,
+  BoundingBox & left,
+  BoundingBox & right) const
+{
+  left = BoundingBox();
+  right = BoundingBox();
+  // Each corner goes to its side; each edge crossing the plane contributes
+  // its crossing point to both sides
+  for (int k = 0; k < 3; k++) {
+    const RowVector3 a = V.row(F(f,k));
+    const RowVector3 b = V.row(F(f,(k+1)%3));
+    const Scalar da = a[axis] - position;
+    const Scalar db = b[axis] - position;
+    if (da <= 0) {
+      left.min_corner = left.min_corner.cwiseMin(a);
+      left.max_corner = left.max_corner.cwiseMax(a);
+    }
+    if (da >= 0) {
+      right.min_corner = right.min_corner.cwiseMin(a);
+      right.max_corner = right.max_corner.cwiseMax(a);
+    }
+    if ((da < 0 && db > 0) || (da > 0 && db < 0)) {
+      RowVector3 p = a + (da / (da - db)) * (b - a);
+      p[axis] = position;
+      left.min_corner = left.min_corner.cwiseMin(p);
+      left.max_corner = left.max_corner.cwiseMax(p);
+      right.min_corner = right.min_corner.cwiseMin(p);
+      right.max_corner = right.max_corner.cwiseMax(p);
+    }
+  }
+  // Restrict to the part of the triangle inside region
+  left.min_corner = left.min_corner.cwiseMax(region.min_corner);
+  left.max_corner = left.max_corner.cwiseMin(region.max_corner);
+  left.max_corner[axis] = std::min(left.max_corner[axis], position);
+  right.min_corner = right.min_corner.cwiseMax(region.min_corner);
+  right.max_corner = right.max_corner.cwiseMin(region.max_corner);
+  right.min_corner[axis] = std::max(right.min_corner[axis], position);
+}
+
 // Implementation of intersect (for compatibility with old Object interface)
-inline bool MeshTriangle::intersect(
+template <typename Scalar>
+inline bool MeshTriangleT<Scalar>::intersect(
   const Ray & ray, 
-  const double min_t, 
-  double & t, 
-  Eigen::Vector3d & n) const
+  const Scalar min_t, 
+  Scalar & t, 
+  Vector3 & n) const
 {
-  bool hit = ray_intersect_triangle(
+  bool hit = ray_intersect_triangle<Scalar>(
     ray,
     V.row(F(f,0)),
     V.row(F(f,1)),
     V.row(F(f,2)),
     min_t,
-    std::numeric_limits<double>::infinity(),
+    std::numeric_limits<Scalar>::infinity(),
     t);
   
   if (hit) {
@@ -2,18 +2,28 @@
 #define OBJECT_H
 
 #include <Eigen/Core>
+#include <algorithm>
 #include <memory>
 #include "BoundingBox.h"
+#include "HitRecord.h"
+#include "PreparedRay.h"
 
-struct Ray;
-class Object
+// Geometry that can be stored in a bounding volume hierarchy, in double
+// (Object) or single (Objectf) precision.
+template <typename Scalar>
+class ObjectT
 {
   public:
+    using Ray = RayT<Scalar>;
+    using BoundingBox = BoundingBoxT<Scalar>;
+    using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+    using RowVector3 = Eigen::Matrix<Scalar, 1, 3>;
+
     // Bounding box for this object
     BoundingBox box;
     
     // https://stackoverflow.com/questions/461203/when-to-use-virtual-destructors
-    virtual ~Object() {}
+    virtual ~ObjectT() {}
     
     // Intersect object with ray.
     //
@@ -27,7 +37,7 @@ class Object
     //
     // The funny = 0 just ensures that this function is defined (as a no-op)
     virtual bool intersect(
-        const Ray & ray, const double min_t, double & t, Eigen::Vector3d & n) const = 0;
+        const Ray & ray, const Scalar min_t, Scalar & t, Vector3 & n) const = 0;
     
     // New interface for AABBTree and MeshTriangle
     // Inputs:
@@ -40,10 +50,75 @@ class Object
     // Returns true iff there is an intersection
     virtual bool ray_intersect(
         const Ray& ray,
-        const double min_t,
-        const double max_t,
-        double & t,
-        std::shared_ptr<Object> & descendant) const = 0;
+        const Scalar min_t,
+        const Scalar max_t,
+        Scalar & t,
+        std::shared_ptr<ObjectT> & descendant) const = 0;
+
+    // Same as above for a ray whose per-ray constants are precomputed (see
+    // PreparedRay.h). The default ignores them.
+    virtual bool ray_intersect(
+        const PreparedRayT<Scalar> & ray,
+        const Scalar min_t,
+        const Scalar max_t,
+        Scalar & t,
+        std::shared_ptr<ObjectT> & descendant) const
+    {
+      return ray_intersect(ray.ray, min_t, max_t, t, descendant);
+    }
+
+    // Closest-hit query for BVH leaves: fills hit.t and, for triangles, the
+    // barycentric coordinates hit.u and hit.v (see HitRecord.h) instead of
+    // handing out a shared_ptr. hit.primitive is left to the caller, and hit
+    // is only changed when there is an intersection. The defaults fall back
+    // to ray_intersect with u = v = 0.
+    virtual bool ray_intersect(
+        const Ray & ray,
+        const Scalar min_t,
+        const Scalar max_t,
+        HitRecordT<Scalar> & hit) const
+    {
+      std::shared_ptr<ObjectT> descendant;
+      if (!ray_intersect(ray, min_t, max_t, hit.t, descendant))
+        return false;
+      hit.u = hit.v = 0;
+      return true;
+    }
+    virtual bool ray_intersect(
+        const PreparedRayT<Scalar> & ray,
+        const Scalar min_t,
+        const Scalar max_t,
+        HitRecordT<Scalar> & hit) const
+    {
+      std::shared_ptr<ObjectT> descendant;
+      if (!ray_intersect(ray, min_t, max_t, hit.t, descendant))
+        return false;
+      hit.u = hit.v = 0;
+      return true;
+    }
+
+    // Any-hit (occlusion) query: is the ray blocked anywhere in [min_t,
+    // max_t]? Implementations may stop at the first hit they find and report
+    // neither its distance nor the object. The defaults fall back to
+    // ray_intersect.
+    virtual bool ray_occluded(
+        const Ray & ray,
+        const Scalar min_t,
+        const Scalar max_t) const
+    {
+      Scalar t;
+      std::shared_ptr<ObjectT> descendant;
+      return ray_intersect(ray, min_t, max_t, t, descendant);
+    }
+    virtual bool ray_occluded(
+        const PreparedRayT<Scalar> & ray,
+        const Scalar min_t,
+        const Scalar max_t) const
+    {
+      Scalar t;
+      std::shared_ptr<ObjectT> descendant;
+      return ray_intersect(ray, min_t, max_t, t, descendant);
+    }
     
     // Point-object squared distance query
     // Inputs:
@@ -55,11 +130,43 @@ class Object
     //   descendant  the actual object that was closest (for BVH traversal)
     // Returns true iff there is a point within the distance range
     virtual bool point_squared_distance(
-        const Eigen::RowVector3d & query,
-        const double min_sqrd,
-        const double max_sqrd,
-        double & sqrd,
-        std::shared_ptr<Object> & descendant) const = 0;
+        const RowVector3 & query,
+        const Scalar min_sqrd,
+        const Scalar max_sqrd,
+        Scalar & sqrd,
+        std::shared_ptr<ObjectT> & descendant) const = 0;
+
+    // Recompute box after the geometry this object refers to changed (e.g. the
+    // vertices of its mesh moved). The default keeps box as is.
+    virtual void update_box() {}
+
+    // Split the part of this object inside a box by an axis-aligned plane
+    // (used by spatial-split BVH builders).
+    //
+    // Inputs:
+    //   region  part of space to consider (usually a subset of box)
+    //   axis  axis (0, 1 or 2) of the splitting plane
+    //   position  coordinate of the splitting plane along axis
+    // Outputs:
+    //   left  bounds of the object's part inside region below the plane
+    //   right  bounds of the object's part inside region above the plane
+    //
+    // The default just cuts `region`, which is conservative but loose.
+    virtual void split_box(
+        const BoundingBox & region,
+        const int axis,
+        const Scalar position,
+        BoundingBox & left,
+        BoundingBox & right) const
+    {
+      left = region;
+      right = region;
+      left.max_corner[axis] = std::min(left.max_corner[axis], position);
+      right.min_corner[axis] = std::max(right.min_corner[axis], position);
+    }
 };
 
+using Object = ObjectT<double>;
+using Objectf = ObjectT<float>;
+
 #endif
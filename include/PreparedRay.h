@@ -0,0 +1,57 @@
+#ifndef PREPARED_RAY_H
+#define PREPARED_RAY_H
+
+#include "Ray.h"
+#include <Eigen/Core>
+#include <cmath>
+#include <utility>
+
+// Ray together with the constants every box and triangle test along a
+// traversal needs, computed once per ray: the inverse direction and direction
+// signs of the slab test, and the axis permutation and shear of the
+// watertight ray-triangle test (Woop, Benthin and Wald 2013).
+template <typename Scalar>
+struct PreparedRayT
+{
+  using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+
+  RayT<Scalar> ray;
+  // 1 / direction, per component (+-inf for zero components)
+  Vector3 inv_direction;
+  // 1 iff direction is negative along the axis, i.e. the ray enters a box
+  // through its max_corner plane
+  int is_negative[3];
+  // kz is the axis of the largest |direction| component; kx and ky are the
+  // other two, swapped when direction[kz] < 0 to preserve winding
+  int kx, ky, kz;
+  // Shear mapping the direction onto the +z axis of the (kx, ky, kz) frame
+  Scalar Sx, Sy, Sz;
+
+  PreparedRayT() {}
+
+  explicit PreparedRayT(const RayT<Scalar> & a_ray)
+  : ray(a_ray)
+  {
+    const Vector3 & d = ray.direction;
+    for (int i = 0; i < 3; i++) {
+      inv_direction[i] = Scalar(1) / d[i];
+      is_negative[i] = std::signbit(d[i]) ? 1 : 0;
+    }
+    const Vector3 abs_d = d.cwiseAbs();
+    kz = abs_d[0] > abs_d[1]
+      ? (abs_d[0] > abs_d[2] ? 0 : 2)
+      : (abs_d[1] > abs_d[2] ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    if (d[kz] < 0)
+      std::swap(kx, ky);
+    Sx = d[kx] / d[kz];
+    Sy = d[ky] / d[kz];
+    Sz = Scalar(1) / d[kz];
+  }
+};
+
+using PreparedRay = PreparedRayT<double>;
+using PreparedRayf = PreparedRayT<float>;
+
+#endif
@@ -3,13 +3,17 @@
 
 #include <Eigen/Core>
 
-struct Ray 
+template <typename Scalar>
+struct RayT 
 {
-  Eigen::Vector3d origin;
+  Eigen::Matrix<Scalar, 3, 1> origin;
   // Not necessarily unit-length direction vector. (It is often useful to have
   // non-unit length so that origin+t*direction lands on a special point when
   // t=1.)
-  Eigen::Vector3d direction;
+  Eigen::Matrix<Scalar, 3, 1> direction;
 };
 
+using Ray = RayT<double>;
+using Rayf = RayT<float>;
+
 #endif
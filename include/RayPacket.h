@@ -0,0 +1,131 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "PreparedRay.h"
+#include "Ray.h"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Largest number of rays traced together
+constexpr int RAY_PACKET_MAX_SIZE = 16;
+
+// Up to RAY_PACKET_MAX_SIZE coherent rays (e.g. the primary rays of a tile of
+// screen cells) traced through a BVH together, so node fetches and culling
+// are shared between them (see LinearBVH::ray_intersect_packet). Ray i is
+// bit i of the ray masks used by packet queries.
+struct RayPacket
+{
+  int size = 0;
+  PreparedRay rays[RAY_PACKET_MAX_SIZE];
+  // All rays leave from rays[0].ray.origin; false disables classify_box
+  bool common_origin = false;
+  // Per axis: coherent[a] iff the directions of all rays have the same sign
+  // along a (is_negative[a]) and none is zero. Culling only uses coherent
+  // axes.
+  bool coherent[3];
+  int is_negative[3];
+  // Range of PreparedRay::inv_direction over the rays along coherent axes
+  Eigen::Vector3d inv_direction_min;
+  Eigen::Vector3d inv_direction_max;
+
+  RayPacket() {}
+
+  // Inputs:
+  //   a_rays  n rays to trace together
+  //   n  number of rays (1 to RAY_PACKET_MAX_SIZE)
+  RayPacket(const Ray * a_rays, const int n)
+  : size(n)
+  {
+    for (int i = 0; i < n; i++)
+      rays[i] = PreparedRay(a_rays[i]);
+    common_origin = true;
+    for (int i = 1; i < n; i++)
+      common_origin = common_origin && a_rays[i].origin == a_rays[0].origin;
+    for (int a = 0; a < 3; a++) {
+      is_negative[a] = rays[0].is_negative[a];
+      coherent[a] = true;
+      inv_direction_min[a] = inv_direction_max[a] = rays[0].inv_direction[a];
+      for (int i = 1; i < n; i++) {
+        coherent[a] = coherent[a] && rays[i].is_negative[a] == is_negative[a];
+        inv_direction_min[a] = std::min(inv_direction_min[a], rays[i].inv_direction[a]);
+        inv_direction_max[a] = std::max(inv_direction_max[a], rays[i].inv_direction[a]);
+      }
+      coherent[a] = coherent[a] &&
+        std::isfinite(inv_direction_min[a]) && std::isfinite(inv_direction_max[a]);
+    }
+  }
+
+  // Mask with one bit per ray
+  unsigned all() const
+  {
+    return size >= 32 ? ~0u : (1u << size) - 1;
+  }
+
+  // Which rays of the packet a box may be hit by
+  enum class BoxHit
+  {
+    // None of the rays
+    NONE,
+    // Some of them (undecided: test the rays one by one)
+    SOME,
+    // All of them
+    ALL
+  };
+
+  // Classify a box against the frustum spanned by the rays, by interval
+  // arithmetic on the slab distances (Boulos et al., "Geometric and
+  // Arithmetic Culling Methods for Entire Ray Packets"). NONE is
+  // conservative; ALL may be reported for a box a ray barely misses, which
+  // only costs that ray some extra tests further down.
+  //
+  // Inputs:
+  //   min_corner, max_corner  box
+  //   min_t  minimum parametric distance to consider
+  //   max_t_lo, max_t_hi  smallest and largest maximum parametric distance
+  //     over the rays
+  // Outputs:
+  //   t_near  lower bound of the distance at which any ray enters the box
+  BoxHit classify_box(
+    const float min_corner[3],
+    const float max_corner[3],
+    const double min_t,
+    const double max_t_lo,
+    const double max_t_hi,
+    double & t_near) const
+  {
+    t_near = min_t;
+    if (!common_origin)
+      return BoxHit::SOME;
+    const double pad = 1.0 + 4.0 * std::numeric_limits<double>::epsilon();
+    const float * corners[2] = {min_corner, max_corner};
+    const Eigen::Vector3d & origin = rays[0].ray.origin;
+    // Entry and exit distances: lowest/highest over the rays
+    double near_lo = min_t, near_hi = min_t;
+    double far_lo = max_t_lo, far_hi = max_t_hi;
+    bool all_axes = true;
+    for (int a = 0; a < 3; a++) {
+      if (!coherent[a]) {
+        all_axes = false;
+        continue;
+      }
+      // Distances are linear in the inverse direction, so their extremes over
+      // the packet are at the ends of its range
+      const double near = corners[is_negative[a]][a] - origin[a];
+      const double far = corners[1 - is_negative[a]][a] - origin[a];
+      const double n1 = near * inv_direction_min[a], n2 = near * inv_direction_max[a];
+      const double f1 = far * inv_direction_min[a], f2 = far * inv_direction_max[a];
+      near_lo = std::max(near_lo, std::min(n1, n2));
+      near_hi = std::max(near_hi, std::max(n1, n2));
+      far_lo = std::min(far_lo, std::min(f1, f2));
+      far_hi = std::min(far_hi, std::max(f1, f2) * pad);
+    }
+    t_near = near_lo;
+    if (near_lo > far_hi)
+      return BoxHit::NONE;
+    return all_axes && near_hi <= far_lo ? BoxHit::ALL : BoxHit::SOME;
+  }
+};
+
+#endif
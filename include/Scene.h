@@ -5,58 +5,512 @@
 #include <memory>
 #include <string>
 #include <iostream>
+#include <chrono>
+#include <new>
 #include <Eigen/Core>
 
 #include "Object.h"
 #include "MeshTriangle.h"
 #include "AABBTree.h"
+#include "LinearBVH.h"
+#include "WideBVH.h"
+#include "ThreadPool.h"
 #include "read_obj.h"
+#include "scene_cache.h"
 #include "per_vertex_normals.h"
+#include "peak_memory_usage.h"
+#include "update_per_vertex_normals.h"
+#include "vertex_triangle_adjacency.h"
+#include "triangle_area_normal.h"
+#include "point_triangle_squared_distance.h"
+#include "MeshAnimation.h"
+#include "PreparedRay.h"
+#include "RayPacket.h"
+#include "TraceZones.h"
+#include "LoadProgress.h"
+
+// Timings (in seconds) and memory of the most recent load
+struct SceneLoadStats {
+    double read_seconds = 0;
+    double normals_seconds = 0;
+    double primitives_seconds = 0;
+    double bvh_seconds = 0;
+    // Threads used by the BVH build
+    int bvh_threads = 1;
+    // Scratch + output bytes at the peak of the BVH build
+    size_t bvh_peak_bytes = 0;
+    // Peak resident set size of the process after the load
+    size_t peak_rss_bytes = 0;
+    // Whether the mesh and BVH came from a scene cache (read_seconds is then
+    // the time to read the cache; nothing was computed)
+    bool from_cache = false;
+};
 
 struct Scene {
-    Eigen::MatrixXd V;
-    Eigen::MatrixXi F;
-    Eigen::MatrixXd N; 
+    // Mesh and vertex normals, read-only: views of either the owned
+    // matrices below or, for a mesh loaded from a scene cache, the mapped
+    // cache file (copied into the owned matrices once the mesh animates)
+    Eigen::Map<const Eigen::MatrixXd> V{nullptr, 0, 3};
+    Eigen::Map<const Eigen::MatrixXi> F{nullptr, 0, 3};
+    Eigen::Map<const Eigen::MatrixXd> N{nullptr, 0, 3};
+    Eigen::MatrixXd V_storage;
+    Eigen::MatrixXi F_storage;
+    Eigen::MatrixXd N_storage;
+    // Scene cache the mesh and BVH arrays are views of, if any
+    std::shared_ptr<const MappedFile> cache_file;
 
     std::vector<std::shared_ptr<Object>> objects;
 
-    std::shared_ptr<AABBTree> bvh;
+    LinearBVH bvh;
+    // Collapsed copies of bvh, only the one matching
+    // bvh_options.branching_factor is built
+    BVH4 bvh4;
+    BVH8 bvh8;
+    BVHBuildOptions bvh_options;
+    BVHStats bvh_stats;
+    SceneLoadStats load_stats;
+
+    // load_mesh reads the mesh, its normals and BVH from a binary cache
+    // when the source file is unchanged, and writes one otherwise (see
+    // scene_cache.h). The cache lives next to the OBJ file, or in cache_dir
+    // if set.
+    bool use_cache = true;
+    std::string cache_dir;
+
+    // Keyframes played back by set_animation_time (empty for static meshes)
+    MeshAnimation animation;
+    // set_animation_time refits the BVH unless the refit SAH cost exceeds
+    // this multiple of the cost right after the last full build, in which
+    // case it rebuilds
+    double rebuild_cost_ratio = 1.5;
+    // SAH cost after the last full build and after the last refit
+    double built_sah_cost = 0;
+    double refit_sah_cost = 0;
+    int num_refits = 0;
+    int num_rebuilds = 0;
+    // Time spent in the last set_animation_time call
+    double animation_update_seconds = 0;
+
+    // Adjacency and face normals kept for incremental normal updates
+    // (CSR: faces of vertex i are VF(NI(i)) ... VF(NI(i+1)-1))
+    Eigen::VectorXi VF;
+    Eigen::VectorXi NI;
+    Eigen::MatrixXd FN;
+    // Threads for per-frame updates (created on first use)
+    std::shared_ptr<ThreadPool> thread_pool;
+    // Incremented whenever the geometry or its BVH changes (rebuild, refit),
+    // so cached frames traced from an older version can be detected
+    uint64_t version = 0;
+    // If set, loading and BVH builds report their stage and progress here
+    // and stop early once it is cancelled, leaving the BVH empty (see
+    // SceneLoader)
+    LoadProgress* progress = nullptr;
+
+    bool cancelled() const { return progress && progress->cancelled(); }
+    void set_stage(LoadStage stage) {
+        if (progress) progress->stage = stage;
+    }
 
     void load_mesh(const std::string& filename) {
-        if (!read_obj(filename, V, F)) {
-            std::cerr << "Failed to load obj!" << std::endl;
+        TRACE_ZONE("Scene::load_mesh");
+        set_stage(LoadStage::READING);
+        const std::string cache = use_cache ? scene_cache_path(filename, cache_dir) : "";
+        if (!cache.empty() && load_cache(cache, filename)) return;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        TRACE_ZONE_NAMED(read_zone, "read_obj");
+        const bool read = read_obj(filename, V_storage, F_storage, progress);
+        view_owned_mesh();
+        if (!read) {
+            if (!cancelled()) std::cerr << "Failed to load obj!" << std::endl;
             return;
         }
+        TRACE_ZONE_END(read_zone);
+        load_stats.read_seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        init_mesh();
+        if (!cache.empty() && !bvh.empty()) {
+            TRACE_ZONE("write_scene_cache");
+            if (!write_scene_cache(cache, filename, build_options(), V, F, N, bvh, bvh_stats,
+                                   bvh4, bvh8))
+                std::cerr << "Warning: could not write scene cache " << cache << std::endl;
+        }
+    }
+
+    // Use the mesh, normals and BVHs of the cache file of `source` in place
+    // if it is valid for the file as it is now and the current bvh_options
+    bool load_cache(const std::string& cache, const std::string& source) {
+        TRACE_ZONE("Scene::load_cache");
+        auto start = std::chrono::high_resolution_clock::now();
+        SceneCache cached;
+        if (!read_scene_cache(cache, source, build_options(), cached)) return false;
+        load_stats = SceneLoadStats();
+        load_stats.from_cache = true;
+        load_stats.read_seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        reset_mesh_state();
+        new (&V) Eigen::Map<const Eigen::MatrixXd>(cached.V.data(), cached.V.rows(), 3);
+        new (&F) Eigen::Map<const Eigen::MatrixXi>(cached.F.data(), cached.F.rows(), 3);
+        new (&N) Eigen::Map<const Eigen::MatrixXd>(cached.N.data(), cached.N.rows(), 3);
+        cache_file = std::move(cached.file);
+        start = std::chrono::high_resolution_clock::now();
+        create_primitives();
+        load_stats.primitives_seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        bvh = std::move(cached.bvh);
+        bvh4 = std::move(cached.bvh4);
+        bvh8 = std::move(cached.bvh8);
+        bvh.primitives.resize(bvh.primitive_indices.size());
+        for (size_t i = 0; i < bvh.primitive_indices.size(); ++i) {
+            bvh.primitives[i] = objects[bvh.primitive_indices[i]].get();
+        }
+        if (!bvh4.empty()) bvh4.primitives = bvh.primitives;
+        if (!bvh8.empty()) bvh8.primitives = bvh.primitives;
+        bvh_stats = cached.bvh_stats;
+        finish_load(start);
+        return true;
+    }
+
+    // Load an animated mesh from a numbered sequence of OBJ files with the
+    // same faces (see MeshAnimation::load_obj_sequence) and show frame 0.
+    bool load_animation(const std::string& pattern, double frames_per_second) {
+        TRACE_ZONE("Scene::load_animation");
+        set_stage(LoadStage::READING);
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!animation.load_obj_sequence(pattern, frames_per_second, F_storage)) {
+            view_owned_mesh();
+            std::cerr << "Failed to load animation!" << std::endl;
+            return false;
+        }
+        V_storage = animation.frames[0];
+        view_owned_mesh();
+        load_stats.read_seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "Animation: " << animation.frames.size() << " frames, "
+                  << animation.duration() << " s" << std::endl;
+
+        init_mesh();
+        return true;
+    }
+
+    // Compute normals, primitives and BVH for the current V and F
+    void init_mesh() {
+        using clock = std::chrono::high_resolution_clock;
+        auto seconds_since = [](clock::time_point start) {
+            return std::chrono::duration<double>(clock::now() - start).count();
+        };
+
+        load_stats.from_cache = false;
+        reset_mesh_state();
+
+        set_stage(LoadStage::NORMALS);
+        auto start = clock::now();
+        {
+            TRACE_ZONE("per_vertex_normals");
+            per_vertex_normals(V_storage, F_storage, N_storage);
+            view_owned_mesh();
+        }
+        load_stats.normals_seconds = seconds_since(start);
+        if (cancelled()) return;
+
+        set_stage(LoadStage::PRIMITIVES);
+        start = clock::now();
+        create_primitives();
+        load_stats.primitives_seconds = seconds_since(start);
+        if (cancelled()) return;
+
+        build_bvh();
+    }
+
+    // Forget the state derived from the previous mesh
+    void reset_mesh_state() {
+        bvh = LinearBVH();
+        bvh4 = BVH4();
+        bvh8 = BVH8();
+        cache_file.reset();
+        VF.resize(0);
+        NI.resize(0);
+        FN.resize(0, 3);
+        num_refits = 0;
+        num_rebuilds = 0;
+    }
 
-        per_vertex_normals(V, F, N);
+    // Point V, F and N at the owned matrices
+    void view_owned_mesh() {
+        new (&V) Eigen::Map<const Eigen::MatrixXd>(V_storage.data(), V_storage.rows(), 3);
+        new (&F) Eigen::Map<const Eigen::MatrixXi>(F_storage.data(), F_storage.rows(), 3);
+        new (&N) Eigen::Map<const Eigen::MatrixXd>(N_storage.data(), N_storage.rows(), 3);
+    }
+
+    // Copy a mesh viewed in the scene cache into the owned matrices before
+    // it is modified (the BVHs copy their arrays as they are refit)
+    void own_mesh() {
+        if (V.data() == V_storage.data()) return;
+        V_storage = V;
+        F_storage = F;
+        N_storage = N;
+        view_owned_mesh();
+    }
 
+    // One MeshTriangle object per face of F
+    void create_primitives() {
+        TRACE_ZONE("create primitives");
         objects.clear();
+        objects.reserve(F.rows());
         for (int i = 0; i < F.rows(); ++i) {
             auto tri = std::make_shared<MeshTriangle>(V, F, i, &N);
             objects.push_back(tri);
         }
+    }
 
-        bvh = std::make_shared<AABBTree>(objects);
-        std::cout << "BVH Built. Leaves: " << objects.size() << std::endl;
+    // bvh_options as the LinearBVH is built with them
+    BVHBuildOptions build_options() const {
+        BVHBuildOptions options = bvh_options;
+        // Only the wide BVHs test leaf triangles a block at a time
+        if (options.branching_factor == 2) options.leaf_block_size = 1;
+        options.progress = progress;
+        return options;
     }
 
-    bool intersect(const Ray& ray, double min_t, double max_t, 
-                   double& t, Eigen::Vector3d& n, 
-                   std::shared_ptr<Object>& hit_obj) const 
-    {
-        if (!bvh) return false;
-        
-        if (bvh->ray_intersect(ray, min_t, max_t, t, hit_obj)) {
-            auto tri = std::dynamic_pointer_cast<MeshTriangle>(hit_obj);
-            if (tri) {
-            
-                Eigen::Vector3d p = ray.origin + t * ray.direction;
-                n = tri->get_normal(p); 
-                return true;
+    // (Re)build the BVH over `objects` using the current bvh_options and
+    // record its quality metrics in bvh_stats.
+    void build_bvh() {
+        if (objects.empty()) return;
+        TRACE_ZONE("Scene::build_bvh");
+
+        set_stage(LoadStage::BUILDING_BVH);
+        if (progress) {
+            progress->objects_placed = 0;
+            progress->objects_total = objects.size();
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        bvh = LinearBVH(objects, build_options());
+        if (cancelled()) {
+            bvh = LinearBVH();
+            return;
+        }
+        finish_bvh(start);
+    }
+
+    // Collapse the wide BVH from `bvh` and record its stats (the time since
+    // `start` counts as the build time)
+    void finish_bvh(std::chrono::high_resolution_clock::time_point start) {
+        bvh4 = bvh_options.branching_factor == 4 ? BVH4(bvh) : BVH4();
+        bvh8 = bvh_options.branching_factor == 8 ? BVH8(bvh) : BVH8();
+        bvh_stats = bvh.stats(bvh_options.traversal_cost);
+        finish_load(start);
+    }
+
+    // Record and report the load of the BVHs and bvh_stats (the time since
+    // `start` counts as the BVH time)
+    void finish_load(std::chrono::high_resolution_clock::time_point start) {
+        load_stats.bvh_seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        load_stats.bvh_threads = bvh_options.num_threads > 0
+            ? bvh_options.num_threads : ThreadPool::hardware_threads();
+        load_stats.bvh_peak_bytes = bvh.build_peak_bytes;
+        load_stats.peak_rss_bytes = peak_memory_usage();
+
+        built_sah_cost = refit_sah_cost = bvh_stats.sah_cost;
+        version++;
+        std::cout << "BVH Built ("
+                  << (bvh_options.method == BVHSplitMethod::SBVH ? "SBVH"
+                      : bvh_options.method == BVHSplitMethod::SAH ? "SAH" : "Midpoint")
+                  << "). Leaves: " << objects.size()
+                  << ", references: " << bvh.primitives.size()
+                  << ", nodes: " << bvh_stats.num_nodes
+                  << ", depth: " << bvh_stats.max_depth
+                  << ", SAH cost: " << bvh_stats.sah_cost
+                  << ", width: " << bvh_options.branching_factor
+                  << ", memory: " << bvh_memory_bytes() / (1024.0 * 1024.0) << " MB"
+                  << std::endl;
+        std::cout << "Load times: read " << load_stats.read_seconds * 1000.0
+                  << (load_stats.from_cache ? " ms (cache), normals " : " ms, normals ") << load_stats.normals_seconds * 1000.0
+                  << " ms, primitives " << load_stats.primitives_seconds * 1000.0
+                  << " ms, BVH " << load_stats.bvh_seconds * 1000.0
+                  << " ms (" << load_stats.bvh_threads << " threads)"
+                  << ". BVH build peak: " << load_stats.bvh_peak_bytes / (1024.0 * 1024.0)
+                  << " MB, process peak RSS: " << load_stats.peak_rss_bytes / (1024.0 * 1024.0)
+                  << " MB" << std::endl;
+    }
+
+    ThreadPool& get_thread_pool() {
+        if (!thread_pool) {
+            thread_pool = std::make_shared<ThreadPool>(bvh_options.num_threads);
+        }
+        return *thread_pool;
+    }
+
+    // Update the object boxes and refit the BVH to the current V, or rebuild
+    // it if refitting degraded it past rebuild_cost_ratio.
+    void refit_bvh() {
+        ThreadPool& pool = get_thread_pool();
+        pool.parallel_for(0, objects.size(), 4096, [this](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                objects[i]->update_box();
             }
-            return false;
+        });
+
+        refit_sah_cost = bvh.refit(pool, bvh_options.traversal_cost);
+        if (refit_sah_cost > rebuild_cost_ratio * built_sah_cost) {
+            build_bvh();
+            num_rebuilds++;
+            return;
+        }
+        if (!bvh4.empty()) bvh4.refit(pool);
+        if (!bvh8.empty()) bvh8.refit(pool);
+        num_refits++;
+        version++;
+    }
+
+    // Move the mesh to the animation's pose at `time` (in seconds): update
+    // the normals of the faces around moved vertices and refit the BVH.
+    void set_animation_time(double time) {
+        if (animation.empty() || objects.empty()) return;
+        TRACE_ZONE("Scene::set_animation_time");
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Eigen::MatrixXd next;
+        animation.sample(time, next);
+        std::vector<int> moved;
+        for (int i = 0; i < V.rows(); ++i) {
+            if (next.row(i) != V.row(i)) moved.push_back(i);
+        }
+        if (moved.empty()) return;
+        own_mesh();
+        V_storage = next;
+        view_owned_mesh();
+
+        if (NI.size() == 0) {
+            // First update: all face normals are needed anyway
+            vertex_triangle_adjacency(F_storage, V.rows(), VF, NI);
+            per_vertex_normals(V_storage, F_storage, VF, NI, get_thread_pool(), FN, N_storage);
+        } else {
+            update_per_vertex_normals(V_storage, F_storage, VF, NI, moved, FN, N_storage);
         }
-        return false;
+        view_owned_mesh();
+        refit_bvh();
+
+        animation_update_seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Bytes used by the hierarchy that is traversed
+    size_t bvh_memory_bytes() const {
+        if (!bvh4.empty()) return bvh4.memory_bytes();
+        if (!bvh8.empty()) return bvh8.memory_bytes();
+        return bvh.memory_bytes();
+    }
+
+    // Closest hit of `ray` (a Ray, or a PreparedRay for watertight triangle
+    // tests) in whichever BVH is built
+    //
+    // Outputs:
+    //   hit  distance, barycentric coordinates and face (index into F, as
+    //     hit.primitive) of the closest hit (see HitRecord.h)
+    // Returns true iff the ray hits the mesh
+    template <typename RayType>
+    bool intersect(const RayType& ray, double min_t, double max_t, HitRecord& hit) const {
+        if (!bvh4.empty()) return bvh4.ray_intersect(ray, min_t, max_t, hit);
+        if (!bvh8.empty()) return bvh8.ray_intersect(ray, min_t, max_t, hit);
+        return bvh.ray_intersect(ray, min_t, max_t, hit);
+    }
+
+    // Smooth normal at a hit: the vertex normals N of the face hit,
+    // interpolated with its barycentric coordinates. Falls back to the face
+    // normal without vertex normals, or where they cancel out.
+    Eigen::Vector3d shading_normal(const HitRecord& hit) const {
+        const int f = hit.primitive;
+        if (N.rows() == V.rows()) {
+            const Eigen::Vector3d n = ((1.0 - hit.u - hit.v) * N.row(F(f, 0))
+                + hit.u * N.row(F(f, 1)) + hit.v * N.row(F(f, 2))).transpose();
+            const double length = n.norm();
+            if (length > 1e-12) return n / length;
+        }
+        const Eigen::RowVector3d e1 = V.row(F(f, 1)) - V.row(F(f, 0));
+        const Eigen::RowVector3d e2 = V.row(F(f, 2)) - V.row(F(f, 0));
+        return e1.cross(e2).normalized().transpose();
+    }
+
+    // Is `ray` (a Ray or PreparedRay) blocked by anything in [min_t, max_t]?
+    // Stops at the first hit and computes no normal, e.g. for shadow rays.
+    template <typename RayType>
+    bool occluded(const RayType& ray, double min_t, double max_t) const {
+        if (!bvh4.empty()) return bvh4.ray_occluded(ray, min_t, max_t);
+        if (!bvh8.empty()) return bvh8.ray_occluded(ray, min_t, max_t);
+        return bvh.ray_occluded(ray, min_t, max_t);
+    }
+
+    // Point of the mesh closest to `query` (see
+    // LinearBVH::point_squared_distance)
+    //
+    // Outputs:
+    //   sqrd  squared distance from query to the mesh
+    //   face  index into F of the closest triangle
+    //   closest  closest point on that triangle
+    // Returns false iff there is no mesh
+    bool closest_point(const Eigen::RowVector3d& query, double& sqrd, int& face,
+                       Eigen::RowVector3d& closest) const
+    {
+        if (!bvh.point_squared_distance(query, 0.0, std::numeric_limits<double>::infinity(),
+                                        sqrd, face))
+            return false;
+        point_triangle_squared_distance<double>(
+            query, V.row(F(face, 0)), V.row(F(face, 1)), V.row(F(face, 2)), sqrd, closest);
+        return true;
+    }
+
+    // closest_point for every row of P, answered in parallel on the scene's
+    // thread pool
+    //
+    // Inputs:
+    //   P  #P by 3 query points
+    // Outputs:
+    //   sqrD  #P squared distances (infinity when there is no mesh)
+    //   I  #P indices into F of the closest triangles (-1 when there is no
+    //     mesh)
+    //   C  #P by 3 closest points
+    void closest_points(const Eigen::MatrixXd& P, Eigen::VectorXd& sqrD,
+                        Eigen::VectorXi& I, Eigen::MatrixXd& C)
+    {
+        sqrD.resize(P.rows());
+        I.resize(P.rows());
+        C.resize(P.rows(), 3);
+        get_thread_pool().parallel_for(0, P.rows(), 256, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                double sqrd;
+                int face;
+                Eigen::RowVector3d closest;
+                if (closest_point(P.row(i), sqrd, face, closest)) {
+                    sqrD(i) = sqrd;
+                    I(i) = face;
+                    C.row(i) = closest;
+                } else {
+                    sqrD(i) = std::numeric_limits<double>::infinity();
+                    I(i) = -1;
+                    C.row(i).setConstant(std::numeric_limits<double>::quiet_NaN());
+                }
+            }
+        });
+    }
+
+    // Closest hits of a packet of rays (prepared-ray tests, see
+    // LinearBVH::ray_intersect_packet)
+    //
+    // Outputs:
+    //   hits  packet.size closest hits (see intersect; only those of rays
+    //     that hit are set)
+    // Returns mask of the rays that hit something (bit i for packet.rays[i])
+    unsigned intersect_packet(const RayPacket& packet, double min_t, double max_t,
+                              HitRecord* hits) const
+    {
+        if (!bvh4.empty()) return bvh4.ray_intersect_packet(packet, min_t, max_t, hits);
+        if (!bvh8.empty()) return bvh8.ray_intersect_packet(packet, min_t, max_t, hits);
+        return bvh.ray_intersect_packet(packet, min_t, max_t, hits);
     }
 };
 
@@ -0,0 +1,69 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "BVHBuildOptions.h"
+#include "LoadProgress.h"
+#include "Scene.h"
+
+// What to load and the settings of the new scene
+struct SceneLoadRequest {
+    // OBJ file, or numbered OBJ sequence if it contains a printf pattern
+    // such as "walk_%03d.obj" (see Scene::load_animation)
+    std::string filename;
+    double animation_fps = 24.0;
+    BVHBuildOptions bvh_options;
+    bool use_cache = true;
+    std::string cache_dir;
+};
+
+// Loads scenes on a background thread so the caller can keep rendering its
+// current scene meanwhile:
+//
+//     loader.load(request);
+//     ...
+//     // once per frame
+//     if (std::shared_ptr<Scene> loaded = loader.take()) scene = loaded;
+//
+// Every load builds a new Scene that only the loading thread touches until
+// it is complete; it is then handed over through an atomic shared_ptr
+// store, so take() either sees nothing or the finished scene.
+class SceneLoader {
+public:
+    SceneLoader() {}
+    // Cancels a load in progress and waits for it to stop
+    ~SceneLoader();
+
+    SceneLoader(const SceneLoader&) = delete;
+    SceneLoader& operator=(const SceneLoader&) = delete;
+
+    // Start loading, cancelling (and waiting for) any load in progress
+    void load(const SceneLoadRequest& request);
+    // Ask the load in progress to stop early and discard its scene
+    void cancel();
+    // Whether a load is in progress
+    bool loading() const { return running.load(std::memory_order_acquire); }
+    // Scene of the last load if it succeeded and was not taken yet, else
+    // null
+    std::shared_ptr<Scene> take();
+
+    // Stage and progress of the current (or last) load. Call from the thread
+    // that calls load(), which replaces it.
+    const LoadProgress& progress() const { return *current_progress; }
+    // File of the current (or last) load
+    const std::string& filename() const { return current_filename; }
+
+private:
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::shared_ptr<LoadProgress> current_progress = std::make_shared<LoadProgress>();
+    std::string current_filename;
+    // Written by the worker, taken by the caller (std::atomic_store/load)
+    std::shared_ptr<Scene> result;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool. A pool of num_threads starts num_threads-1
+// workers: the thread waiting on the results (TaskGroup::wait, parallel_for)
+// executes tasks as the last worker, so a pool of size 1 simply runs
+// everything on the caller.
+//
+// Every worker owns a deque of tasks: tasks it submits go to the back of its
+// own deque and it runs them newest first (nested task trees unfold
+// depth-first), while idle threads steal the oldest tasks from the front of
+// the other deques. Tasks submitted from outside the pool go to one shared
+// deque that all threads steal from.
+class ThreadPool {
+public:
+    // Inputs:
+    //   num_threads  total number of threads to use (0 = one per hardware
+    //     thread)
+    explicit ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Total number of threads including the waiting caller
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Queue a task for execution on any thread of the pool
+    void submit(std::function<void()> task);
+
+    // Pop and run one queued task on the calling thread (its own deque first,
+    // then stealing). Returns false if every deque was empty.
+    bool run_pending_task();
+
+    // Call fn(chunk_begin, chunk_end) over [begin, end) split into chunks of at
+    // least `grain` indices, and wait for all of them.
+    void parallel_for(int begin, int end, int grain,
+                      const std::function<void(int, int)>& fn);
+
+    // Number of hardware threads (at least 1)
+    static int hardware_threads();
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // Index of the calling thread's deque (the shared one for threads outside
+    // the pool)
+    int queue_index() const;
+    // Pop the newest task of queues[index], or steal the oldest task of
+    // another deque
+    bool pop_task(int index, std::function<void()>& task);
+    void worker_loop(int index);
+
+    std::vector<std::thread> workers;
+    // queues[i] belongs to workers[i]; queues.back() is the shared deque
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    // Number of tasks in all deques
+    std::atomic<int> queued;
+    // Idle workers sleep on condition until a task is queued
+    std::mutex sleep_mutex;
+    std::condition_variable condition;
+    bool stopping;
+};
+
+// Tracks a set of tasks submitted to a ThreadPool. Tasks may themselves add
+// further tasks to the group; wait() returns once all of them finished.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool) : pool(pool), pending(0) {}
+    ~TaskGroup() { wait(); }
+
+    void run(std::function<void()> task);
+    // Help executing queued tasks until every task of this group is done
+    void wait();
+
+private:
+    ThreadPool& pool;
+    std::atomic<int> pending;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef TRACE_ZONES_H
+#define TRACE_ZONES_H
+
+#include <cstdint>
+#include <string>
+
+// Scoped timeline zones for profiling where frame and load time goes, written
+// out as Chrome trace-event JSON (open in Perfetto or chrome://tracing).
+//
+//     void Scene::build_bvh() {
+//         TRACE_ZONE("build_bvh");
+//         ...
+//     }
+//
+// Every thread records its finished zones into a ring buffer of its own
+// (the oldest events are overwritten once it is full), so recording threads
+// never wait on each other. Zones are compiled in only with TRACE_ZONES
+// defined (CMake option TRACE_ZONES); without it the macros expand to
+// nothing. When compiled in, recording is still off until
+// set_trace_recording(true): a zone then costs one relaxed atomic load.
+//
+// Zone names must be string literals (or otherwise outlive the recording).
+
+// Turn recording on or off for all threads
+void set_trace_recording(bool enabled);
+bool trace_recording();
+
+// Name the calling thread in the trace (e.g. "render worker 2")
+void set_trace_thread_name(const std::string& name);
+
+// Write the events recorded so far by all threads as Chrome trace-event JSON
+// and clear them.
+//
+// Returns false if the file could not be opened (events are kept) or
+// written.
+bool write_chrome_trace(const std::string& filename);
+
+// Number of events currently held by all threads' buffers
+size_t trace_event_count();
+
+// Records the time from its construction to its destruction as a zone of the
+// calling thread (if recording was on when it was constructed)
+class TraceZone {
+public:
+    explicit TraceZone(const char* name, bool active = true);
+    ~TraceZone() { end(); }
+
+    // End the zone before the end of its scope (later calls do nothing)
+    void end();
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+    const char* name;
+    // 0 if the zone is not recorded
+    uint64_t start_ns;
+};
+
+#ifdef TRACE_ZONES
+constexpr bool TRACE_ZONES_ENABLED = true;
+#define TRACE_ZONE_CONCAT_(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_(a, b)
+// Zone from here to the end of the enclosing scope
+#define TRACE_ZONE(name) TraceZone TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name)
+// Zone that is only recorded if `condition` holds (e.g. only at the root of
+// a recursion)
+#define TRACE_ZONE_IF(name, condition) \
+    TraceZone TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name, condition)
+// Zone in variable `var` that TRACE_ZONE_END(var) ends early, for stretches
+// of code that are not a scope of their own
+#define TRACE_ZONE_NAMED(var, name) TraceZone var(name)
+#define TRACE_ZONE_END(var) var.end()
+#define TRACE_THREAD_NAME(name) set_trace_thread_name(name)
+#else
+constexpr bool TRACE_ZONES_ENABLED = false;
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_ZONE_IF(name, condition) ((void)0)
+#define TRACE_ZONE_NAMED(var, name) ((void)0)
+#define TRACE_ZONE_END(var) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
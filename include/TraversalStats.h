@@ -0,0 +1,70 @@
+#ifndef TRAVERSAL_STATS_H
+#define TRAVERSAL_STATS_H
+
+#include <cstdint>
+
+// Work done by ray queries, to see why a frame is slow. Counting is compiled
+// in only with TRAVERSAL_STATS defined (CMake option TRAVERSAL_STATS);
+// otherwise TRAVERSAL_STATS_ADD expands to nothing and the counters stay 0.
+//
+// Every thread counts into its own thread_local TraversalStats
+// (thread_traversal_stats), so render threads never contend; callers take
+// the difference of two snapshots around the work they want to measure and
+// add up per-thread results afterwards.
+struct TraversalStats
+{
+  // BVH nodes popped (or recursed into) by traversals; a packet traversal
+  // counts each node once for all its rays
+  uint64_t nodes_visited = 0;
+  // Ray-box slab tests (a wide node tests all its children, a packet
+  // frustum test counts as one)
+  uint64_t box_tests = 0;
+  // Ray-triangle tests. Every lane of a SIMD triangle block counts as one,
+  // and the candidates it lets through count again for their exact test.
+  uint64_t triangle_tests = 0;
+  // Ray-triangle tests that hit
+  uint64_t triangle_hits = 0;
+
+  TraversalStats & operator+=(const TraversalStats & other)
+  {
+    nodes_visited += other.nodes_visited;
+    box_tests += other.box_tests;
+    triangle_tests += other.triangle_tests;
+    triangle_hits += other.triangle_hits;
+    return *this;
+  }
+
+  TraversalStats operator-(const TraversalStats & other) const
+  {
+    TraversalStats difference;
+    difference.nodes_visited = nodes_visited - other.nodes_visited;
+    difference.box_tests = box_tests - other.box_tests;
+    difference.triangle_tests = triangle_tests - other.triangle_tests;
+    difference.triangle_hits = triangle_hits - other.triangle_hits;
+    return difference;
+  }
+
+  // Single number for heatmaps: nodes visited plus triangles tested
+  uint64_t cost() const { return nodes_visited + triangle_tests; }
+};
+
+#ifdef TRAVERSAL_STATS
+constexpr bool TRAVERSAL_STATS_ENABLED = true;
+#else
+constexpr bool TRAVERSAL_STATS_ENABLED = false;
+#endif
+
+// Counters of the calling thread
+inline TraversalStats & thread_traversal_stats()
+{
+  thread_local TraversalStats stats;
+  return stats;
+}
+
+#ifdef TRAVERSAL_STATS
+#define TRAVERSAL_STATS_ADD(counter, n) (thread_traversal_stats().counter += (n))
+#else
+#define TRAVERSAL_STATS_ADD(counter, n) ((void)0)
+#endif
+
+#endif
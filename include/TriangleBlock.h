@@ -0,0 +1,92 @@
+#ifndef TRIANGLE_BLOCK_H
+#define TRIANGLE_BLOCK_H
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cstdint>
+
+// Number of triangles in a TriangleBlock: one per lane of the widest float
+// SIMD register available
+#if defined(__AVX__)
+constexpr int TRIANGLE_BLOCK_WIDTH = 8;
+#else
+constexpr int TRIANGLE_BLOCK_WIDTH = 4;
+#endif
+
+// Up to TRIANGLE_BLOCK_WIDTH triangles baked into single-precision
+// structure-of-arrays form (first corner plus the two edges leaving it), so a
+// ray is tested against all of them in one SIMD pass without touching the
+// mesh (see ray_intersect_triangle_block.h). Unused lanes have zero edges,
+// which no ray can hit.
+struct alignas(32) TriangleBlock
+{
+  static constexpr int WIDTH = TRIANGLE_BLOCK_WIDTH;
+  // v0[k][i] is coordinate k of the first corner of triangle i
+  float v0[3][WIDTH];
+  // Edges v1 - v0 and v2 - v0
+  float e1[3][WIDTH];
+  float e2[3][WIDTH];
+  // Caller-defined id of each triangle (-1 for unused lanes)
+  int32_t id[WIDTH];
+  // 10^-3 |e1| |e2|: rays with |det| below this times |direction| are within
+  // ~0.06 degrees of the triangle plane, where the float test cannot resolve
+  // u and v; such lanes are always reported as candidates
+  float grazing_det[WIDTH];
+  // Bitmask of the lanes whose triangle is too thin for the float test to
+  // resolve (altitude below ~10^-3 of its distance from the origin); these
+  // are always reported as candidates
+  uint32_t exact_lanes;
+
+  TriangleBlock()
+  : exact_lanes(0)
+  {
+    for (int i = 0; i < WIDTH; i++)
+      clear(i);
+  }
+
+  // Store triangle (a, b, c) in `lane`. Edges are computed in double
+  // precision before rounding.
+  void set(
+    const int lane,
+    const Eigen::RowVector3d & a,
+    const Eigen::RowVector3d & b,
+    const Eigen::RowVector3d & c,
+    const int triangle_id)
+  {
+    for (int k = 0; k < 3; k++) {
+      v0[k][lane] = static_cast<float>(a[k]);
+      e1[k][lane] = static_cast<float>(b[k] - a[k]);
+      e2[k][lane] = static_cast<float>(c[k] - a[k]);
+    }
+    id[lane] = triangle_id;
+    grazing_det[lane] = static_cast<float>(1e-3 * (b - a).norm() * (c - a).norm());
+
+    const Eigen::RowVector3d ab = b - a;
+    const Eigen::RowVector3d ac = c - a;
+    const Eigen::RowVector3d bc = c - b;
+    const double longest = std::max(ab.norm(), std::max(ac.norm(), bc.norm()));
+    const double twice_area = ab.cross(ac).norm();
+    const double extent = std::max(longest,
+      std::max(a.cwiseAbs().maxCoeff(), std::max(b.cwiseAbs().maxCoeff(), c.cwiseAbs().maxCoeff())));
+    if (twice_area < 1e-3 * extent * longest)
+      exact_lanes |= 1u << lane;
+    else
+      exact_lanes &= ~(1u << lane);
+  }
+
+  // Mark `lane` unused
+  void clear(const int lane)
+  {
+    for (int k = 0; k < 3; k++) {
+      v0[k][lane] = 0;
+      e1[k][lane] = 0;
+      e2[k][lane] = 0;
+    }
+    id[lane] = -1;
+    grazing_det[lane] = 0;
+    exact_lanes &= ~(1u << lane);
+  }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "LinearBVH.h"
+#include "BoundingBox.h"
+#include "MappedVector.h"
+#include "Object.h"
+#include "PreparedRay.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+#include "TriangleBlock.h"
+#include <cstdint>
+#include <vector>
+
+// Node of a WideBVH with up to N children. Child bounds are stored as
+// structure-of-arrays so one ray is tested against all N boxes at once.
+template <int N>
+struct alignas(64) WideBVHNode
+{
+  // bounds[0..2] = min x/y/z, bounds[3..5] = max x/y/z of each child. Unused
+  // slots hold an empty box (min = +inf, max = -inf), which no ray can hit.
+  float bounds[6][N];
+  // Internal child: index of the child node. Leaf child: index of its first
+  // object in WideBVH::primitives, or of its first block in WideBVH::blocks
+  // when the triangles are baked. Unused slot: -1.
+  int32_t child[N];
+  // Number of objects (or blocks) of a leaf child (0 for internal and unused
+  // slots)
+  int32_t count[N];
+};
+
+// Multi-way bounding volume hierarchy obtained by collapsing a binary
+// LinearBVH: each node absorbs the largest-area internal nodes below it until
+// it has N children. Traversal tests a ray against all children of a node in
+// a single SIMD pass (SSE for N=4, AVX for N=8 when compiled with AVX,
+// portable scalar code otherwise).
+//
+// When every object is a MeshTriangle the leaves are baked into
+// TriangleBlocks and tested a block of triangles at a time; only the few
+// triangles that pass this float test go through the exact
+// Object::ray_intersect.
+//
+// Like the LinearBVH's, nodes, primitive_indices and blocks may view a
+// mapped scene cache.
+template <int N>
+struct WideBVH
+{
+  MappedVector<WideBVHNode<N> > nodes;
+  // Objects in leaf order (same order as the source LinearBVH)
+  std::vector<const Object *> primitives;
+  // primitive_indices[i] is the index of primitives[i] in the original list
+  MappedVector<int> primitive_indices;
+  // Baked leaf triangles in leaf order (empty unless all primitives are
+  // MeshTriangles). Block lane ids are positions in primitives.
+  MappedVector<TriangleBlock> blocks;
+  // Depth of the deepest node (root has depth == 0)
+  int max_depth = 0;
+
+  WideBVH() {}
+  // Collapse a binary LinearBVH.
+  explicit WideBVH(const LinearBVH & bvh);
+
+  bool empty() const { return nodes.empty(); }
+  // Bytes used by nodes, primitive lists and triangle blocks
+  size_t memory_bytes() const;
+  // Recompute all child bounds bottom-up from the objects' current boxes,
+  // keeping the topology (see LinearBVH::refit). Baked triangles are
+  // re-read from their meshes.
+  void refit(ThreadPool & pool);
+
+  // Find the closest object hit by a ray (see LinearBVH::ray_intersect).
+  bool ray_intersect(
+    const Ray & ray,
+    const double min_t,
+    const double max_t,
+    HitRecord & hit) const;
+  // Same as above for a prepared ray (see LinearBVH::ray_intersect)
+  bool ray_intersect(
+    const PreparedRay & ray,
+    const double min_t,
+    const double max_t,
+    HitRecord & hit) const;
+  // Is the ray blocked by any object in [min_t, max_t]? (see
+  // LinearBVH::ray_occluded)
+  bool ray_occluded(
+    const Ray & ray,
+    const double min_t,
+    const double max_t) const;
+  bool ray_occluded(
+    const PreparedRay & ray,
+    const double min_t,
+    const double max_t) const;
+  // Find the closest hit of every ray of a packet (see
+  // LinearBVH::ray_intersect_packet). Children the packet's frustum cannot
+  // decide are tested in one SIMD pass per active ray.
+  unsigned ray_intersect_packet(
+    const RayPacket & packet,
+    const double min_t,
+    const double max_t,
+    HitRecord * hits) const;
+};
+
+using BVH4 = WideBVH<4>;
+using BVH8 = WideBVH<8>;
+
+#endif
@@ -4,12 +4,15 @@
 #include <Eigen/Core>
 // Grow a box `B` by inserting a box `A`.
 //
+// Templates:
+//   Scalar  double or float
 // Inputs:
 //   A  bounding box to be inserted
 //   B  bounding box to be grown
 // Outputs:
 //   B  bounding box grown to include original contents and A
+template <typename Scalar>
 void insert_box_into_box(
-  const BoundingBox & A,
-  BoundingBox & B);
+  const BoundingBoxT<Scalar> & A,
+  BoundingBoxT<Scalar> & B);
 #endif
@@ -6,6 +6,8 @@
 
 // Grow a box `B` by inserting a triangle with corners `a`, `b`, and `c`.
 //
+// Templates:
+//   Scalar  double or float
 // Inputs:
 //   a  first corner of triangle
 //   b  second corner of triangle
@@ -13,10 +15,11 @@
 //   B  bounding box to be grown
 // Outputs:
 //   B  bounding box grown to include original contents and triangle
+template <typename Scalar>
 void insert_triangle_into_box(
-  const Eigen::RowVector3d & a,
-  const Eigen::RowVector3d & b,
-  const Eigen::RowVector3d & c,
-  BoundingBox & B);
+  const Eigen::Matrix<Scalar, 1, 3> & a,
+  const Eigen::Matrix<Scalar, 1, 3> & b,
+  const Eigen::Matrix<Scalar, 1, 3> & c,
+  BoundingBoxT<Scalar> & B);
 
 #endif
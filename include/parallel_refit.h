@@ -0,0 +1,89 @@
+#ifndef PARALLEL_REFIT_H
+#define PARALLEL_REFIT_H
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+// Recompute every node of a tree bottom-up, in parallel. The tree must be
+// stored depth-first: node 0 is the root, children have larger indices than
+// their parent and every subtree occupies a contiguous range of indices.
+// The top levels are cut into a few subtrees per thread; each subtree is
+// refit by walking its index range backwards, then the nodes above the cut
+// are refit serially.
+//
+// Inputs:
+//   pool  threads to use
+//   num_nodes  number of nodes in the tree
+//   children  children(i, kids) appends the indices of the child *nodes* of
+//     node i to kids (nothing for leaves)
+//   refit_node  refit_node(i) recomputes node i from its children, which are
+//     already up to date, and returns a value to accumulate
+// Returns the sum of refit_node(i) over all nodes
+template <typename Children, typename RefitNode>
+double parallel_refit(
+  ThreadPool & pool,
+  const int num_nodes,
+  const Children & children,
+  const RefitNode & refit_node)
+{
+  if (num_nodes == 0)
+    return 0.0;
+
+  // End of the index range of the subtree rooted at i
+  const auto subtree_end = [&](int i) {
+    std::vector<int> kids;
+    while (true) {
+      kids.clear();
+      children(i, kids);
+      if (kids.empty())
+        return i + 1;
+      i = *std::max_element(kids.begin(), kids.end());
+    }
+  };
+
+  // Expand the top levels breadth-first until there are enough subtrees
+  std::vector<int> top;
+  std::vector<int> cut = {0};
+  const size_t target = 4 * pool.size();
+  std::vector<int> kids;
+  while (cut.size() < target) {
+    std::vector<int> next;
+    bool expanded = false;
+    for (const int c : cut) {
+      kids.clear();
+      children(c, kids);
+      if (kids.empty()) {
+        next.push_back(c);
+      } else {
+        top.push_back(c);
+        next.insert(next.end(), kids.begin(), kids.end());
+        expanded = true;
+      }
+    }
+    cut = std::move(next);
+    if (!expanded)
+      break;
+  }
+
+  std::vector<double> partial(cut.size(), 0.0);
+  pool.parallel_for(0, cut.size(), 1, [&](const int begin, const int end) {
+    for (int k = begin; k < end; k++) {
+      for (int j = subtree_end(cut[k]) - 1; j >= cut[k]; j--) {
+        partial[k] += refit_node(j);
+      }
+    }
+  });
+
+  double sum = 0.0;
+  for (const double p : partial) {
+    sum += p;
+  }
+  // Breadth-first order reversed visits children before parents
+  for (auto it = top.rbegin(); it != top.rend(); ++it) {
+    sum += refit_node(*it);
+  }
+  return sum;
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef PEAK_MEMORY_USAGE_H
+#define PEAK_MEMORY_USAGE_H
+
+#include <cstddef>
+
+// Peak resident set size of the current process.
+//
+// Returns peak memory usage in bytes (0 if unsupported on this platform)
+size_t peak_memory_usage();
+
+#endif
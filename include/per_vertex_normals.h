@@ -1,18 +1,53 @@
 #ifndef PER_VERTEX_NORMALS_H
 #define PER_VERTEX_NORMALS_H
 
+#include "ThreadPool.h"
 #include <Eigen/Core>
 
-// Compute per-vertex normals for a triangle mesh.
+// Compute per-vertex normals for a triangle mesh: the normalized sum of the
+// area normals of the faces around every vertex (zero for vertices with no
+// or only degenerate faces).
+//
+// Face normals are computed in parallel (on a pool sized to the mesh; small
+// meshes stay on the calling thread), then added to their corners in face
+// order, so no adjacency is built and the result does not depend on the
+// number of threads.
+//
+// Templates:
+//   Scalar  double or float
+// Inputs:
+//   V  #V by 3 matrix of vertex positions
+//   F  #F by 3 matrix of face indices
+// Outputs:
+//   N  #V by 3 matrix of vertex normals
+template <typename Scalar>
+void per_vertex_normals(
+  const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & V,
+  const Eigen::MatrixXi & F,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & N);
+
+// Same as above using a vertex-face adjacency that is already at hand: face
+// normals, then every vertex gathers the normals of its faces, both in
+// parallel on `pool`. The face normals are kept (e.g. for
+// update_per_vertex_normals). Matches the version above exactly.
 //
 // Inputs:
 //   V  #V by 3 matrix of vertex positions
 //   F  #F by 3 matrix of face indices
+//   VF  #F*3 list of face indices and
+//   NI  #V+1 list of offsets into VF (see vertex_triangle_adjacency.h)
+//   pool  threads to compute with
 // Outputs:
+//   FN  #F by 3 matrix of face area normals (see triangle_area_normal.h)
 //   N  #V by 3 matrix of vertex normals
+template <typename Scalar>
 void per_vertex_normals(
-  const Eigen::MatrixXd & V,
+  const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & V,
   const Eigen::MatrixXi & F,
-  Eigen::MatrixXd & N);
+  const Eigen::VectorXi & VF,
+  const Eigen::VectorXi & NI,
+  ThreadPool & pool,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & FN,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & N);
 
 #endif
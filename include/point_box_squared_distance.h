@@ -0,0 +1,22 @@
+#ifndef POINT_BOX_SQUARED_DISTANCE_H
+#define POINT_BOX_SQUARED_DISTANCE_H
+
+#include "BoundingBox.h"
+#include <Eigen/Core>
+
+// Compute the squared distance between a point and an axis-aligned box (0 if
+// the point is inside). This is a lower bound of the squared distance to
+// anything inside the box.
+//
+// Templates:
+//   Scalar  double or float
+// Inputs:
+//   query  3D query point
+//   box  axis-aligned bounding box
+// Returns the squared distance from query to the closest point of box
+template <typename Scalar>
+Scalar point_box_squared_distance(
+  const Eigen::Matrix<Scalar, 1, 3> & query,
+  const BoundingBoxT<Scalar> & box);
+
+#endif
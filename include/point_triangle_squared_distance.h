@@ -0,0 +1,31 @@
+#ifndef POINT_TRIANGLE_SQUARED_DISTANCE_H
+#define POINT_TRIANGLE_SQUARED_DISTANCE_H
+
+#include <Eigen/Core>
+
+// Compute the squared distance between a point and a triangle, and the
+// closest point on the triangle. The point is classified against the
+// triangle's Voronoi regions (corners, edges, face), so the result is exact up
+// to rounding for every triangle, degenerate ones included (Ericson,
+// "Real-Time Collision Detection", 5.1.5).
+//
+// Templates:
+//   Scalar  double or float
+// Inputs:
+//   query  3D query point
+//   a  3D position of the first corner of the triangle
+//   b  3D position of the second corner of the triangle
+//   c  3D position of the third corner of the triangle
+// Outputs:
+//   sqrd  squared distance from query to the triangle
+//   p  point on the triangle closest to query
+template <typename Scalar>
+void point_triangle_squared_distance(
+  const Eigen::Matrix<Scalar, 1, 3> & query,
+  const Eigen::Matrix<Scalar, 1, 3> & a,
+  const Eigen::Matrix<Scalar, 1, 3> & b,
+  const Eigen::Matrix<Scalar, 1, 3> & c,
+  Scalar & sqrd,
+  Eigen::Matrix<Scalar, 1, 3> & p);
+
+#endif
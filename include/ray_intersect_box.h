@@ -2,20 +2,33 @@
 #define RAY_INTERSECT_BOX_H
 
 #include "Ray.h"
+#include "PreparedRay.h"
 #include "BoundingBox.h"
 
 // Intersect a ray with an axis-aligned bounding box.
 //
+// Templates:
+//   Scalar  double or float
 // Inputs:
 //   ray  ray to intersect with
 //   box  axis-aligned bounding box
 //   min_t  minimum parametric distance to consider
 //   max_t  maximum parametric distance to consider
 // Returns true iff there is an intersection
+template <typename Scalar>
 bool ray_intersect_box(
-  const Ray & ray,
-  const BoundingBox& box,
-  const double min_t,
-  const double max_t);
+  const RayT<Scalar> & ray,
+  const BoundingBoxT<Scalar> & box,
+  const Scalar min_t,
+  const Scalar max_t);
+// Same as above for a prepared ray: a branch-free slab test using the
+// precomputed inverse direction and direction signs. Exits at slab
+// boundaries are padded by a few ulps so boxes never lose a hit to rounding.
+template <typename Scalar>
+bool ray_intersect_box(
+  const PreparedRayT<Scalar> & ray,
+  const BoundingBoxT<Scalar> & box,
+  const Scalar min_t,
+  const Scalar max_t);
 
 #endif
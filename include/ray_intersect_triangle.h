@@ -2,10 +2,13 @@
 #define RAY_INTERSECT_TRIANGLE_H
 
 #include "Ray.h"
+#include "PreparedRay.h"
 #include <Eigen/Core>
 
 // Intersect a ray with a triangle.
 //
+// Templates:
+//   Scalar  double or float
 // Inputs:
 //   ray  ray to intersect with
 //   A  first corner of triangle
@@ -16,13 +19,60 @@
 // Outputs:
 //   t  parametric distance of intersection
 // Returns true iff there is an intersection
+template <typename Scalar>
 bool ray_intersect_triangle(
-  const Ray & ray,
-  const Eigen::RowVector3d & A,
-  const Eigen::RowVector3d & B,
-  const Eigen::RowVector3d & C,
-  const double min_t,
-  const double max_t,
-  double & t);
+  const RayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t);
+// Same as above for a prepared ray, using the watertight test of Woop et al.:
+// corners are sheared into the ray's frame and classified by 2D edge
+// functions, so a ray through a shared edge or vertex hits at least one of
+// the triangles around it (no cracks). Float edge functions that round to 0
+// are recomputed in double. Both windings are hit; triangles seen exactly
+// edge-on are not.
+template <typename Scalar>
+bool ray_intersect_triangle(
+  const PreparedRayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t);
+
+// Same as above, also returning where the ray hits the triangle
+//
+// Outputs:
+//   t  parametric distance of intersection
+//   u  barycentric coordinate of B at the hit
+//   v  barycentric coordinate of C at the hit, i.e. the hit is at
+//     (1 - u - v) A + u B + v C
+// Returns true iff there is an intersection (outputs are only set then)
+template <typename Scalar>
+bool ray_intersect_triangle(
+  const RayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t,
+  Scalar & u,
+  Scalar & v);
+template <typename Scalar>
+bool ray_intersect_triangle(
+  const PreparedRayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t,
+  Scalar & u,
+  Scalar & v);
 
 #endif
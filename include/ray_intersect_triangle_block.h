@@ -0,0 +1,28 @@
+#ifndef RAY_INTERSECT_TRIANGLE_BLOCK_H
+#define RAY_INTERSECT_TRIANGLE_BLOCK_H
+
+#include "TriangleBlock.h"
+
+// Test a ray against every triangle of a block at once (Möller–Trumbore in
+// single precision, SSE/AVX when available). The test is conservative: its
+// tolerances are wide enough that it keeps every triangle
+// ray_intersect_triangle would report as hit (for scenes where the ray origin
+// is within ~10^4 triangle sizes), so it serves as a filter and callers
+// confirm the returned lanes exactly. Lanes in block.exact_lanes, and lanes the
+// ray grazes (see TriangleBlock::grazing_det), are always returned.
+//
+// Inputs:
+//   block  triangles to intersect with
+//   origin  ray origin
+//   direction  ray direction
+//   min_t  minimum parametric distance to consider
+//   max_t  maximum parametric distance to consider
+// Returns bitmask of the lanes whose triangle may be hit
+unsigned ray_intersect_triangle_block(
+  const TriangleBlock & block,
+  const float origin[3],
+  const float direction[3],
+  const float min_t,
+  const float max_t);
+
+#endif
@@ -1,19 +1,35 @@
 #ifndef READ_OBJ_H
 #define READ_OBJ_H
 
+#include "LoadProgress.h"
 #include <Eigen/Core>
 #include <string>
 #include <vector>
 
+// Read the positions and faces of an OBJ file (other statements are
+// ignored). Faces with more than three corners are split into fans around
+// their first corner; negative (relative) indices count back from the last
+// vertex before the face.
+//
+// The file is memory-mapped and, if large, split into newline-aligned
+// chunks parsed in parallel: a first pass counts the vertices and triangles
+// of every chunk, a second one parses them straight into their rows of V
+// and F.
+//
 // Inputs:
 //   filename  
+//   progress  if not null, bytes_total is set to the file size and
+//     bytes_parsed counts up as the file is parsed; the parse stops early
+//     (returning false) once the load is cancelled
 // Outputs:
 //   V  Vertices (n x 3 matrix)
 //   F  Faces (m x 3 matrix)
-// Returns true if successful
+// Returns true if successful (false if the file cannot be read, a vertex
+// is malformed, a face index is out of range or the load was cancelled)
 bool read_obj(
   const std::string & filename,
   Eigen::MatrixXd & V,
-  Eigen::MatrixXi & F);
+  Eigen::MatrixXi & F,
+  LoadProgress * progress = nullptr);
 
 #endif
\ No newline at end of file
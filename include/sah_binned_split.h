@@ -0,0 +1,56 @@
+#ifndef SAH_BINNED_SPLIT_H
+#define SAH_BINNED_SPLIT_H
+
+#include "BoundingBox.h"
+#include <vector>
+
+// Find the cheapest split of a set of objects according to the binned surface
+// area heuristic. The centroid bounds are divided into `num_bins` equal bins
+// along each axis and every bin boundary is evaluated as a candidate plane.
+//
+// Templates:
+//   Scalar  double or float (box precision)
+// Inputs:
+//   boxes  list of bounding boxes of the objects to split
+//   num_bins  number of bins per axis
+//   traversal_cost  cost of visiting an internal node relative to one object
+//     intersection test
+//   block_size  number of objects a leaf intersects at once (a side holding
+//     n objects costs ceil(n / block_size) intersection tests)
+// Outputs:
+//   axis  axis (0, 1 or 2) of the best split plane
+//   split  position of the best split plane: objects whose box center along
+//     `axis` is < split belong to the left child
+//   cost  SAH cost of the best split, in units of one intersection test
+//     (compare against ceil(boxes.size() / block_size) to decide whether to
+//     make a leaf)
+// Returns false iff no split separates the objects (all centers coincide)
+template <typename Scalar>
+bool sah_binned_split(
+  const std::vector<BoundingBoxT<Scalar> > & boxes,
+  const int num_bins,
+  const double traversal_cost,
+  const int block_size,
+  int & axis,
+  double & split,
+  double & cost);
+// Same as above, but only splits the subset of objects listed in `indices`
+// (used by builders that partition an index array in place).
+//
+// Inputs:
+//   boxes  list of bounding boxes of all objects
+//   indices  list of num_indices indices into boxes of the objects to split
+//   num_indices  number of objects to split
+template <typename Scalar>
+bool sah_binned_split(
+  const std::vector<BoundingBoxT<Scalar> > & boxes,
+  const int * indices,
+  const int num_indices,
+  const int num_bins,
+  const double traversal_cost,
+  const int block_size,
+  int & axis,
+  double & split,
+  double & cost);
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "BVHBuildOptions.h"
+#include "BVHStats.h"
+#include "LinearBVH.h"
+#include "MappedFile.h"
+#include "WideBVH.h"
+#include <Eigen/Core>
+#include <memory>
+#include <string>
+
+// Binary cache of a loaded mesh: its vertices, faces, per-vertex normals,
+// flattened LinearBVH and the wide BVH collapsed from it, so reloading an
+// unchanged OBJ skips parsing, normals and the BVH build and collapse.
+//
+// The file is a fixed header followed by one section per array, each
+// aligned to 64 bytes and stored exactly as in memory (column-major V and N
+// as doubles, F as int32, raw LinearBVHNodes, int32 primitive indices, raw
+// WideBVHNodes and TriangleBlocks). A read cache is used in place: the
+// matrices and BVH arrays view the sections of the mapping, so loads copy
+// nothing and processes showing the same model share its pages. The header
+// records the format version, byte order and element sizes, the size and
+// modification time of the source file, the BVH build options and the
+// BVH's stats, and a checksum of the header and sections: a cache that does
+// not match any of them is ignored.
+
+// Contents of a cache file. V, F, N and the arrays of the BVHs view the
+// sections of `file`, which stays mapped while any of them (or copies of
+// the BVHs) are in use.
+struct SceneCache
+{
+  std::shared_ptr<const MappedFile> file;
+  Eigen::Map<const Eigen::MatrixXd> V{nullptr, 0, 3};
+  Eigen::Map<const Eigen::MatrixXi> F{nullptr, 0, 3};
+  Eigen::Map<const Eigen::MatrixXd> N{nullptr, 0, 3};
+  // nodes, primitive_indices and max_depth of the cached hierarchy
+  // (primitives is left empty: it points into the caller's objects)
+  LinearBVH bvh;
+  BVHStats bvh_stats;
+  // Wide BVH of options.branching_factor 4 or 8, likewise without
+  // primitives (both are empty for branching factor 2)
+  BVH4 bvh4;
+  BVH8 bvh8;
+};
+
+// Path of the cache file of an OBJ file
+//
+// Inputs:
+//   source  path of the OBJ file
+//   cache_dir  directory holding cache files (created if missing), or empty
+//     to keep the cache next to the source as source + ".cache"
+// Returns the path of the cache file. Files in cache_dir are named after
+// the source's file name and a hash of its absolute path, so equally named
+// sources in different directories do not collide.
+std::string scene_cache_path(
+  const std::string & source,
+  const std::string & cache_dir = "");
+
+// Write a cache file (to a uniquely named temporary file first, renamed
+// into place once complete, so readers never see a partial cache and
+// concurrent writers never interleave)
+//
+// Inputs:
+//   filename  path of the cache file
+//   source  path of the OBJ file the mesh was read from
+//   options  options the BVH was built with (only the ones that change the
+//     BVHs are recorded: method, bins, leaf sizes, costs, SBVH limits and
+//     branching factor)
+//   V  #V by 3 vertex positions
+//   F  #F by 3 face indices into V
+//   N  #V by 3 per-vertex normals
+//   bvh  hierarchy built over the faces of F (primitive_indices index F)
+//   bvh_stats  bvh.stats(options.traversal_cost)
+//   bvh4  bvh collapsed if options.branching_factor is 4 (else ignored)
+//   bvh8  bvh collapsed if options.branching_factor is 8 (else ignored)
+// Returns true iff the file was written
+bool write_scene_cache(
+  const std::string & filename,
+  const std::string & source,
+  const BVHBuildOptions & options,
+  const Eigen::Ref<const Eigen::MatrixXd> & V,
+  const Eigen::Ref<const Eigen::MatrixXi> & F,
+  const Eigen::Ref<const Eigen::MatrixXd> & N,
+  const LinearBVH & bvh,
+  const BVHStats & bvh_stats,
+  const BVH4 & bvh4,
+  const BVH8 & bvh8);
+
+// Map a cache file written by write_scene_cache, if it is valid for
+// `source` as it is now and for `options`
+//
+// Inputs:
+//   filename  path of the cache file
+//   source  path of the OBJ file the cache should be of
+//   options  options the BVHs should have been built with
+// Outputs:
+//   cache  mapping of the file and views of its contents (only changed if
+//     the cache is valid)
+// Returns true iff the cache exists and is valid
+bool read_scene_cache(
+  const std::string & filename,
+  const std::string & source,
+  const BVHBuildOptions & options,
+  SceneCache & cache);
+
+#endif
@@ -5,14 +5,16 @@
 // Compute the normal vector of a 3D triangle given its corner locations. The
 // output vector should have length equal to the area of the triangle.
 //
+// Templates:
+//   Scalar  double or float
 // Inputs:
 //   a  3D position of the first corner as a **row vector**
 //   b  3D position of the second corner as a **row vector**
 //   c  3D position of the third corner as a **row vector**
 // Returns the area normal of the triangle as a 3D row vector
-Eigen::RowVector3d triangle_area_normal(
-  const Eigen::RowVector3d & a, 
-  const Eigen::RowVector3d & b, 
-  const Eigen::RowVector3d & c);
+template <typename Scalar>
+Eigen::Matrix<Scalar, 1, 3> triangle_area_normal(
+  const Eigen::Matrix<Scalar, 1, 3> & a, 
+  const Eigen::Matrix<Scalar, 1, 3> & b, 
+  const Eigen::Matrix<Scalar, 1, 3> & c);
 #endif
-
@@ -0,0 +1,30 @@
+#ifndef UPDATE_PER_VERTEX_NORMALS_H
+#define UPDATE_PER_VERTEX_NORMALS_H
+
+#include <Eigen/Core>
+#include <vector>
+
+// Update per-vertex normals after some vertices moved. Only faces incident on
+// a moved vertex and the vertices of those faces are recomputed; the result
+// matches a full per_vertex_normals call.
+//
+// Inputs:
+//   V  #V by 3 matrix of (new) vertex positions
+//   F  #F by 3 matrix of face indices
+//   VF  #F*3 list of face indices and
+//   NI  #V+1 list of offsets into VF: the vertex-face adjacency of F (see
+//     vertex_triangle_adjacency.h)
+//   moved  list of indices of vertices whose position changed
+// Inputs/Outputs:
+//   FN  #F by 3 matrix of face area normals (see triangle_area_normal.h)
+//   N  #V by 3 matrix of unit vertex normals (see per_vertex_normals.h)
+void update_per_vertex_normals(
+  const Eigen::MatrixXd & V,
+  const Eigen::MatrixXi & F,
+  const Eigen::VectorXi & VF,
+  const Eigen::VectorXi & NI,
+  const std::vector<int> & moved,
+  Eigen::MatrixXd & FN,
+  Eigen::MatrixXd & N);
+
+#endif
@@ -2,18 +2,22 @@
 #define VERTEX_TRIANGLE_ADJACENCY_H
 
 #include <Eigen/Core>
-#include <vector>
 
-// Compute vertex-triangle adjacency list.
+// Compute vertex-triangle adjacency in compressed sparse row form: a counting
+// pass over F sizes every vertex's run, a prefix sum places the runs, and a
+// second pass fills them (two allocations in total, however many vertices).
 //
 // Inputs:
 //   F  #F by 3 matrix of face indices
 //   num_vertices  number of vertices
 // Outputs:
-//   VF  list of lists so that VF[i] is a list of face indices incident on vertex i
+//   VF  3*#F list of face indices, so that the faces incident on vertex i
+//     are VF(NI(i)), ..., VF(NI(i+1)-1) in increasing order
+//   NI  num_vertices+1 list of offsets into VF
 void vertex_triangle_adjacency(
   const Eigen::MatrixXi & F,
   const int num_vertices,
-  std::vector<std::vector<int> > & VF);
+  Eigen::VectorXi & VF,
+  Eigen::VectorXi & NI);
 
 #endif
@@ -22,4 +22,8 @@ void viewing_ray(
   const int height,
   Ray & ray);
 
+// Hits of viewing rays nearer than this parametric distance are ignored (a
+// little in front of the camera, in units of the unnormalized direction)
+constexpr double VIEWING_RAY_MIN_T = 0.01;
+
 #endif
@@ -1,8 +1,10 @@
 #include <iostream>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <cmath>
 #include <algorithm>
+#include <fstream>
 #include <Eigen/Core>
 
 #ifdef USE_IMGUI
@@ -13,11 +15,17 @@
 #endif
 
 #include "Scene.h"
+#include "SceneLoader.h"
 #include "Camera.h"
 #include "ASCIIRenderer.h"
 #include "CameraController.h"
+#include "TraceZones.h"
 
-Scene g_scene;
+// Scene being rendered. Loads run on g_loader's thread and replace it only
+// once complete (see poll_loaded_model), so the old one keeps rendering
+// meanwhile.
+std::shared_ptr<Scene> g_scene = std::make_shared<Scene>();
+SceneLoader g_loader;
 Camera g_camera;
 ASCIIRenderer g_renderer;
 CameraController g_camera_controller;
@@ -29,28 +37,44 @@ float g_light_phi =150.0f;
 double g_fps = 0.0;
 double g_render_time = 0.0;
 
+// Playback of animated meshes (paths containing a printf pattern such as
+// "walk_%03d.obj" load a numbered OBJ sequence)
+bool g_animation_playing = true;
+float g_animation_fps = 24.0f;
+double g_animation_time = 0.0;
+
+// Start loading a model in the background with the current scene's settings
 void load_model(const std::string& filename) {
     if (filename.empty()) return;
 
-    std::cout << "Loading: " << filename << std::endl;
+    SceneLoadRequest request;
+    request.filename = filename;
+    request.animation_fps = g_animation_fps;
+    request.bvh_options = g_scene->bvh_options;
+    request.use_cache = g_scene->use_cache;
+    request.cache_dir = g_scene->cache_dir;
+    g_loader.load(request);
+}
+
+// Swap in the model of a finished load and fit the camera to it
+void poll_loaded_model() {
+    std::shared_ptr<Scene> loaded = g_loader.take();
+    if (!loaded) return;
+    TRACE_ZONE("swap scene");
+    g_scene = loaded;
+    g_animation_time = 0.0;
+
+    BoundingBox box = g_scene->bvh.box();
+    Eigen::RowVector3d center = box.center();
+    Eigen::RowVector3d size = box.max_corner - box.min_corner;
+    double max_size = size.maxCoeff();
     
-    g_scene = Scene(); 
-    g_scene.load_mesh(filename);
+    g_camera_controller.set_target_and_fit(
+        Eigen::Vector3d(center(0), center(1), center(2)),
+        max_size * 0.8
+    );
     
-    if (g_scene.bvh) {
-        Eigen::RowVector3d center = g_scene.bvh->box.center();
-        Eigen::RowVector3d size = g_scene.bvh->box.max_corner - g_scene.bvh->box.min_corner;
-        double max_size = size.maxCoeff();
-        
-        g_camera_controller.set_target_and_fit(
-            Eigen::Vector3d(center(0), center(1), center(2)),
-            max_size * 0.8
-        );
-        
-        std::cout << "✓ Loaded: " << g_scene.bvh->num_leaves << " triangles" << std::endl;
-    } else {
-        std::cerr << "Failed to load model or model is empty." << std::endl;
-    }
+    std::cout << "✓ Loaded: " << g_scene->objects.size() << " triangles" << std::endl;
 }
 
 #ifdef USE_IMGUI
@@ -78,6 +102,28 @@ void run_with_imgui() {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGui::StyleColorsDark();
+    
+    // Block elements and Braille patterns for the Unicode glyph modes, merged
+    // into the default font from a system font when one is found, at the
+    // default font's character width so the frame stays aligned
+    {
+        ImGuiIO& io = ImGui::GetIO();
+        io.Fonts->AddFontDefault();
+        static const ImWchar unicode_glyphs[] = {0x2580, 0x259F, 0x2800, 0x28FF, 0};
+        ImFontConfig config;
+        config.MergeMode = true;
+        config.GlyphMinAdvanceX = config.GlyphMaxAdvanceX = 7.0f;
+        const char* font_paths[] = {
+            "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+            "/usr/share/fonts/dejavu-sans-mono-fonts/DejaVuSansMono.ttf",
+            "C:\\Windows\\Fonts\\seguisym.ttf"};
+        for (const char* path : font_paths) {
+            if (std::ifstream(path)) {
+                io.Fonts->AddFontFromFileTTF(path, 13.0f, &config, unicode_glyphs);
+                break;
+            }
+        }
+    }
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 150");
     
@@ -108,11 +154,19 @@ void run_with_imgui() {
     auto last_time = std::chrono::high_resolution_clock::now();
     
     while (!glfwWindowShouldClose(window)) {
+        TRACE_ZONE("frame");
         auto current_time = std::chrono::high_resolution_clock::now();
         double delta_time = std::chrono::duration<double>(current_time - last_time).count();
         last_time = current_time;
         g_fps = 1.0 / delta_time;
         
+        poll_loaded_model();
+        if (g_animation_playing && !g_scene->animation.empty()) {
+            g_animation_time += delta_time;
+            g_scene->set_animation_time(g_animation_time);
+        }
+        
+        TRACE_ZONE_NAMED(camera_zone, "camera update");
         g_camera_controller.update(delta_time);
         g_camera_controller.apply_to_camera(g_camera, g_renderer.aspect_ratio_correction);
         
@@ -128,12 +182,15 @@ void run_with_imgui() {
             cos(theta_rad) * camera_up +
             sin(theta_rad) * sin(phi_rad) * camera_forward
         ).normalized();
+        TRACE_ZONE_END(camera_zone);
         
         auto render_start = std::chrono::high_resolution_clock::now();
-        std::string ascii_frame = g_renderer.render(g_scene, g_camera);
+        static std::string ascii_frame;
+        g_renderer.render(*g_scene, g_camera, ascii_frame);
         auto render_end = std::chrono::high_resolution_clock::now();
         g_render_time = std::chrono::duration<double>(render_end - render_start).count();
         
+        TRACE_ZONE_NAMED(imgui_zone, "ImGui submit");
         glfwPollEvents();
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -163,7 +220,33 @@ void run_with_imgui() {
         ImGui::Begin("Controls", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
         
         ImGui::Text("FPS: %.0f", g_fps);
-        ImGui::Text("Render: %.1f ms", g_render_time * 1000.0);
+        ImGui::Text("Render: %.3f ms (%s)", g_render_time * 1000.0,
+                    g_renderer.last_invalidation == FrameInvalidation::RETRACE ? "traced"
+                    : g_renderer.last_invalidation == FrameInvalidation::RESHADE ? "reshaded" : "cached");
+        {
+            int grid_width, grid_height;
+            g_renderer.get_grid_size(grid_width, grid_height);
+            const int cells = std::max(grid_width * grid_height, 1);
+            ImGui::Text("Rays: %d + %d shadow (%.2f per cell)", g_renderer.primary_rays_traced,
+                        g_renderer.shadow_rays_traced, double(g_renderer.primary_rays_traced) / cells);
+        }
+        if (TRAVERSAL_STATS_ENABLED) {
+            const TraversalStats& stats = g_renderer.last_traversal_stats;
+            const double rays = std::max(g_renderer.primary_rays_traced + g_renderer.shadow_rays_traced, 1);
+            ImGui::Text("Nodes: %llu (%.1f per ray)", (unsigned long long)stats.nodes_visited,
+                        stats.nodes_visited / rays);
+            ImGui::Text("Box tests: %llu (%.1f per ray)", (unsigned long long)stats.box_tests,
+                        stats.box_tests / rays);
+            ImGui::Text("Triangles: %llu (%.1f per ray)", (unsigned long long)stats.triangle_tests,
+                        stats.triangle_tests / rays);
+            ImGui::Text("Triangle hits: %llu", (unsigned long long)stats.triangle_hits);
+            ImGui::Checkbox("Cost Heatmap", &g_renderer.heatmap);
+            if (g_renderer.heatmap) {
+                ImGui::SliderInt("Max Cost (0 = auto)", &g_renderer.heatmap_max_cost, 0, 1000);
+            }
+        } else {
+            ImGui::TextDisabled("Traversal stats: build with -DTRAVERSAL_STATS=ON");
+        }
         
         ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
         
@@ -182,13 +265,131 @@ void run_with_imgui() {
         if (ImGui::Button("Load", ImVec2(-1, 0))) {
             load_model(g_model_path_buffer);
         }
+        ImGui::Checkbox("Use Scene Cache", &g_scene->use_cache);
+        if (g_loader.loading()) {
+            const LoadProgress& progress = g_loader.progress();
+            const LoadStage stage = progress.stage;
+            char overlay[64];
+            if (stage == LoadStage::READING && progress.bytes_total > 0) {
+                std::snprintf(overlay, sizeof(overlay), "%s %.0f / %.0f MB", load_stage_name(stage),
+                              progress.bytes_parsed / (1024.0 * 1024.0), progress.bytes_total / (1024.0 * 1024.0));
+            } else if (stage == LoadStage::BUILDING_BVH) {
+                std::snprintf(overlay, sizeof(overlay), "%s %.0f%%", load_stage_name(stage),
+                              progress.fraction() * 100.0);
+            } else {
+                std::snprintf(overlay, sizeof(overlay), "%s", load_stage_name(stage));
+            }
+            ImGui::ProgressBar(progress.fraction(), ImVec2(-1, 0), overlay);
+            if (ImGui::Button("Cancel Load", ImVec2(-1, 0))) {
+                g_loader.cancel();
+            }
+        } else if (g_loader.progress().stage == LoadStage::FAILED ||
+                   g_loader.progress().stage == LoadStage::CANCELLED) {
+            ImGui::TextDisabled("%s: %s", load_stage_name(g_loader.progress().stage),
+                                g_loader.filename().c_str());
+        }
         
         ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
         
+        ImGui::TextColored(ImVec4(0.5, 1, 0.5, 1), "BVH");
+        const char* builder_names[] = {"Midpoint", "SAH (binned)", "SBVH (spatial splits)"};
+        int builder_idx = static_cast<int>(g_scene->bvh_options.method);
+        bool rebuild = false;
+        if (ImGui::Combo("Builder", &builder_idx, builder_names, IM_ARRAYSIZE(builder_names))) {
+            g_scene->bvh_options.method = static_cast<BVHSplitMethod>(builder_idx);
+            rebuild = true;
+        }
+        const char* width_names[] = {"Binary", "BVH4", "BVH8"};
+        const int widths[] = {2, 4, 8};
+        int width_idx = g_scene->bvh_options.branching_factor == 8 ? 2
+                      : g_scene->bvh_options.branching_factor == 4 ? 1 : 0;
+        if (ImGui::Combo("Width", &width_idx, width_names, IM_ARRAYSIZE(width_names))) {
+            g_scene->bvh_options.branching_factor = widths[width_idx];
+            rebuild = true;
+        }
+        if (g_scene->bvh_options.method != BVHSplitMethod::MIDPOINT) {
+            ImGui::SliderInt("Bins", &g_scene->bvh_options.num_bins, 2, 64);
+            rebuild |= ImGui::IsItemDeactivatedAfterEdit();
+            ImGui::SliderInt("Leaf Size", &g_scene->bvh_options.max_leaf_size, 1, 16);
+            rebuild |= ImGui::IsItemDeactivatedAfterEdit();
+            float traversal_cost = (float)g_scene->bvh_options.traversal_cost;
+            if (ImGui::SliderFloat("Trav. Cost", &traversal_cost, 0.1f, 4.0f)) {
+                g_scene->bvh_options.traversal_cost = traversal_cost;
+            }
+            rebuild |= ImGui::IsItemDeactivatedAfterEdit();
+        }
+        if (g_scene->bvh_options.method == BVHSplitMethod::SBVH) {
+            float growth = (float)g_scene->bvh_options.max_reference_growth;
+            if (ImGui::SliderFloat("Ref. Budget", &growth, 0.0f, 2.0f)) {
+                g_scene->bvh_options.max_reference_growth = growth;
+            }
+            rebuild |= ImGui::IsItemDeactivatedAfterEdit();
+        }
+        if (rebuild) {
+            g_scene->build_bvh();
+        }
+        ImGui::Checkbox("Watertight Rays", &g_renderer.use_prepared_rays);
+        const char* packet_names[] = {"Off", "4 (2x2)", "8 (4x2)", "16 (4x4)"};
+        const int packet_sizes[] = {1, 4, 8, 16};
+        int packet_idx = g_renderer.packet_size >= 16 ? 3
+                       : g_renderer.packet_size >= 8 ? 2
+                       : g_renderer.packet_size >= 4 ? 1 : 0;
+        if (ImGui::Combo("Packets", &packet_idx, packet_names, IM_ARRAYSIZE(packet_names))) {
+            g_renderer.packet_size = packet_sizes[packet_idx];
+        }
+        const char* adaptive_names[] = {"Off", "2x2", "4x4"};
+        const int adaptive_steps[] = {1, 2, 4};
+        int adaptive_idx = g_renderer.adaptive_step >= 4 ? 2
+                         : g_renderer.adaptive_step >= 2 ? 1 : 0;
+        if (ImGui::Combo("Adaptive", &adaptive_idx, adaptive_names, IM_ARRAYSIZE(adaptive_names))) {
+            g_renderer.adaptive_step = adaptive_steps[adaptive_idx];
+        }
+        if (g_renderer.adaptive_step > 1) {
+            ImGui::SliderInt("Tolerance", &g_renderer.adaptive_tolerance, 0, 4);
+            ImGui::Checkbox("Refine Triangle Edges", &g_renderer.adaptive_refine_primitives);
+        }
+        ImGui::Text("Nodes: %d (%d leaves)", g_scene->bvh_stats.num_nodes, g_scene->bvh_stats.num_leaf_nodes);
+        ImGui::Text("Depth: %d", g_scene->bvh_stats.max_depth);
+        ImGui::Text("SAH Cost: %.2f", g_scene->bvh_stats.sah_cost);
+        ImGui::Text("Memory: %.1f MB", g_scene->bvh_memory_bytes() / (1024.0 * 1024.0));
+        ImGui::Text("Build: %.1f ms (%d threads)", g_scene->load_stats.bvh_seconds * 1000.0, g_scene->load_stats.bvh_threads);
+        ImGui::Text("Build peak: %.1f MB", g_scene->load_stats.bvh_peak_bytes / (1024.0 * 1024.0));
+        ImGui::Text("Load: read %.0f / normals %.0f ms%s",
+                    g_scene->load_stats.read_seconds * 1000.0, g_scene->load_stats.normals_seconds * 1000.0,
+                    g_scene->load_stats.from_cache ? " (cache)" : "");
+        ImGui::Text("Peak RSS: %.1f MB", g_scene->load_stats.peak_rss_bytes / (1024.0 * 1024.0));
+        
+        ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
+        
+        if (!g_scene->animation.empty()) {
+            ImGui::TextColored(ImVec4(1, 0.5, 1, 1), "Animation");
+            ImGui::Checkbox("Play", &g_animation_playing);
+            float duration = (float)g_scene->animation.duration();
+            float time = duration > 0.0f ? (float)std::fmod(g_animation_time, (double)duration) : 0.0f;
+            if (ImGui::SliderFloat("Time", &time, 0.0f, duration)) {
+                g_animation_time = time;
+                g_scene->set_animation_time(g_animation_time);
+            }
+            ImGui::Text("Frames: %d, %.2f s", (int)g_scene->animation.frames.size(), g_scene->animation.duration());
+            ImGui::Checkbox("Interpolate", &g_scene->animation.interpolate);
+            float ratio = (float)g_scene->rebuild_cost_ratio;
+            if (ImGui::SliderFloat("Rebuild at", &ratio, 1.0f, 4.0f, "%.2fx SAH")) {
+                g_scene->rebuild_cost_ratio = ratio;
+            }
+            ImGui::Text("Update: %.2f ms", g_scene->animation_update_seconds * 1000.0);
+            ImGui::Text("Refits: %d, rebuilds: %d", g_scene->num_refits, g_scene->num_rebuilds);
+            ImGui::Text("SAH: %.2f (built %.2f)", g_scene->refit_sah_cost, g_scene->built_sah_cost);
+            
+            ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
+        }
+        
         ImGui::TextColored(ImVec4(0, 1, 1, 1), "Render Settings");
         ImGui::Text("Resolution");
         ImGui::SliderInt("##res", &g_renderer.resolution, 40, 400);
         
+        ImGui::Text("Threads (0 = all cores)");
+        ImGui::SliderInt("##threads", &g_renderer.num_threads, 0, ThreadPool::hardware_threads());
+        
         ImGui::Text("Scale");
         float scale_val = (float)g_camera_controller.scale;
         if (ImGui::SliderFloat("##scale", &scale_val, 0.1f, 10.0f)) {
@@ -199,6 +400,13 @@ void run_with_imgui() {
         const char* charset_names[] = {"Simple", "Detailed"};
         ImGui::Combo("##charset", &g_renderer.charset_type, charset_names, 2);
         
+        ImGui::Text("Glyphs");
+        const char* glyph_mode_names[] = {"Charset", "Shapes (2x4)", "Braille (2x4)", "Blocks (2x2)"};
+        int glyph_mode = static_cast<int>(g_renderer.glyph_mode);
+        if (ImGui::Combo("##glyphs", &glyph_mode, glyph_mode_names, IM_ARRAYSIZE(glyph_mode_names))) {
+            g_renderer.glyph_mode = static_cast<GlyphMode>(glyph_mode);
+        }
+        
         ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
         
         ImGui::TextColored(ImVec4(1, 0.5, 0, 1), "Lighting");
@@ -223,6 +431,8 @@ void run_with_imgui() {
             g_renderer.ambient_strength = ambient;
         }
         
+        ImGui::Checkbox("Shadows", &g_renderer.shadows);
+        
         ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
         
         ImGui::Checkbox("Auto Rotate", &g_camera_controller.auto_rotate);
@@ -235,9 +445,32 @@ void run_with_imgui() {
             g_camera_controller.auto_rotate = true;
         }
         
+        if (TRACE_ZONES_ENABLED) {
+            ImGui::Spacing(); ImGui::Separator(); ImGui::Spacing();
+            
+            ImGui::TextColored(ImVec4(0.5, 0.8, 1, 1), "Trace");
+            bool recording = trace_recording();
+            if (ImGui::Checkbox("Record Zones", &recording)) {
+                set_trace_recording(recording);
+            }
+            ImGui::Text("Events: %zu", trace_event_count());
+            static char trace_path[256] = "trace.json";
+            ImGui::InputText("##trace_path", trace_path, IM_ARRAYSIZE(trace_path));
+            if (ImGui::Button("Save Trace", ImVec2(-1, 0))) {
+                if (write_chrome_trace(trace_path)) {
+                    std::cout << "Trace written to " << trace_path << std::endl;
+                } else {
+                    std::cerr << "Failed to write " << trace_path << std::endl;
+                }
+            }
+        }
+        
         ImGui::End();
         
         ImGui::Render();
+        TRACE_ZONE_END(imgui_zone);
+        
+        TRACE_ZONE("present");
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
@@ -258,6 +491,7 @@ void run_with_imgui() {
 #endif
 
 int main(int argc, char* argv[]) {
+    TRACE_THREAD_NAME("main");
     if (argc > 1) {
         strncpy(g_model_path_buffer, argv[1], sizeof(g_model_path_buffer) - 1);
     } 
@@ -265,7 +499,7 @@ int main(int argc, char* argv[]) {
     #ifdef USE_IMGUI
         run_with_imgui();
     #else
-        std::cerr << "Please compile with -DUSE_IMGUI=ON" << std::endl;
+        std::cerr << "Please compile with -DUSE_IMGUI=ON, or run ascii_terminal for the headless front-end" << std::endl;
         return 1;
     #endif
     
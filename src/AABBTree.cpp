@@ -1,22 +1,28 @@
 #include "AABBTree.h"
 #include "insert_box_into_box.h"
+#include "sah_binned_split.h"
+#include "TraceZones.h"
 #include <algorithm>
 
-AABBTree::AABBTree(
+template <typename Scalar>
+AABBTreeT<Scalar>::AABBTreeT(
   const std::vector<std::shared_ptr<Object> > & objects,
-  int a_depth)
+  int a_depth,
+  const BVHBuildOptions & options)
 : depth(a_depth),
 num_leaves(objects.size())
 {
-  this->box.min_corner = Eigen::RowVector3d(
-      std::numeric_limits<double>::infinity(),
-      std::numeric_limits<double>::infinity(),
-      std::numeric_limits<double>::infinity()
+  // The whole build as one zone (children are built recursively)
+  TRACE_ZONE_IF("AABBTree build", a_depth == 0);
+  this->box.min_corner = RowVector3(
+      std::numeric_limits<Scalar>::infinity(),
+      std::numeric_limits<Scalar>::infinity(),
+      std::numeric_limits<Scalar>::infinity()
   );
-  this->box.max_corner = Eigen::RowVector3d(
-      -std::numeric_limits<double>::infinity(),
-      -std::numeric_limits<double>::infinity(),
-      -std::numeric_limits<double>::infinity()
+  this->box.max_corner = RowVector3(
+      -std::numeric_limits<Scalar>::infinity(),
+      -std::numeric_limits<Scalar>::infinity(),
+      -std::numeric_limits<Scalar>::infinity()
   );
   
   for (const auto & obj : objects) {
@@ -29,31 +35,57 @@ num_leaves(objects.size())
       return;
   }
 
-  Eigen::RowVector3d diag = this->box.max_corner - this->box.min_corner;
   int axis;
-  diag.maxCoeff(&axis);
+  double mid;
+  bool can_split = true;
 
-  double mid = this->box.center()[axis];
+  const bool sah = options.method != BVHSplitMethod::MIDPOINT;
+  if (sah) {
+      std::vector<BoundingBoxT<Scalar> > boxes;
+      boxes.reserve(objects.size());
+      for (const auto & obj : objects) {
+          boxes.push_back(obj->box);
+      }
+
+      double cost;
+      can_split = sah_binned_split(
+        boxes, options.num_bins, options.traversal_cost, 1, axis, mid, cost);
+
+      // Keep everything in this node if splitting is not expected to pay off
+      if ((int)objects.size() <= options.max_leaf_size &&
+          (!can_split || cost >= objects.size())) {
+          leaf_objects = objects;
+          return;
+      }
+  } else {
+      RowVector3 diag = this->box.max_corner - this->box.min_corner;
+      diag.maxCoeff(&axis);
+      mid = this->box.center()[axis];
+  }
 
   std::vector<std::shared_ptr<Object>> left_objs;
   std::vector<std::shared_ptr<Object>> right_objs;
 
-  for (const auto & obj : objects) {
-      double center = obj->box.center()[axis];
-      if (center <= mid)
-          left_objs.push_back(obj);
-      else
-          right_objs.push_back(obj);
+  if (can_split) {
+      for (const auto & obj : objects) {
+          double center = obj->box.center()[axis];
+          bool goes_left = sah ? center < mid : center <= mid;
+          if (goes_left)
+              left_objs.push_back(obj);
+          else
+              right_objs.push_back(obj);
+      }
   }
 
-  if (left_objs.empty()) {
-      left_objs.assign(objects.begin(), objects.begin() + objects.size() / 2);
-      right_objs.assign(objects.begin() + objects.size() / 2, objects.end());
-  } else if (right_objs.empty()) {
+  if (left_objs.empty() || right_objs.empty()) {
       left_objs.assign(objects.begin(), objects.begin() + objects.size() / 2);
       right_objs.assign(objects.begin() + objects.size() / 2, objects.end());
   }
 
-  left  = std::make_shared<AABBTree>(left_objs,  depth + 1);
-  right = std::make_shared<AABBTree>(right_objs, depth + 1);
-}
\ No newline at end of file
+  left  = std::make_shared<AABBTreeT>(left_objs,  depth + 1, options);
+  right = std::make_shared<AABBTreeT>(right_objs, depth + 1, options);
+}
+
+// Explicit template instantiations
+template struct AABBTreeT<double>;
+template struct AABBTreeT<float>;
@@ -0,0 +1,70 @@
+#include "AABBTree.h"
+#include "point_box_squared_distance.h"
+#include <queue>
+#include <utility>
+#include <vector>
+
+template <typename Scalar>
+bool AABBTreeT<Scalar>::point_squared_distance(
+    const RowVector3 & query,
+    const Scalar min_sqrd,
+    const Scalar max_sqrd,
+    Scalar & sqrd,
+    std::shared_ptr<Object> & descendant) const
+{
+  // Lower bound of the squared distance to an object (its box) and the
+  // pointer owning it in its parent
+  using Entry = std::pair<Scalar, const std::shared_ptr<Object> *>;
+  auto farther = [](const Entry & a, const Entry & b) { return a.first > b.first; };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(farther)> queue(farther);
+
+  bool found = false;
+  Scalar closest = max_sqrd;
+  // Queue the children of a subtree that may hold something closer
+  auto expand = [&](const AABBTreeT & tree) {
+    auto push = [&](const std::shared_ptr<Object> & obj) {
+      if (!obj)
+        return;
+      const Scalar d = point_box_squared_distance<Scalar>(query, obj->box);
+      if (d <= closest)
+        queue.emplace(d, &obj);
+    };
+    for (const auto & obj : tree.leaf_objects)
+      push(obj);
+    push(tree.left);
+    push(tree.right);
+  };
+
+  if (point_box_squared_distance<Scalar>(query, box) > closest)
+    return false;
+  expand(*this);
+  while (!queue.empty()) {
+    const Entry entry = queue.top();
+    queue.pop();
+    if (entry.first > closest)
+      break;
+    const std::shared_ptr<Object> & obj = *entry.second;
+    if (const auto * subtree = dynamic_cast<const AABBTreeT *>(obj.get())) {
+      expand(*subtree);
+      continue;
+    }
+    Scalar d;
+    std::shared_ptr<Object> obj_descendant;
+    if (obj->point_squared_distance(query, min_sqrd, closest, d, obj_descendant)) {
+      found = true;
+      closest = d;
+      descendant = obj_descendant ? obj_descendant : obj;
+    }
+  }
+  if (found)
+    sqrd = closest;
+  return found;
+}
+
+// Explicit template instantiations
+template bool AABBTreeT<double>::point_squared_distance(
+  const Eigen::RowVector3d &, const double, const double, double &,
+  std::shared_ptr<Object> &) const;
+template bool AABBTreeT<float>::point_squared_distance(
+  const Eigen::RowVector3f &, const float, const float, float &,
+  std::shared_ptr<Objectf> &) const;
@@ -1,37 +1,62 @@
 #include "AABBTree.h"
+#include "TraversalStats.h"
 
-bool AABBTree::ray_intersect(
-    const Ray& ray,
-    const double min_t,
-    const double max_t,
-    double & t,
-    std::shared_ptr<Object> & descendant) const
+namespace
+{
+  // Shared by the plain and prepared-ray queries; RayType selects the box
+  // and child tests
+  template <typename Scalar, typename RayType>
+  bool intersect_subtree(
+    const AABBTreeT<Scalar> & tree,
+    const RayType & ray,
+    const Scalar min_t,
+    const Scalar max_t,
+    Scalar & t,
+    std::shared_ptr<ObjectT<Scalar> > & descendant)
   {
-    if (!ray_intersect_box(ray, this->box, min_t, max_t))
+    TRAVERSAL_STATS_ADD(nodes_visited, 1);
+    if (!ray_intersect_box(ray, tree.box, min_t, max_t))
         return false;
   
-    if (left && !right)
+    if (!tree.leaf_objects.empty())
+    {
+        bool hit = false;
+        Scalar closest = max_t;
+        for (const auto & obj : tree.leaf_objects) {
+            Scalar t_obj;
+            std::shared_ptr<ObjectT<Scalar> > obj_descendant;
+            if (obj->ray_intersect(ray, min_t, closest, t_obj, obj_descendant)) {
+                hit = true;
+                closest = t_obj;
+                t = t_obj;
+                descendant = obj_descendant ? obj_descendant : obj;
+            }
+        }
+        return hit;
+    }
+  
+    if (tree.left && !tree.right)
     {
-        bool hit = left->ray_intersect(ray, min_t, max_t, t, descendant);
+        bool hit = tree.left->ray_intersect(ray, min_t, max_t, t, descendant);
         if (hit && !descendant) {
-            descendant = left;
+            descendant = tree.left;
         }
         return hit;
     }
   
-    if (!left && !right)
+    if (!tree.left && !tree.right)
         return false;
   
     bool hit_left  = false, hit_right = false;
-    double t_left  = std::numeric_limits<double>::infinity();
-    double t_right = std::numeric_limits<double>::infinity();
-    std::shared_ptr<Object> obj_left, obj_right;
+    Scalar t_left  = std::numeric_limits<Scalar>::infinity();
+    Scalar t_right = std::numeric_limits<Scalar>::infinity();
+    std::shared_ptr<ObjectT<Scalar> > obj_left, obj_right;
   
-    if (left)
-        hit_left = left->ray_intersect(ray, min_t, max_t, t_left, obj_left);
+    if (tree.left)
+        hit_left = tree.left->ray_intersect(ray, min_t, max_t, t_left, obj_left);
   
-    if (right)
-        hit_right = right->ray_intersect(ray, min_t, max_t, t_right, obj_right);
+    if (tree.right)
+        hit_right = tree.right->ray_intersect(ray, min_t, max_t, t_right, obj_right);
   
     if (hit_left && hit_right)
     {
@@ -59,4 +84,85 @@ bool AABBTree::ray_intersect(
     }
   
     return false;
-  }
\ No newline at end of file
+  }
+
+  template <typename Scalar, typename RayType>
+  bool occluded_subtree(
+    const AABBTreeT<Scalar> & tree,
+    const RayType & ray,
+    const Scalar min_t,
+    const Scalar max_t)
+  {
+    TRAVERSAL_STATS_ADD(nodes_visited, 1);
+    if (!ray_intersect_box(ray, tree.box, min_t, max_t))
+        return false;
+    for (const auto & obj : tree.leaf_objects) {
+        if (obj->ray_occluded(ray, min_t, max_t))
+            return true;
+    }
+    return (tree.left && tree.left->ray_occluded(ray, min_t, max_t)) ||
+           (tree.right && tree.right->ray_occluded(ray, min_t, max_t));
+  }
+}
+
+template <typename Scalar>
+bool AABBTreeT<Scalar>::ray_intersect(
+    const Ray& ray,
+    const Scalar min_t,
+    const Scalar max_t,
+    Scalar & t,
+    std::shared_ptr<Object> & descendant) const
+{
+  return intersect_subtree(*this, ray, min_t, max_t, t, descendant);
+}
+
+template <typename Scalar>
+bool AABBTreeT<Scalar>::ray_intersect(
+    const PreparedRayT<Scalar> & ray,
+    const Scalar min_t,
+    const Scalar max_t,
+    Scalar & t,
+    std::shared_ptr<Object> & descendant) const
+{
+  return intersect_subtree(*this, ray, min_t, max_t, t, descendant);
+}
+
+template <typename Scalar>
+bool AABBTreeT<Scalar>::ray_occluded(
+    const Ray & ray,
+    const Scalar min_t,
+    const Scalar max_t) const
+{
+  return occluded_subtree(*this, ray, min_t, max_t);
+}
+
+template <typename Scalar>
+bool AABBTreeT<Scalar>::ray_occluded(
+    const PreparedRayT<Scalar> & ray,
+    const Scalar min_t,
+    const Scalar max_t) const
+{
+  return occluded_subtree(*this, ray, min_t, max_t);
+}
+
+// Explicit template instantiations
+template bool AABBTreeT<double>::ray_intersect(
+  const Ray &, const double, const double, double &,
+  std::shared_ptr<Object> &) const;
+template bool AABBTreeT<float>::ray_intersect(
+  const Rayf &, const float, const float, float &,
+  std::shared_ptr<Objectf> &) const;
+template bool AABBTreeT<double>::ray_intersect(
+  const PreparedRay &, const double, const double, double &,
+  std::shared_ptr<Object> &) const;
+template bool AABBTreeT<float>::ray_intersect(
+  const PreparedRayf &, const float, const float, float &,
+  std::shared_ptr<Objectf> &) const;
+template bool AABBTreeT<double>::ray_occluded(
+  const Ray &, const double, const double) const;
+template bool AABBTreeT<float>::ray_occluded(
+  const Rayf &, const float, const float) const;
+template bool AABBTreeT<double>::ray_occluded(
+  const PreparedRay &, const double, const double) const;
+template bool AABBTreeT<float>::ray_occluded(
+  const PreparedRayf &, const float, const float) const;
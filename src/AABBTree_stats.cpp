@@ -0,0 +1,54 @@
+#include "AABBTree.h"
+#include <algorithm>
+
+namespace
+{
+  // Accumulate stats of the subtree rooted at `node` with SAH areas left
+  // unnormalized.
+  template <typename Scalar>
+  void accumulate_stats(
+    const AABBTreeT<Scalar> & node,
+    const double traversal_cost,
+    BVHStats & stats)
+  {
+    stats.num_nodes++;
+    stats.max_depth = std::max(stats.max_depth, node.depth);
+    const double area = node.box.surface_area();
+
+    // Children that are not AABBTrees are objects held directly by this node
+    int num_objects = node.leaf_objects.size();
+    bool has_subtrees = false;
+    for (const auto & child : {node.left, node.right}) {
+      if (!child)
+        continue;
+      if (const auto subtree = std::dynamic_pointer_cast<AABBTreeT<Scalar> >(child)) {
+        has_subtrees = true;
+        accumulate_stats(*subtree, traversal_cost, stats);
+      } else {
+        num_objects++;
+      }
+    }
+
+    if (has_subtrees)
+      stats.sah_cost += traversal_cost * area;
+    if (num_objects > 0) {
+      stats.sah_cost += num_objects * area;
+      if (!has_subtrees)
+        stats.num_leaf_nodes++;
+    }
+  }
+}
+
+template <typename Scalar>
+BVHStats AABBTreeT<Scalar>::stats(const double traversal_cost) const
+{
+  BVHStats stats;
+  accumulate_stats(*this, traversal_cost, stats);
+  const double root_area = box.surface_area();
+  stats.sah_cost = root_area > 0 ? stats.sah_cost / root_area : 0.0;
+  return stats;
+}
+
+// Explicit template instantiations
+template BVHStats AABBTreeT<double>::stats(const double) const;
+template BVHStats AABBTreeT<float>::stats(const double) const;
@@ -1,46 +1,674 @@
 #include "ASCIIRenderer.h"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 
+namespace {
+    // The normal flipped, if needed, to point back towards the viewer: the
+    // visible side is lit even on meshes wound inside out
+    Eigen::Vector3d facing_normal(const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir) {
+        return normal.dot(view_dir) > 0.0 ? Eigen::Vector3d(-normal) : normal;
+    }
+    
+    // Index in `charset` of the character for `brightness`
+    int charset_index(double brightness, const std::string& charset) {
+        int index = static_cast<int>(brightness * (charset.length() - 1));
+        return std::clamp(index, 0, static_cast<int>(charset.length() - 1));
+    }
+    
+    int popcount(unsigned mask) {
+#if defined(_MSC_VER)
+        return static_cast<int>(__popcnt(mask));
+#else
+        return __builtin_popcount(mask);
+#endif
+    }
+    
+    // Mask of a 2x4 cell drawn as four rows of two characters, top to
+    // bottom, '#' marking the samples covered (bit row * 2 + column)
+    constexpr unsigned cell_mask(const char* rows) {
+        unsigned mask = 0;
+        for (int k = 0; k < 8; k++) {
+            if (rows[k] == '#') mask |= 1u << k;
+        }
+        return mask;
+    }
+    
+    // ASCII glyphs by the part of a 2x4 cell they suggest is covered, for
+    // cells on a silhouette. A glyph may appear with several masks.
+    struct ShapeGlyph {
+        unsigned mask;
+        char glyph;
+    };
+    constexpr ShapeGlyph SHAPE_GLYPHS[] = {
+        {cell_mask("#......."), '`'},
+        {cell_mask(".#......"), '\''},
+        {cell_mask("##......"), '"'},
+        {cell_mask("####...."), '"'},
+        {cell_mask("..##...."), '-'},
+        {cell_mask("....##.."), '-'},
+        {cell_mask("..####.."), '='},
+        {cell_mask("......##"), '_'},
+        {cell_mask("......#."), '.'},
+        {cell_mask(".......#"), ','},
+        {cell_mask("....####"), 'o'},
+        {cell_mask("#.#.#.#."), '['},
+        {cell_mask(".#.#.#.#"), ']'},
+        // Cells split along a diagonal
+        {cell_mask("##.#.#.."), '\\'},
+        {cell_mask("..#.#.##"), '\\'},
+        {cell_mask("###.#..."), '/'},
+        {cell_mask("...#.###"), '/'},
+    };
+    
+    // Shape glyph closest to `coverage` (fewest samples differing)
+    char shape_glyph(unsigned coverage) {
+        char best = ' ';
+        int best_distance = 9;
+        for (const ShapeGlyph& shape : SHAPE_GLYPHS) {
+            const int distance = popcount(coverage ^ shape.mask);
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = shape.glyph;
+            }
+        }
+        return best;
+    }
+    
+    // Ordered dithering thresholds of the samples of a 2x4 cell (Braille
+    // dots) and of a 2x2 cell (quadrant blocks), row-major
+    constexpr double DITHER_2X4[8] = {
+        0.5 / 8, 4.5 / 8,
+        6.5 / 8, 2.5 / 8,
+        1.5 / 8, 5.5 / 8,
+        7.5 / 8, 3.5 / 8};
+    constexpr double DITHER_2X2[4] = {
+        0.5 / 4, 2.5 / 4,
+        3.5 / 4, 1.5 / 4};
+    
+    // Braille dot bit of each sample of a 2x4 cell (dots 1-3 and 7 on the
+    // left, 4-6 and 8 on the right)
+    constexpr int BRAILLE_BITS[8] = {0, 3, 1, 4, 2, 5, 6, 7};
+    
+    // Block element for each mask of lit quadrants (1 top left, 2 top
+    // right, 4 bottom left, 8 bottom right)
+    constexpr char32_t QUADRANT_BLOCKS[16] = {
+        U' ', U'\u2598', U'\u259D', U'\u2580', U'\u2596', U'\u258C', U'\u259E', U'\u259B',
+        U'\u2597', U'\u259A', U'\u2590', U'\u259C', U'\u2584', U'\u2599', U'\u259F', U'\u2588'};
+    
+    void append_utf8(std::string& output, char32_t c) {
+        if (c < 0x80) {
+            output += static_cast<char>(c);
+        } else if (c < 0x800) {
+            output += static_cast<char>(0xC0 | (c >> 6));
+            output += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            output += static_cast<char>(0xE0 | (c >> 12));
+            output += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            output += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+}
+
 std::string ASCIIRenderer::render(const Scene& scene, const Camera& camera) {
     std::string output;
+    render(scene, camera, output);
+    return output;
+}
+
+void ASCIIRenderer::render(const Scene& scene, const Camera& camera, std::string& output) {
+    TRACE_ZONE("ASCIIRenderer::render");
+    using clock = std::chrono::steady_clock;
+    auto seconds_since = [](clock::time_point start) {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+    last_timings = RenderTimings();
     
     int grid_width, grid_height;
     get_grid_size(grid_width, grid_height);
+    int sample_width, sample_height;
+    get_sample_grid_size(sample_width, sample_height);
+    
+    TraceState trace_state;
+    trace_state.scene = &scene;
+    trace_state.scene_version = scene.version;
+    trace_state.camera = camera;
+    trace_state.width = sample_width;
+    trace_state.height = sample_height;
+    trace_state.use_prepared_rays = use_prepared_rays;
+    trace_state.packet_size = packet_size;
+    trace_state.adaptive_step = adaptive_step;
+    trace_state.adaptive_tolerance = adaptive_tolerance;
+    trace_state.adaptive_refine_primitives = adaptive_refine_primitives;
+    // Adaptive sampling settles shadows while tracing (interpolated hit
+    // points are not on the surface and must not cast shadow rays)
+    const bool trace_shadows = adaptive() && shadows;
+    trace_state.shadow_direction = trace_shadows ? light.direction : Eigen::Vector3d::Zero();
     
-    const std::string& charset = charsets[charset_type];
+    ShadeState shade_state;
+    shade_state.light = light;
+    shade_state.ambient_strength = ambient_strength;
+    shade_state.charset = charsets[charset_type];
+    shade_state.glyph_mode = glyph_mode;
+    shade_state.shadows = shadows;
+    shade_state.heatmap = heatmap;
+    shade_state.heatmap_max_cost = heatmap_max_cost;
+    
+    if (!frame_valid || !(trace_state == traced)) {
+        last_invalidation = FrameInvalidation::RETRACE;
+    } else if (!(shade_state == shaded)) {
+        last_invalidation = FrameInvalidation::RESHADE;
+    } else {
+        last_invalidation = FrameInvalidation::NONE;
+        primary_rays_traced = 0;
+        shadow_rays_traced = 0;
+        last_traversal_stats = TraversalStats();
+        TRACE_ZONE("copy cached frame");
+        const auto start = clock::now();
+        output = frame;
+        last_timings.assembly_seconds = seconds_since(start);
+        return;
+    }
+    
+    // Small against the scene, large against float rounding of hit points
+    shadow_bias = 0.0;
+    if (shadows && !scene.bvh.empty()) {
+        const BoundingBox box = scene.bvh.box();
+        shadow_bias = 1e-4 * (box.max_corner - box.min_corner).norm();
+    }
+    
+    RayCount rays;
+    auto start = clock::now();
+    if (last_invalidation == FrameInvalidation::RETRACE) {
+        TRACE_ZONE("trace");
+        gbuffer.assign(sample_width * sample_height, GBufferCell());
+        if (adaptive()) {
+            // Samples first: blocks read the samples of their neighbours
+            rays = for_each_tile("trace samples", sample_width, sample_height,
+                [&](int row, int col, int rows, int cols) {
+                    return trace_samples(scene, camera, row, col, rows, cols);
+                });
+            rays += for_each_tile("refine tile", sample_width, sample_height,
+                [&](int row, int col, int rows, int cols) {
+                    return refine_tile(scene, camera, row, col, rows, cols, shade_state.charset);
+                });
+        } else {
+            rays = for_each_tile("trace tile", sample_width, sample_height,
+                [&](int row, int col, int rows, int cols) {
+                    render_tile(scene, camera, row, col, rows, cols);
+                    return RayCount{rows * cols, 0, {}};
+                });
+        }
+    }
+    
+    last_timings.trace_seconds = seconds_since(start);
+    
+    start = clock::now();
+    TRACE_ZONE_NAMED(shade_zone, "shade");
+    glyphs.resize(grid_width * grid_height);
+    if (heatmap) {
+        uint32_t max_cost = 1;
+        for (const GBufferCell& cell : gbuffer) max_cost = std::max(max_cost, cell.cost);
+        heatmap_scale = heatmap_max_cost > 0 ? heatmap_max_cost : max_cost;
+    }
     
-    output.reserve(grid_height * (grid_width + 1));
+    // The heatmap leaves shadows unsettled; they are cast when it is turned off
+    const bool cast_shadows = !trace_shadows && !heatmap &&
+        (last_invalidation == FrameInvalidation::RETRACE || heatmap != shaded.heatmap ||
+         shadows != shaded.shadows || light.direction != shaded.light.direction);
     
+    rays += for_each_tile("shade tile", grid_width, grid_height, [&](int row, int col, int rows, int cols) {
+        return RayCount{0, shade_tile(scene, camera, row, col, rows, cols, cast_shadows,
+                                      shade_state.charset, glyphs), {}};
+    });
+    last_timings.shade_seconds = seconds_since(start);
+    TRACE_ZONE_END(shade_zone);
+    
+    TRACE_ZONE("assemble");
+    start = clock::now();
+    frame.clear();
     for (int row = 0; row < grid_height; row++) {
         for (int col = 0; col < grid_width; col++) {
+            append_utf8(frame, glyphs[row * grid_width + col]);
+        }
+        frame += '\n';
+    }
+    primary_rays_traced = rays.primary;
+    shadow_rays_traced = rays.shadow;
+    last_traversal_stats = rays.traversal;
+    
+    traced = trace_state;
+    shaded = shade_state;
+    frame_valid = true;
+    output = frame;
+    last_timings.assembly_seconds = seconds_since(start);
+}
+
+void ASCIIRenderer::invalidate() {
+    frame_valid = false;
+}
+
+bool ASCIIRenderer::adaptive() const {
+    // Blocks of samples must not straddle render tiles, and their cells must
+    // fit refine_tile's buffer
+    return adaptive_step > 1 && adaptive_step <= MAX_ADAPTIVE_STEP &&
+           TILE_WIDTH % adaptive_step == 0 && TILE_HEIGHT % adaptive_step == 0;
+}
+
+bool ASCIIRenderer::TraceState::operator==(const TraceState& other) const {
+    const Camera& a = camera;
+    const Camera& b = other.camera;
+    return scene == other.scene && scene_version == other.scene_version &&
+           a.e == b.e && a.u == b.u && a.v == b.v && a.w == b.w &&
+           a.d == b.d && a.width == b.width && a.height == b.height &&
+           width == other.width && height == other.height &&
+           use_prepared_rays == other.use_prepared_rays && packet_size == other.packet_size &&
+           adaptive_step == other.adaptive_step && adaptive_tolerance == other.adaptive_tolerance &&
+           adaptive_refine_primitives == other.adaptive_refine_primitives &&
+           shadow_direction == other.shadow_direction;
+}
+
+bool ASCIIRenderer::ShadeState::operator==(const ShadeState& other) const {
+    return light.direction == other.light.direction && light.intensity == other.light.intensity &&
+           ambient_strength == other.ambient_strength && charset == other.charset &&
+           glyph_mode == other.glyph_mode && shadows == other.shadows &&
+           heatmap == other.heatmap && heatmap_max_cost == other.heatmap_max_cost;
+}
+
+template <typename Fn>
+ASCIIRenderer::RayCount ASCIIRenderer::for_each_tile(const char* zone, int grid_width, int grid_height,
+                                                     const Fn& fn) {
+    const int tiles_x = (grid_width + TILE_WIDTH - 1) / TILE_WIDTH;
+    const int tiles_y = (grid_height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    std::vector<RayCount> counts(tiles_x * tiles_y);
+    
+    ThreadPool& pool = get_thread_pool();
+    TaskGroup group(pool);
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            const int row = ty * TILE_HEIGHT;
+            const int col = tx * TILE_WIDTH;
+            const int rows = std::min(TILE_HEIGHT, grid_height - row);
+            const int cols = std::min(TILE_WIDTH, grid_width - col);
+            RayCount& count = counts[ty * tiles_x + tx];
+            group.run([zone, &fn, &count, row, col, rows, cols] {
+                TRACE_ZONE(zone);
+                TraversalStats before;
+                if (TRAVERSAL_STATS_ENABLED) before = thread_traversal_stats();
+                count = fn(row, col, rows, cols);
+                if (TRAVERSAL_STATS_ENABLED) count.traversal = thread_traversal_stats() - before;
+            });
+        }
+    }
+    group.wait();
+    
+    RayCount total;
+    for (const RayCount& count : counts) {
+        total += count;
+    }
+    return total;
+}
+
+void ASCIIRenderer::render_tile(const Scene& scene, const Camera& camera, int row, int col,
+                                int rows, int cols) {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
+    
+    if (packet_size > 1) {
+        // 2x2, 4x2 or 4x4 cells
+        const int tile_width = packet_size <= 4 ? 2 : 4;
+        const int tile_height = std::max(1, std::min(packet_size, RAY_PACKET_MAX_SIZE) / tile_width);
+        for (int i = row; i < row + rows; i += tile_height) {
+            for (int j = col; j < col + cols; j += tile_width) {
+                trace_tile(scene, camera, i, j,
+                    std::min(tile_height, row + rows - i),
+                    std::min(tile_width, col + cols - j));
+            }
+        }
+        return;
+    }
+    
+    for (int i = row; i < row + rows; i++) {
+        for (int j = col; j < col + cols; j++) {
             Ray ray;
-            viewing_ray(camera, row, col, grid_width, grid_height, ray);
+            viewing_ray(camera, i, j, grid_width, grid_height, ray);
             
-            char c = trace_ray(scene, ray, charset);
-            output += c;
+            trace_ray(scene, ray, gbuffer[i * grid_width + j]);
         }
-        output += '\n';
     }
+}
+
+void ASCIIRenderer::trace_tile(const Scene& scene, const Camera& camera, int row, int col,
+                               int rows, int cols) {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
     
-    return output;
+    int cells[RAY_PACKET_MAX_SIZE];
+    int n = 0;
+    for (int i = row; i < row + rows; i++) {
+        for (int j = col; j < col + cols; j++) {
+            cells[n++] = i * grid_width + j;
+        }
+    }
+    trace_packet(scene, camera, cells, n);
+}
+
+void ASCIIRenderer::trace_packet(const Scene& scene, const Camera& camera, const int* cells, int n) {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
+    
+    Ray rays[RAY_PACKET_MAX_SIZE];
+    for (int k = 0; k < n; k++) {
+        viewing_ray(camera, cells[k] / grid_width, cells[k] % grid_width,
+                    grid_width, grid_height, rays[k]);
+    }
+    
+    HitRecord hits[RAY_PACKET_MAX_SIZE];
+    TraversalStats before;
+    if (TRAVERSAL_STATS_ENABLED) before = thread_traversal_stats();
+    const unsigned hit = scene.intersect_packet(
+        RayPacket(rays, n), VIEWING_RAY_MIN_T, std::numeric_limits<double>::infinity(), hits);
+    uint32_t cost = 0;
+    if (TRAVERSAL_STATS_ENABLED) cost = (thread_traversal_stats() - before).cost() / n;
+    
+    for (int k = 0; k < n; k++) {
+        GBufferCell& cell = gbuffer[cells[k]];
+        cell = GBufferCell();
+        cell.cost = cost;
+        if (hit & (1u << k)) {
+            cell.hit = true;
+            cell.depth = hits[k].t;
+            cell.normal = scene.shading_normal(hits[k]);
+            cell.primitive = hits[k].primitive;
+        }
+    }
+}
+
+void ASCIIRenderer::trace_cells(const Scene& scene, const Camera& camera, const int* cells, int n) {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
+    
+    if (packet_size > 1) {
+        const int size = std::min(packet_size, RAY_PACKET_MAX_SIZE);
+        for (int k = 0; k < n; k += size) {
+            trace_packet(scene, camera, cells + k, std::min(size, n - k));
+        }
+        return;
+    }
+    for (int k = 0; k < n; k++) {
+        Ray ray;
+        viewing_ray(camera, cells[k] / grid_width, cells[k] % grid_width,
+                    grid_width, grid_height, ray);
+        trace_ray(scene, ray, gbuffer[cells[k]]);
+    }
+}
+
+bool ASCIIRenderer::is_sample(int i, int j) const {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
+    return (i % adaptive_step == 0 || i == grid_height - 1) &&
+           (j % adaptive_step == 0 || j == grid_width - 1);
 }
 
-char ASCIIRenderer::trace_ray(const Scene& scene, const Ray& ray, const std::string& charset) {
-    double t;
-    Eigen::Vector3d n;
-    std::shared_ptr<Object> hit_obj;
+ASCIIRenderer::RayCount ASCIIRenderer::trace_samples(const Scene& scene, const Camera& camera,
+                                                     int row, int col, int rows, int cols) {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
     
-    if (scene.intersect(ray, 0.01, std::numeric_limits<double>::infinity(), t, n, hit_obj)) {
-        double brightness = calculate_brightness(n, ray.direction);
-        return brightness_to_char(brightness, charset);
+    // Sample rows and columns of the tile: every adaptive_step-th one, plus
+    // the last of the grid so every block has samples on all its corners
+    std::vector<int> sample_rows, sample_cols;
+    for (int i = row; i < row + rows; i++) {
+        if (is_sample(i, 0)) sample_rows.push_back(i);
+    }
+    for (int j = col; j < col + cols; j++) {
+        if (is_sample(0, j)) sample_cols.push_back(j);
     }
     
+    // Packets of neighbouring samples (4x4 at most, as for full frames)
+    const int tile_width = packet_size <= 4 ? 2 : 4;
+    const int tile_height = std::max(1, std::min(packet_size, RAY_PACKET_MAX_SIZE) / tile_width);
+    RayCount count;
+    int cells[RAY_PACKET_MAX_SIZE];
+    for (size_t a = 0; a < sample_rows.size(); a += tile_height) {
+        for (size_t b = 0; b < sample_cols.size(); b += tile_width) {
+            int n = 0;
+            for (size_t y = a; y < std::min(a + tile_height, sample_rows.size()); y++) {
+                for (size_t x = b; x < std::min(b + tile_width, sample_cols.size()); x++) {
+                    cells[n++] = sample_rows[y] * grid_width + sample_cols[x];
+                }
+            }
+            trace_cells(scene, camera, cells, n);
+            count.primary += n;
+            count.shadow += update_shadows(scene, camera, cells, n);
+        }
+    }
+    return count;
+}
+
+ASCIIRenderer::RayCount ASCIIRenderer::refine_tile(const Scene& scene, const Camera& camera,
+                                                   int row, int col, int rows, int cols,
+                                                   const std::string& charset) {
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
+    const int step = adaptive_step;
+    
+    RayCount count;
+    // Tiles start on sample rows and columns, so blocks never straddle them
+    for (int r = row; r < row + rows; r += step) {
+        const int r_end = std::min(r + step, grid_height);
+        const int r2 = std::min(r + step, grid_height - 1);
+        for (int c = col; c < col + cols; c += step) {
+            const int c_end = std::min(c + step, grid_width);
+            const int c2 = std::min(c + step, grid_width - 1);
+            
+            // Samples on the corners of the block, with their normals facing
+            // the viewer so mixed windings do not cancel out
+            const int corner_i[4] = {r, r, r2, r2};
+            const int corner_j[4] = {c, c2, c, c2};
+            const GBufferCell* corner[4];
+            Eigen::Vector3d normal[4];
+            int num_hits = 0;
+            int min_level = static_cast<int>(charset.length()), max_level = -1;
+            bool refine = false;
+            for (int k = 0; k < 4; k++) {
+                corner[k] = &gbuffer[corner_i[k] * grid_width + corner_j[k]];
+                if (!corner[k]->hit) continue;
+                num_hits++;
+                Ray ray;
+                viewing_ray(camera, corner_i[k], corner_j[k], grid_width, grid_height, ray);
+                normal[k] = facing_normal(corner[k]->normal, ray.direction);
+                const int level = charset_index(
+                    calculate_brightness(normal[k], ray.direction, corner[k]->shadowed), charset);
+                min_level = std::min(min_level, level);
+                max_level = std::max(max_level, level);
+                refine = refine || corner[k]->shadowed != corner[0]->shadowed ||
+                    (adaptive_refine_primitives && corner[k]->primitive != corner[0]->primitive);
+            }
+            refine = refine || (num_hits > 0 && num_hits < 4) ||
+                max_level - min_level > adaptive_tolerance;
+            
+            if (refine) {
+                // trace_cells splits the block's cells into packets
+                int cells[MAX_ADAPTIVE_STEP * MAX_ADAPTIVE_STEP];
+                int n = 0;
+                for (int i = r; i < r_end; i++) {
+                    for (int j = c; j < c_end; j++) {
+                        if (!is_sample(i, j)) cells[n++] = i * grid_width + j;
+                    }
+                }
+                trace_cells(scene, camera, cells, n);
+                count.primary += n;
+                count.shadow += update_shadows(scene, camera, cells, n);
+                continue;
+            }
+            
+            // Bilinear interpolation of the samples (all hit or all missed)
+            for (int i = r; i < r_end; i++) {
+                const double v = r2 > r ? double(i - r) / (r2 - r) : 0.0;
+                for (int j = c; j < c_end; j++) {
+                    if (is_sample(i, j)) continue;
+                    GBufferCell& cell = gbuffer[i * grid_width + j];
+                    cell = GBufferCell();
+                    if (num_hits == 0) continue;
+                    const double u = c2 > c ? double(j - c) / (c2 - c) : 0.0;
+                    const double w[4] = {(1 - u) * (1 - v), u * (1 - v), (1 - u) * v, u * v};
+                    Eigen::Vector3d n = Eigen::Vector3d::Zero();
+                    for (int k = 0; k < 4; k++) {
+                        cell.depth += w[k] * corner[k]->depth;
+                        n += w[k] * normal[k];
+                    }
+                    cell.hit = true;
+                    cell.normal = n.norm() > 0.0 ? Eigen::Vector3d(n.normalized()) : normal[0];
+                    cell.primitive = corner[(v >= 0.5 ? 2 : 0) + (u >= 0.5 ? 1 : 0)]->primitive;
+                    cell.shadowed = corner[0]->shadowed;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+int ASCIIRenderer::update_shadows(const Scene& scene, const Camera& camera, const int* cells, int n) {
+    if (!shadows) return 0;
+    int grid_width, grid_height;
+    get_sample_grid_size(grid_width, grid_height);
+    
+    int cast = 0;
+    for (int k = 0; k < n; k++) {
+        Ray ray;
+        viewing_ray(camera, cells[k] / grid_width, cells[k] % grid_width,
+                    grid_width, grid_height, ray);
+        cast += update_shadow(scene, ray, gbuffer[cells[k]]);
+    }
+    return cast;
+}
+
+bool ASCIIRenderer::update_shadow(const Scene& scene, const Ray& view_ray, GBufferCell& cell) const {
+    cell.shadowed = false;
+    if (!cell.hit || !shadows ||
+        facing_normal(cell.normal, view_ray.direction).dot(-light.direction) <= 0.0) {
+        return false;
+    }
+    const Eigen::Vector3d p = view_ray.origin + cell.depth * view_ray.direction;
+    cell.shadowed = in_shadow(scene, p, cell.normal, view_ray.direction);
+    return true;
+}
+
+void ASCIIRenderer::trace_ray(const Scene& scene, const Ray& ray, GBufferCell& cell) {
+    HitRecord hit_record;
+    const double max_t = std::numeric_limits<double>::infinity();
+    TraversalStats before;
+    if (TRAVERSAL_STATS_ENABLED) before = thread_traversal_stats();
+    const bool hit = use_prepared_rays
+        ? scene.intersect(PreparedRay(ray), VIEWING_RAY_MIN_T, max_t, hit_record)
+        : scene.intersect(ray, VIEWING_RAY_MIN_T, max_t, hit_record);
+    cell = GBufferCell();
+    if (TRAVERSAL_STATS_ENABLED) cell.cost = static_cast<uint32_t>((thread_traversal_stats() - before).cost());
+    if (hit) {
+        cell.hit = true;
+        cell.depth = hit_record.t;
+        cell.normal = scene.shading_normal(hit_record);
+        cell.primitive = hit_record.primitive;
+    }
+}
+
+int ASCIIRenderer::shade_tile(const Scene& scene, const Camera& camera, int row, int col,
+                              int rows, int cols, bool cast_shadows, const std::string& charset,
+                              std::vector<char32_t>& glyphs) {
+    int grid_width, grid_height;
+    get_grid_size(grid_width, grid_height);
+    int sample_width, sample_height;
+    get_sample_grid_size(sample_width, sample_height);
+    int sub_x, sub_y;
+    get_subsamples(sub_x, sub_y);
+    
+    int shadow_rays = 0;
+    double brightness[8];
+    for (int i = row; i < row + rows; i++) {
+        for (int j = col; j < col + cols; j++) {
+            unsigned coverage = 0;
+            for (int k = 0; k < sub_x * sub_y; k++) {
+                const int si = i * sub_y + k / sub_x;
+                const int sj = j * sub_x + k % sub_x;
+                GBufferCell& cell = gbuffer[si * sample_width + sj];
+                if (heatmap) {
+                    // Misses cost work too: every sample is drawn
+                    brightness[k] = std::min(cell.cost / heatmap_scale, 1.0);
+                    coverage |= 1u << k;
+                    continue;
+                }
+                brightness[k] = 0.0;
+                if (!cell.hit) continue;
+                Ray ray;
+                viewing_ray(camera, si, sj, sample_width, sample_height, ray);
+                if (cast_shadows) {
+                    shadow_rays += update_shadow(scene, ray, cell);
+                }
+                brightness[k] = calculate_brightness(cell.normal, ray.direction, cell.shadowed);
+                coverage |= 1u << k;
+            }
+            glyphs[i * grid_width + j] = cell_glyph(coverage, brightness, charset);
+        }
+    }
+    return shadow_rays;
+}
+
+char32_t ASCIIRenderer::cell_glyph(unsigned coverage, const double* brightness,
+                                   const std::string& charset) const {
+    switch (glyph_mode) {
+    case GlyphMode::CHARSET:
+        return coverage ? static_cast<unsigned char>(charset[charset_index(brightness[0], charset)]) : ' ';
+    case GlyphMode::SHAPES: {
+        // Mostly covered cells keep their shading; the others are edges
+        const int covered = popcount(coverage);
+        if (covered == 0) return ' ';
+        if (covered < 6) return static_cast<unsigned char>(shape_glyph(coverage));
+        double sum = 0.0;
+        for (int k = 0; k < 8; k++) sum += brightness[k];
+        return static_cast<unsigned char>(charset[charset_index(sum / covered, charset)]);
+    }
+    case GlyphMode::BRAILLE: {
+        unsigned dots = 0;
+        for (int k = 0; k < 8; k++) {
+            if ((coverage >> k & 1u) && brightness[k] > DITHER_2X4[k]) dots |= 1u << BRAILLE_BITS[k];
+        }
+        return 0x2800 + dots;
+    }
+    case GlyphMode::BLOCKS: {
+        unsigned quadrants = 0;
+        for (int k = 0; k < 4; k++) {
+            if ((coverage >> k & 1u) && brightness[k] > DITHER_2X2[k]) quadrants |= 1u << k;
+        }
+        return QUADRANT_BLOCKS[quadrants];
+    }
+    }
     return ' ';
 }
 
-double ASCIIRenderer::calculate_brightness(const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir) {
-    double diffuse = std::max(0.0, normal.dot(-light.direction)) * light.intensity;
+bool ASCIIRenderer::in_shadow(const Scene& scene, const Eigen::Vector3d& point,
+                              const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir) const {
+    if (!shadows) {
+        return false;
+    }
+    const Eigen::Vector3d n = facing_normal(normal, view_dir);
+    if (n.dot(-light.direction) <= 0.0) {
+        return false;
+    }
+    
+    Ray ray;
+    ray.origin = point + shadow_bias * n;
+    ray.direction = -light.direction;
+    const double max_t = std::numeric_limits<double>::infinity();
+    return use_prepared_rays
+        ? scene.occluded(PreparedRay(ray), shadow_bias, max_t)
+        : scene.occluded(ray, shadow_bias, max_t);
+}
+
+double ASCIIRenderer::calculate_brightness(const Eigen::Vector3d& normal, const Eigen::Vector3d& view_dir,
+                                           bool in_shadow) {
+    double diffuse = in_shadow ? 0.0
+        : std::max(0.0, facing_normal(normal, view_dir).dot(-light.direction)) * light.intensity;
     double ambient = ambient_strength;
     double brightness = std::clamp(ambient + diffuse, 0.0, 1.0);
     
@@ -48,8 +676,13 @@ double ASCIIRenderer::calculate_brightness(const Eigen::Vector3d& normal, const
 }
 
 char ASCIIRenderer::brightness_to_char(double brightness, const std::string& charset) {
-    int index = static_cast<int>(brightness * (charset.length() - 1));
-    index = std::clamp(index, 0, static_cast<int>(charset.length() - 1));
-    
-    return charset[index];
-}
\ No newline at end of file
+    return charset[charset_index(brightness, charset)];
+}
+
+ThreadPool& ASCIIRenderer::get_thread_pool() {
+    const int threads = num_threads > 0 ? num_threads : ThreadPool::hardware_threads();
+    if (!thread_pool || thread_pool->size() != threads) {
+        thread_pool = std::make_shared<ThreadPool>(threads);
+    }
+    return *thread_pool;
+}
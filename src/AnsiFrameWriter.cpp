@@ -0,0 +1,120 @@
+#include "AnsiFrameWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Unchanged cells between two changed ones that are rewritten rather
+    // than skipped with another cursor escape (which takes about as many
+    // bytes)
+    constexpr int MAX_REWRITTEN_GAP = 4;
+
+    // Bytes of the UTF-8 character starting with `lead`
+    size_t utf8_length(unsigned char lead) {
+        if (lead < 0x80) return 1;
+        if ((lead >> 5) == 0x6) return 2;
+        if ((lead >> 4) == 0xE) return 3;
+        if ((lead >> 3) == 0x1E) return 4;
+        return 1;
+    }
+
+    // Move the cursor to (row, column), both 1-based
+    void append_cursor_position(std::string& output, int row, int column) {
+        output += "\x1b[";
+        output += std::to_string(row);
+        output += ';';
+        output += std::to_string(column);
+        output += 'H';
+    }
+}
+
+bool AnsiFrameWriter::split_cells(const std::string& frame, std::vector<size_t>& offsets,
+                                  int& width, int& height) {
+    offsets.clear();
+    width = -1;
+    height = 0;
+    bool rectangular = true;
+    int column = 0;
+    for (size_t i = 0; i < frame.size();) {
+        if (frame[i] == '\n') {
+            rectangular = rectangular && (width < 0 || column == width);
+            width = column;
+            column = 0;
+            height++;
+            i++;
+            continue;
+        }
+        offsets.push_back(i);
+        column++;
+        i += utf8_length(static_cast<unsigned char>(frame[i]));
+    }
+    // A last row without '\n'
+    if (column > 0) {
+        rectangular = rectangular && (width < 0 || column == width);
+        width = column;
+        height++;
+    }
+    width = std::max(width, 0);
+    return rectangular;
+}
+
+void AnsiFrameWriter::write(const std::string& frame, std::string& output) {
+    int frame_width, frame_height;
+    const bool rectangular = split_cells(frame, offsets, frame_width, frame_height);
+    // Bytes of cell k of the new frame (a row ends at its '\n')
+    auto cell_end = [&](size_t k) {
+        return offsets[k] + utf8_length(static_cast<unsigned char>(frame[offsets[k]]));
+    };
+
+    if (!valid || !rectangular || frame_width != width || frame_height != height) {
+        // Full redraw, row by row (rows may be shorter than the screen)
+        append_cursor_position(output, top_row, 1);
+        output += "\x1b[J";
+        size_t begin = 0;
+        for (int row = 0; row < frame_height; row++) {
+            const size_t end = std::min(frame.find('\n', begin), frame.size());
+            append_cursor_position(output, top_row + row, 1);
+            output.append(frame, begin, end - begin);
+            begin = end + 1;
+        }
+        changed_cells = static_cast<int>(offsets.size());
+        valid = rectangular;
+    } else {
+        changed_cells = 0;
+        auto changed = [&](size_t k) {
+            const size_t length = cell_end(k) - offsets[k];
+            const size_t previous_length =
+                utf8_length(static_cast<unsigned char>(previous[previous_offsets[k]]));
+            return length != previous_length ||
+                std::memcmp(&frame[offsets[k]], &previous[previous_offsets[k]], length) != 0;
+        };
+        for (int row = 0; row < height; row++) {
+            const size_t row_start = static_cast<size_t>(row) * width;
+            int column = 0;
+            while (column < width) {
+                if (!changed(row_start + column)) {
+                    column++;
+                    continue;
+                }
+                // Run of changed cells, bridging short gaps of unchanged ones
+                int last = column;
+                for (int c = column + 1; c < width && c - last <= MAX_REWRITTEN_GAP; c++) {
+                    if (changed(row_start + c)) last = c;
+                }
+                changed_cells += last - column + 1;
+                append_cursor_position(output, top_row + row, column + 1);
+                const size_t begin = offsets[row_start + column];
+                output.append(frame, begin, cell_end(row_start + last) - begin);
+                column = last + 1;
+            }
+        }
+    }
+
+    previous = frame;
+    previous_offsets.swap(offsets);
+    width = frame_width;
+    height = frame_height;
+}
+
+void AnsiFrameWriter::reset() {
+    valid = false;
+}
@@ -0,0 +1,368 @@
+#include "LinearBVH.h"
+#include "insert_box_into_box.h"
+#include "sah_binned_split.h"
+#include "ThreadPool.h"
+#include "TraceZones.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+  // Round towards -inf / +inf when converting to float so the float box
+  // always contains the double box.
+  float round_down(const double x)
+  {
+    float f = static_cast<float>(x);
+    if (f > x)
+      f = std::nextafter(f, -std::numeric_limits<float>::infinity());
+    return f;
+  }
+  float round_up(const double x)
+  {
+    float f = static_cast<float>(x);
+    if (f < x)
+      f = std::nextafter(f, std::numeric_limits<float>::infinity());
+    return f;
+  }
+
+  // SAH cost of a leaf holding n objects
+  double leaf_cost(const int n, const int block_size)
+  {
+    const int bs = std::max(block_size, 1);
+    return (n + bs - 1) / bs;
+  }
+
+  int longest_axis(const BoundingBox & box)
+  {
+    int axis;
+    Eigen::RowVector3d diag = box.max_corner - box.min_corner;
+    diag.maxCoeff(&axis);
+    return axis;
+  }
+
+  // Subtrees over fewer objects than this are built serially by one task
+  const int parallel_build_threshold = 4096;
+
+  // State shared by all tasks of one build
+  struct BuildContext
+  {
+    const std::vector<BoundingBox> & boxes;
+    const BVHBuildOptions & options;
+    int max_leaf_size;
+    // Object indices, partitioned in place so every leaf is a contiguous run
+    std::vector<int> & indices;
+    // Node slots. A subtree over n objects uses at most 2n-1 slots, so each
+    // subtree gets a fixed range up front and tasks never write the same slot
+    std::vector<LinearBVHNode> & nodes;
+    std::vector<char> & used;
+    std::atomic<int> max_depth;
+    TaskGroup * group;
+  };
+
+  // Build the subtree over indices[begin,end) rooted at slot node_index.
+  void build_recursive(
+    BuildContext & ctx,
+    const int node_index,
+    const int begin,
+    const int end,
+    const int depth)
+  {
+    int previous_depth = ctx.max_depth.load(std::memory_order_relaxed);
+    while (depth > previous_depth &&
+      !ctx.max_depth.compare_exchange_weak(previous_depth, depth)) {}
+    ctx.used[node_index] = 1;
+
+    BoundingBox box;
+    for (int i = begin; i < end; i++) {
+      insert_box_into_box(ctx.boxes[ctx.indices[i]], box);
+    }
+    LinearBVHNode & node = ctx.nodes[node_index];
+    node.set_box(box);
+
+    const int n = end - begin;
+    const BVHBuildOptions & options = ctx.options;
+    int axis = longest_axis(box);
+    double split = box.center()[axis];
+    bool can_split = true;
+    bool make_leaf = n == 1;
+
+    LoadProgress * progress = options.progress;
+    if (progress && progress->cancelled()) {
+      // Finish the subtree as one leaf (as large as a node can count)
+      node.offset = begin;
+      node.count = std::min(n, (int)std::numeric_limits<uint16_t>::max());
+      node.axis = 0;
+      return;
+    }
+
+    const bool sah = options.method != BVHSplitMethod::MIDPOINT;
+    if (!make_leaf && sah) {
+      double cost;
+      can_split = sah_binned_split(
+        ctx.boxes, ctx.indices.data() + begin, n,
+        options.num_bins, options.traversal_cost, options.leaf_block_size,
+        axis, split, cost);
+      make_leaf = n <= ctx.max_leaf_size &&
+        (!can_split || cost >= leaf_cost(n, options.leaf_block_size));
+    }
+
+    if (make_leaf) {
+      node.offset = begin;
+      node.count = n;
+      node.axis = 0;
+      if (progress)
+        progress->add_objects_placed(n);
+      return;
+    }
+
+    int mid = begin;
+    if (can_split) {
+      mid = std::partition(
+        ctx.indices.begin() + begin, ctx.indices.begin() + end,
+        [&](const int i) {
+          const double center = ctx.boxes[i].center()[axis];
+          return sah ? center < split : center <= split;
+        }) - ctx.indices.begin();
+    }
+    if (mid == begin || mid == end) {
+      mid = begin + n / 2;
+    }
+
+    const int left = node_index + 1;
+    const int right = node_index + 2 * (mid - begin);
+    node.offset = right;
+    node.count = 0;
+    node.axis = axis;
+
+    if (ctx.group && n >= parallel_build_threshold) {
+      ctx.group->run([&ctx, left, begin, mid, depth] {
+        build_recursive(ctx, left, begin, mid, depth + 1);
+      });
+    } else {
+      build_recursive(ctx, left, begin, mid, depth + 1);
+    }
+    build_recursive(ctx, right, mid, end, depth + 1);
+  }
+
+  // Copy the subtree rooted at slot `index` of `slots` to the end of `nodes`
+  // in depth-first order, dropping unused slots. Returns its new index.
+  int compact_recursive(
+    const std::vector<LinearBVHNode> & slots,
+    const int index,
+    std::vector<LinearBVHNode> & nodes)
+  {
+    const int node_index = nodes.size();
+    nodes.push_back(slots[index]);
+    if (slots[index].count == 0) {
+      compact_recursive(slots, index + 1, nodes);
+      nodes[node_index].offset =
+        compact_recursive(slots, slots[index].offset, nodes);
+    }
+    return node_index;
+  }
+
+  // Append a leaf holding `objects` to bvh and return its node index
+  int flatten_leaf(
+    const std::vector<const Object *> & objects,
+    const std::unordered_map<const Object *, int> & index_of,
+    LinearBVH & bvh)
+  {
+    const int node_index = bvh.nodes.size();
+    bvh.nodes.emplace_back();
+    LinearBVHNode & node = bvh.nodes[node_index];
+    BoundingBox box;
+    node.offset = bvh.primitives.size();
+    node.count = objects.size();
+    node.axis = 0;
+    for (const Object * obj : objects) {
+      insert_box_into_box(obj->box, box);
+      const auto found = index_of.find(obj);
+      assert(found != index_of.end() && "tree object missing from list");
+      bvh.primitives.push_back(obj);
+      bvh.primitive_indices.push_back(found->second);
+    }
+    node.set_box(box);
+    return node_index;
+  }
+
+  int flatten_recursive(
+    const Object & obj,
+    const int depth,
+    const std::unordered_map<const Object *, int> & index_of,
+    LinearBVH & bvh)
+  {
+    bvh.max_depth = std::max(bvh.max_depth, depth);
+    const AABBTree * tree = dynamic_cast<const AABBTree *>(&obj);
+    if (!tree) {
+      return flatten_leaf({&obj}, index_of, bvh);
+    }
+    if (!tree->leaf_objects.empty()) {
+      std::vector<const Object *> objects;
+      for (const auto & leaf_obj : tree->leaf_objects) {
+        objects.push_back(leaf_obj.get());
+      }
+      return flatten_leaf(objects, index_of, bvh);
+    }
+    if (!tree->right) {
+      return flatten_recursive(*tree->left, depth, index_of, bvh);
+    }
+    if (!tree->left) {
+      return flatten_recursive(*tree->right, depth, index_of, bvh);
+    }
+
+    const int node_index = bvh.nodes.size();
+    bvh.nodes.emplace_back();
+    bvh.nodes[node_index].set_box(tree->box);
+    flatten_recursive(*tree->left, depth + 1, index_of, bvh);
+    const int right = flatten_recursive(*tree->right, depth + 1, index_of, bvh);
+
+    LinearBVHNode & node = bvh.nodes[node_index];
+    node.offset = right;
+    node.count = 0;
+    node.axis = longest_axis(tree->box);
+    return node_index;
+  }
+}
+
+void LinearBVHNode::set_box(const BoundingBox & box)
+{
+  for (int i = 0; i < 3; i++) {
+    min_corner[i] = round_down(box.min_corner[i]);
+    max_corner[i] = round_up(box.max_corner[i]);
+  }
+}
+
+LinearBVH::LinearBVH(
+  const std::vector<std::shared_ptr<Object> > & objects,
+  const BVHBuildOptions & options)
+{
+  if (objects.empty())
+    return;
+  TRACE_ZONE("LinearBVH build");
+  if (options.method == BVHSplitMethod::SBVH) {
+    build_spatial_split(objects, options);
+    return;
+  }
+
+  const int n = objects.size();
+  ThreadPool pool(options.num_threads);
+
+  std::vector<BoundingBox> boxes(n);
+  std::vector<int> indices(n);
+  pool.parallel_for(0, n, 4096, [&](const int begin, const int end) {
+    for (int i = begin; i < end; i++) {
+      boxes[i] = objects[i]->box;
+      indices[i] = i;
+    }
+  });
+
+  std::vector<LinearBVHNode> slots(2 * n - 1);
+  std::vector<char> used(slots.size(), 0);
+  TaskGroup group(pool);
+  BuildContext ctx{
+    boxes,
+    options,
+    std::clamp(options.max_leaf_size, 1, (int)std::numeric_limits<uint16_t>::max()),
+    indices,
+    slots,
+    used,
+    {0},
+    pool.size() > 1 ? &group : nullptr};
+  build_recursive(ctx, 0, 0, n, 0);
+  group.wait();
+  max_depth = ctx.max_depth;
+
+  // Leaves holding several objects leave gaps in the slot array
+  const size_t num_used = std::count(used.begin(), used.end(), 1);
+  build_peak_bytes =
+    boxes.size() * sizeof(BoundingBox) +
+    indices.size() * sizeof(int) +
+    used.size() * sizeof(char) +
+    slots.size() * sizeof(LinearBVHNode) +
+    (num_used == slots.size() ? 0 : num_used * sizeof(LinearBVHNode));
+  if (num_used == slots.size()) {
+    nodes = std::move(slots);
+  } else {
+    nodes.reserve(num_used);
+    compact_recursive(slots, 0, nodes.owned());
+  }
+
+  primitives.resize(n);
+  pool.parallel_for(0, n, 4096, [&](const int begin, const int end) {
+    for (int i = begin; i < end; i++) {
+      primitives[i] = objects[indices[i]].get();
+    }
+  });
+  primitive_indices = std::move(indices);
+}
+
+LinearBVH::LinearBVH(
+  const AABBTree & tree,
+  const std::vector<std::shared_ptr<Object> > & objects)
+{
+  if (!tree.left && !tree.right && tree.leaf_objects.empty())
+    return;
+
+  std::unordered_map<const Object *, int> index_of;
+  for (size_t i = 0; i < objects.size(); i++) {
+    index_of[objects[i].get()] = i;
+  }
+  flatten_recursive(tree, 0, index_of, *this);
+}
+
+BoundingBox LinearBVH::box() const
+{
+  if (nodes.empty())
+    return BoundingBox();
+  const LinearBVHNode & root = nodes[0];
+  return BoundingBox(
+    Eigen::RowVector3d(root.min_corner[0], root.min_corner[1], root.min_corner[2]),
+    Eigen::RowVector3d(root.max_corner[0], root.max_corner[1], root.max_corner[2]));
+}
+
+size_t LinearBVH::memory_bytes() const
+{
+  return nodes.capacity() * sizeof(LinearBVHNode) +
+    primitives.capacity() * sizeof(const Object *) +
+    primitive_indices.capacity() * sizeof(int);
+}
+
+BVHStats LinearBVH::stats(const double traversal_cost) const
+{
+  BVHStats stats;
+  if (nodes.empty())
+    return stats;
+
+  const auto area = [](const LinearBVHNode & node) {
+    const double dx = node.max_corner[0] - node.min_corner[0];
+    const double dy = node.max_corner[1] - node.min_corner[1];
+    const double dz = node.max_corner[2] - node.min_corner[2];
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+  };
+
+  // Depth-first walk carrying each node's depth
+  std::vector<std::pair<int, int> > stack = {{0, 0}};
+  while (!stack.empty()) {
+    const auto [index, depth] = stack.back();
+    stack.pop_back();
+    const LinearBVHNode & node = nodes[index];
+    stats.num_nodes++;
+    stats.max_depth = std::max(stats.max_depth, depth);
+    if (node.count > 0) {
+      stats.num_leaf_nodes++;
+      stats.sah_cost += node.count * area(node);
+    } else {
+      stats.sah_cost += traversal_cost * area(node);
+      stack.push_back({index + 1, depth + 1});
+      stack.push_back({node.offset, depth + 1});
+    }
+  }
+  const double root_area = area(nodes[0]);
+  stats.sah_cost = root_area > 0 ? stats.sah_cost / root_area : 0.0;
+  return stats;
+}
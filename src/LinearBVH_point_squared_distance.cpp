@@ -0,0 +1,92 @@
+#include "LinearBVH.h"
+#include "point_box_squared_distance.h"
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  // Squared distance from a point to a node's box (a lower bound of the
+  // squared distance to its objects, as the float bounds are rounded outward)
+  inline double point_node_squared_distance(
+    const Eigen::RowVector3d & query,
+    const LinearBVHNode & node)
+  {
+    double sqrd = 0;
+    for (int i = 0; i < 3; i++) {
+      const double d = std::max({
+        static_cast<double>(node.min_corner[i]) - query[i],
+        0.0,
+        query[i] - static_cast<double>(node.max_corner[i])});
+      sqrd += d * d;
+    }
+    return sqrd;
+  }
+}
+
+bool LinearBVH::point_squared_distance(
+  const Eigen::RowVector3d & query,
+  const double min_sqrd,
+  const double max_sqrd,
+  double & sqrd,
+  int & hit_index) const
+{
+  if (nodes.empty())
+    return false;
+
+  // Nodes not visited yet, nearest box first
+  using Entry = std::pair<double, int>;
+  std::vector<Entry> storage;
+  storage.reserve(2 * (max_depth + 1));
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue(
+    std::greater<Entry>(), std::move(storage));
+
+  bool found = false;
+  double closest = max_sqrd;
+  // MeshTriangle and other leaves set this to null; it is never read
+  std::shared_ptr<Object> descendant;
+  int current = 0;
+  double current_sqrd = point_node_squared_distance(query, nodes[0]);
+  while (true) {
+    if (current_sqrd <= closest) {
+      const LinearBVHNode & node = nodes[current];
+      if (node.count > 0) {
+        for (int i = node.offset; i < node.offset + node.count; i++) {
+          // The object's own box is much cheaper than its exact distance
+          if (point_box_squared_distance<double>(query, primitives[i]->box) > closest)
+            continue;
+          double d;
+          if (primitives[i]->point_squared_distance(query, min_sqrd, closest, d, descendant)) {
+            found = true;
+            closest = d;
+            hit_index = primitive_indices[i];
+          }
+        }
+      } else {
+        // Descend into the nearer child right away and queue the other one,
+        // which saves a queue round trip per level
+        const int first = current + 1;
+        const int second = node.offset;
+        const double first_sqrd = point_node_squared_distance(query, nodes[first]);
+        const double second_sqrd = point_node_squared_distance(query, nodes[second]);
+        const bool first_nearer = first_sqrd <= second_sqrd;
+        const double far_sqrd = first_nearer ? second_sqrd : first_sqrd;
+        if (far_sqrd <= closest)
+          queue.emplace(far_sqrd, first_nearer ? second : first);
+        current = first_nearer ? first : second;
+        current_sqrd = first_nearer ? first_sqrd : second_sqrd;
+        continue;
+      }
+    }
+    if (queue.empty() || queue.top().first > closest)
+      break;
+    current = queue.top().second;
+    current_sqrd = queue.top().first;
+    queue.pop();
+  }
+
+  if (found)
+    sqrd = closest;
+  return found;
+}
@@ -0,0 +1,241 @@
+#include "LinearBVH.h"
+#include "TraversalStats.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+  // Branch-free slab test of a ray against a node's float box, entering
+  // through the corner planes picked by the direction signs. The far distance
+  // is padded by a few ulps so rounding never rejects a ray that grazes a
+  // corner (Ize, "Robust BVH Ray Traversal").
+  inline bool ray_intersect_node(
+    const LinearBVHNode & node,
+    const PreparedRay & ray,
+    const double min_t,
+    const double max_t)
+  {
+    TRAVERSAL_STATS_ADD(box_tests, 1);
+    const double pad = 1.0 + 4.0 * std::numeric_limits<double>::epsilon();
+    const float * corners[2] = {node.min_corner, node.max_corner};
+    double t_near = min_t;
+    double t_far = max_t;
+    for (int i = 0; i < 3; i++) {
+      const double t1 =
+        (corners[ray.is_negative[i]][i] - ray.ray.origin[i]) * ray.inv_direction[i];
+      const double t2 =
+        (corners[1 - ray.is_negative[i]][i] - ray.ray.origin[i]) * ray.inv_direction[i] * pad;
+      // Comparisons written so a NaN (0 * inf on a slab boundary) is ignored
+      t_near = t1 > t_near ? t1 : t_near;
+      t_far = t2 < t_far ? t2 : t_far;
+    }
+    return t_near <= t_far;
+  }
+
+  // Index of the lowest set bit of a non-zero mask
+  inline int lowest_set_bit(const unsigned mask)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+  // Traversal shared by all single-ray queries; leaf objects are tested with
+  // leaf_ray (a Ray or the PreparedRay itself). With any_hit it returns at
+  // the first object hit, leaving hit_record unset.
+  template <bool any_hit, typename RayType>
+  bool traverse(
+    const LinearBVH & bvh,
+    const PreparedRay & ray,
+    const RayType & leaf_ray,
+    const double min_t,
+    const double max_t,
+    HitRecord & hit_record)
+  {
+    if (bvh.nodes.empty())
+      return false;
+    const LinearBVHNode * nodes = bvh.nodes.data();
+    const int * primitive_indices = bvh.primitive_indices.data();
+
+    // Each level pushes at most one node, so max_depth+1 entries suffice
+    int fixed_stack[64];
+    std::vector<int> dynamic_stack;
+    int * stack = fixed_stack;
+    if (bvh.max_depth >= 64) {
+      dynamic_stack.resize(bvh.max_depth + 1);
+      stack = dynamic_stack.data();
+    }
+    int stack_size = 0;
+
+    bool hit = false;
+    double closest = max_t;
+    HitRecord candidate;
+    int current = 0;
+    while (true) {
+      const LinearBVHNode & node = nodes[current];
+      TRAVERSAL_STATS_ADD(nodes_visited, 1);
+      if (ray_intersect_node(node, ray, min_t, closest)) {
+        if (node.count > 0) {
+          for (int i = node.offset; i < node.offset + node.count; i++) {
+            if (any_hit) {
+              if (bvh.primitives[i]->ray_occluded(leaf_ray, min_t, max_t))
+                return true;
+              continue;
+            }
+            if (bvh.primitives[i]->ray_intersect(leaf_ray, min_t, closest, candidate)) {
+              hit = true;
+              closest = candidate.t;
+              hit_record = candidate;
+              hit_record.primitive = primitive_indices[i];
+            }
+          }
+        } else {
+          // Descend into the near child, defer the far one
+          if (ray.is_negative[node.axis]) {
+            stack[stack_size++] = current + 1;
+            current = node.offset;
+          } else {
+            stack[stack_size++] = node.offset;
+            current = current + 1;
+          }
+          continue;
+        }
+      }
+      if (stack_size == 0)
+        break;
+      current = stack[--stack_size];
+    }
+
+    return hit;
+  }
+}
+
+bool LinearBVH::ray_intersect(
+  const Ray & ray,
+  const double min_t,
+  const double max_t,
+  HitRecord & hit) const
+{
+  return traverse<false>(*this, PreparedRay(ray), ray, min_t, max_t, hit);
+}
+
+bool LinearBVH::ray_intersect(
+  const PreparedRay & ray,
+  const double min_t,
+  const double max_t,
+  HitRecord & hit) const
+{
+  return traverse<false>(*this, ray, ray, min_t, max_t, hit);
+}
+
+bool LinearBVH::ray_occluded(
+  const Ray & ray,
+  const double min_t,
+  const double max_t) const
+{
+  HitRecord hit;
+  return traverse<true>(*this, PreparedRay(ray), ray, min_t, max_t, hit);
+}
+
+bool LinearBVH::ray_occluded(
+  const PreparedRay & ray,
+  const double min_t,
+  const double max_t) const
+{
+  HitRecord hit;
+  return traverse<true>(*this, ray, ray, min_t, max_t, hit);
+}
+
+unsigned LinearBVH::ray_intersect_packet(
+  const RayPacket & packet,
+  const double min_t,
+  const double max_t,
+  HitRecord * hits) const
+{
+  if (nodes.empty() || packet.size == 0)
+    return 0;
+
+  struct StackEntry
+  {
+    int node;
+    unsigned rays;
+  };
+  StackEntry fixed_stack[64];
+  std::vector<StackEntry> dynamic_stack;
+  StackEntry * stack = fixed_stack;
+  if (max_depth >= 64) {
+    dynamic_stack.resize(max_depth + 1);
+    stack = dynamic_stack.data();
+  }
+  int stack_size = 0;
+
+  double closest[RAY_PACKET_MAX_SIZE];
+  std::fill(closest, closest + packet.size, max_t);
+  unsigned hit = 0;
+  HitRecord candidate;
+
+  stack[stack_size++] = {0, packet.all()};
+  while (stack_size > 0) {
+    const StackEntry entry = stack[--stack_size];
+    const LinearBVHNode & node = nodes[entry.node];
+    TRAVERSAL_STATS_ADD(nodes_visited, 1);
+
+    // Rays hitting the node: decided for the whole packet by its frustum
+    // when possible, otherwise ray by ray
+    double max_t_lo = std::numeric_limits<double>::infinity();
+    double max_t_hi = -std::numeric_limits<double>::infinity();
+    for (unsigned m = entry.rays; m; m &= m - 1) {
+      const int r = lowest_set_bit(m);
+      max_t_lo = std::min(max_t_lo, closest[r]);
+      max_t_hi = std::max(max_t_hi, closest[r]);
+    }
+    double t_near;
+    TRAVERSAL_STATS_ADD(box_tests, 1);
+    const RayPacket::BoxHit box_hit = packet.classify_box(
+      node.min_corner, node.max_corner, min_t, max_t_lo, max_t_hi, t_near);
+    if (box_hit == RayPacket::BoxHit::NONE)
+      continue;
+    unsigned rays = entry.rays;
+    if (box_hit == RayPacket::BoxHit::SOME) {
+      rays = 0;
+      for (unsigned m = entry.rays; m; m &= m - 1) {
+        const int r = lowest_set_bit(m);
+        if (ray_intersect_node(node, packet.rays[r], min_t, closest[r]))
+          rays |= 1u << r;
+      }
+      if (!rays)
+        continue;
+    }
+
+    if (node.count > 0) {
+      for (unsigned m = rays; m; m &= m - 1) {
+        const int r = lowest_set_bit(m);
+        for (int i = node.offset; i < node.offset + node.count; i++) {
+          if (primitives[i]->ray_intersect(packet.rays[r], min_t, closest[r], candidate)) {
+            hit |= 1u << r;
+            closest[r] = candidate.t;
+            hits[r] = candidate;
+            hits[r].primitive = primitive_indices[i];
+          }
+        }
+      }
+    } else {
+      // Near child (for the first active ray) on top
+      const int first = lowest_set_bit(rays);
+      const int near_child = packet.rays[first].is_negative[node.axis] ? node.offset : entry.node + 1;
+      const int far_child = near_child == node.offset ? entry.node + 1 : node.offset;
+      stack[stack_size++] = {far_child, rays};
+      stack[stack_size++] = {near_child, rays};
+    }
+  }
+
+  return hit;
+}
@@ -0,0 +1,50 @@
+#include "LinearBVH.h"
+#include "insert_box_into_box.h"
+#include "parallel_refit.h"
+#include <algorithm>
+
+double LinearBVH::refit(ThreadPool & pool, const double traversal_cost)
+{
+  if (nodes.empty())
+    return 0.0;
+  // Own the nodes (copying mapped ones) before the threads write them
+  std::vector<LinearBVHNode> & nodes = this->nodes.owned();
+
+  const auto area = [](const LinearBVHNode & node) {
+    const double dx = node.max_corner[0] - node.min_corner[0];
+    const double dy = node.max_corner[1] - node.min_corner[1];
+    const double dz = node.max_corner[2] - node.min_corner[2];
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+  };
+
+  const double weighted_area = parallel_refit(
+    pool,
+    nodes.size(),
+    [&](const int i, std::vector<int> & kids) {
+      if (nodes[i].count == 0) {
+        kids.push_back(i + 1);
+        kids.push_back(nodes[i].offset);
+      }
+    },
+    [&](const int i) {
+      LinearBVHNode & node = nodes[i];
+      if (node.count > 0) {
+        BoundingBox box;
+        for (int p = node.offset; p < node.offset + node.count; p++) {
+          insert_box_into_box(primitives[p]->box, box);
+        }
+        node.set_box(box);
+        return node.count * area(node);
+      }
+      const LinearBVHNode & left = nodes[i + 1];
+      const LinearBVHNode & right = nodes[node.offset];
+      for (int k = 0; k < 3; k++) {
+        node.min_corner[k] = std::min(left.min_corner[k], right.min_corner[k]);
+        node.max_corner[k] = std::max(left.max_corner[k], right.max_corner[k]);
+      }
+      return traversal_cost * area(node);
+    });
+
+  const double root_area = area(nodes[0]);
+  return root_area > 0 ? weighted_area / root_area : 0.0;
+}
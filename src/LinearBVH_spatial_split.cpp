@@ -0,0 +1,277 @@
+#include "LinearBVH.h"
+#include "insert_box_into_box.h"
+#include "sah_binned_split.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+  // An object reference: the part of object `index` inside `box`
+  struct Reference
+  {
+    int index;
+    BoundingBox box;
+  };
+
+  bool is_empty(const BoundingBox & box)
+  {
+    return (box.min_corner.array() > box.max_corner.array()).any();
+  }
+
+  BoundingBox box_intersection(const BoundingBox & a, const BoundingBox & b)
+  {
+    return BoundingBox(
+      a.min_corner.cwiseMax(b.min_corner),
+      a.max_corner.cwiseMin(b.max_corner));
+  }
+
+  // Candidate split of a node
+  struct Split
+  {
+    double cost = std::numeric_limits<double>::infinity();
+    int axis = 0;
+    double position = 0;
+    bool spatial = false;
+  };
+
+  // State shared by the whole build
+  struct SpatialSplitBuilder
+  {
+    const std::vector<std::shared_ptr<Object> > & objects;
+    const BVHBuildOptions & options;
+    int max_leaf_size;
+    double root_area;
+    // Number of references the build may still duplicate
+    long long remaining_references;
+    // Current and peak number of live references
+    size_t live_references = 0;
+    size_t peak_references = 0;
+    LinearBVH & bvh;
+
+    // Cheapest binned spatial split of refs (spatial splits bin the node's
+    // box rather than the centroids and clip references into every bin they
+    // overlap)
+    Split find_spatial_split(
+      const std::vector<Reference> & refs,
+      const BoundingBox & bounds) const
+    {
+      const int nb = std::max(options.num_bins, 2);
+      const int bs = std::max(options.leaf_block_size, 1);
+      const auto blocks = [bs](const int count) { return (count + bs - 1) / bs; };
+      const double inv_area = 1.0 / std::max(bounds.surface_area(),
+        std::numeric_limits<double>::min());
+      Split best;
+      std::vector<BoundingBox> bin_boxes(nb);
+      std::vector<int> entries(nb), exits(nb);
+      std::vector<double> right_area(nb);
+      std::vector<int> right_count(nb);
+
+      for (int a = 0; a < 3; a++) {
+        const double lo = bounds.min_corner[a];
+        const double extent = bounds.max_corner[a] - lo;
+        if (!(extent > 0))
+          continue;
+        const double width = extent / nb;
+        const auto bin_of = [&](const double x) {
+          return std::clamp(static_cast<int>((x - lo) / width), 0, nb - 1);
+        };
+
+        std::fill(bin_boxes.begin(), bin_boxes.end(), BoundingBox());
+        std::fill(entries.begin(), entries.end(), 0);
+        std::fill(exits.begin(), exits.end(), 0);
+        for (const Reference & ref : refs) {
+          const int first = bin_of(ref.box.min_corner[a]);
+          const int last = bin_of(ref.box.max_corner[a]);
+          entries[first]++;
+          exits[last]++;
+          BoundingBox rest = ref.box;
+          for (int b = first; b < last; b++) {
+            BoundingBox piece, remainder;
+            objects[ref.index]->split_box(rest, a, lo + (b + 1) * width, piece, remainder);
+            if (!is_empty(piece))
+              insert_box_into_box(piece, bin_boxes[b]);
+            rest = remainder;
+          }
+          if (!is_empty(rest))
+            insert_box_into_box(rest, bin_boxes[last]);
+        }
+
+        BoundingBox right_box;
+        int count = 0;
+        for (int b = nb - 1; b > 0; b--) {
+          insert_box_into_box(bin_boxes[b], right_box);
+          count += exits[b];
+          right_area[b] = right_box.surface_area();
+          right_count[b] = count;
+        }
+        BoundingBox left_box;
+        int left_count = 0;
+        for (int b = 1; b < nb; b++) {
+          insert_box_into_box(bin_boxes[b - 1], left_box);
+          left_count += entries[b - 1];
+          // Both children must shrink or the recursion might not terminate
+          if (left_count == 0 || right_count[b] == 0 ||
+              left_count >= (int)refs.size() || right_count[b] >= (int)refs.size())
+            continue;
+          const double cost = options.traversal_cost +
+            (left_box.surface_area() * blocks(left_count) +
+             right_area[b] * blocks(right_count[b])) * inv_area;
+          if (cost < best.cost) {
+            best.cost = cost;
+            best.axis = a;
+            best.position = lo + b * width;
+            best.spatial = true;
+          }
+        }
+      }
+      return best;
+    }
+
+    void track(const long long delta)
+    {
+      live_references += delta;
+      peak_references = std::max(peak_references, live_references);
+    }
+
+    int build(std::vector<Reference> & refs, const int depth)
+    {
+      const int node_index = bvh.nodes.size();
+      bvh.nodes.emplace_back();
+      bvh.max_depth = std::max(bvh.max_depth, depth);
+
+      const int n = refs.size();
+      BoundingBox bounds;
+      std::vector<BoundingBox> boxes;
+      boxes.reserve(n);
+      for (const Reference & ref : refs) {
+        insert_box_into_box(ref.box, bounds);
+        boxes.push_back(ref.box);
+      }
+      bvh.nodes[node_index].set_box(bounds);
+
+      // Object split
+      Split split;
+      bool can_split = n > 1 && sah_binned_split(
+        boxes, options.num_bins, options.traversal_cost, options.leaf_block_size,
+        split.axis, split.position, split.cost);
+
+      // Spatial split, only where object-split children overlap noticeably
+      // (deep degenerate chains fall back to object splits)
+      if (can_split && remaining_references > 0 && depth < 64) {
+        BoundingBox left_box, right_box;
+        for (const Reference & ref : refs) {
+          insert_box_into_box(ref.box,
+            ref.box.center()[split.axis] < split.position ? left_box : right_box);
+        }
+        const BoundingBox overlap = box_intersection(left_box, right_box);
+        if (!is_empty(overlap) &&
+            overlap.surface_area() > options.spatial_split_alpha * root_area) {
+          const Split spatial = find_spatial_split(refs, bounds);
+          if (spatial.cost < split.cost)
+            split = spatial;
+        }
+      }
+
+      const int bs = std::max(options.leaf_block_size, 1);
+      const double leaf_cost = (n + bs - 1) / bs;
+      // A cancelled build finishes every subtree as one leaf (keeping as
+      // many references as a node can count)
+      const bool cancelled = options.progress && options.progress->cancelled();
+      if (cancelled || n == 1 ||
+          (n <= max_leaf_size && (!can_split || split.cost >= leaf_cost))) {
+        const int count = std::min(n, (int)std::numeric_limits<uint16_t>::max());
+        LinearBVHNode & node = bvh.nodes[node_index];
+        node.offset = bvh.primitives.size();
+        node.count = count;
+        node.axis = 0;
+        for (int i = 0; i < count; i++) {
+          bvh.primitives.push_back(objects[refs[i].index].get());
+          bvh.primitive_indices.push_back(refs[i].index);
+        }
+        if (options.progress)
+          options.progress->add_objects_placed(n);
+        track(-n);
+        std::vector<Reference>().swap(refs);
+        return node_index;
+      }
+
+      std::vector<Reference> left_refs, right_refs;
+      if (can_split) {
+        for (const Reference & ref : refs) {
+          if (!split.spatial) {
+            (ref.box.center()[split.axis] < split.position ? left_refs : right_refs)
+              .push_back(ref);
+          } else if (ref.box.max_corner[split.axis] <= split.position) {
+            left_refs.push_back(ref);
+          } else if (ref.box.min_corner[split.axis] >= split.position) {
+            right_refs.push_back(ref);
+          } else {
+            // Straddling reference: clip into both children while the
+            // budget lasts, otherwise send it whole to its centroid's side
+            BoundingBox left_piece, right_piece;
+            objects[ref.index]->split_box(
+              ref.box, split.axis, split.position, left_piece, right_piece);
+            const bool left_empty = is_empty(left_piece);
+            const bool right_empty = is_empty(right_piece);
+            if (remaining_references > 0 && !left_empty && !right_empty) {
+              remaining_references--;
+              left_refs.push_back({ref.index, left_piece});
+              right_refs.push_back({ref.index, right_piece});
+            } else if (!left_empty && (right_empty ||
+                       ref.box.center()[split.axis] < split.position)) {
+              left_refs.push_back(ref);
+            } else {
+              right_refs.push_back(ref);
+            }
+          }
+        }
+      }
+      if (left_refs.empty() || right_refs.empty()) {
+        left_refs.assign(refs.begin(), refs.begin() + n / 2);
+        right_refs.assign(refs.begin() + n / 2, refs.end());
+      }
+      track(left_refs.size() + right_refs.size() - n);
+      std::vector<Reference>().swap(refs);
+
+      build(left_refs, depth + 1);
+      const int right = build(right_refs, depth + 1);
+
+      LinearBVHNode & node = bvh.nodes[node_index];
+      node.offset = right;
+      node.count = 0;
+      node.axis = split.axis;
+      return node_index;
+    }
+  };
+}
+
+void LinearBVH::build_spatial_split(
+  const std::vector<std::shared_ptr<Object> > & objects,
+  const BVHBuildOptions & options)
+{
+  std::vector<Reference> refs(objects.size());
+  BoundingBox bounds;
+  for (size_t i = 0; i < objects.size(); i++) {
+    refs[i] = {static_cast<int>(i), objects[i]->box};
+    insert_box_into_box(objects[i]->box, bounds);
+  }
+
+  SpatialSplitBuilder builder{
+    objects,
+    options,
+    std::clamp(options.max_leaf_size, 1, (int)std::numeric_limits<uint16_t>::max()),
+    bounds.surface_area(),
+    static_cast<long long>(std::floor(options.max_reference_growth * objects.size())),
+    0,
+    0,
+    *this};
+  builder.track(refs.size());
+  builder.build(refs, 0);
+
+  nodes.shrink_to_fit();
+  primitives.shrink_to_fit();
+  primitive_indices.shrink_to_fit();
+  build_peak_bytes =
+    builder.peak_references * sizeof(Reference) + memory_bytes();
+}
@@ -0,0 +1,56 @@
+#include "MappedFile.h"
+#include <cstdint>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string & filename, const bool sequential)
+{
+#ifndef _WIN32
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat info;
+  if (::fstat(fd, &info) == 0) {
+    opened = true;
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+      void * mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        ::madvise(mapping, length, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+        bytes = static_cast<const char *>(mapping);
+      } else {
+        opened = false;
+        length = 0;
+      }
+    }
+  }
+  ::close(fd);
+#else
+  (void)sequential;
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open())
+    return;
+  file.seekg(0, std::ios::end);
+  length = static_cast<size_t>(file.tellg());
+  file.seekg(0, std::ios::beg);
+  // Start the bytes on a cache line (a mapping starts on a page)
+  buffer.resize(length + 63);
+  char * start = buffer.data() + (64 - reinterpret_cast<uintptr_t>(buffer.data()) % 64) % 64;
+  opened = static_cast<bool>(file.read(start, length)) || length == 0;
+  bytes = start;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+  if (bytes)
+    ::munmap(const_cast<char *>(bytes), length);
+#endif
+}
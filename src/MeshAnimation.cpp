@@ -0,0 +1,78 @@
+#include "MeshAnimation.h"
+#include "read_obj.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+  std::string frame_path(const std::string & pattern, const int number)
+  {
+    char buffer[1024];
+    std::snprintf(buffer, sizeof(buffer), pattern.c_str(), number);
+    return buffer;
+  }
+
+  bool file_exists(const std::string & path)
+  {
+    return std::ifstream(path).good();
+  }
+}
+
+bool MeshAnimation::load_obj_sequence(
+  const std::string & pattern,
+  const double frames_per_second,
+  Eigen::MatrixXi & F)
+{
+  frames.clear();
+  times.clear();
+
+  int number = file_exists(frame_path(pattern, 0)) ? 0 : 1;
+  for (; file_exists(frame_path(pattern, number)); number++) {
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi frame_F;
+    const std::string path = frame_path(pattern, number);
+    if (!read_obj(path, V, frame_F))
+      return false;
+    if (frames.empty()) {
+      F = frame_F;
+    } else if (V.rows() != frames[0].rows() ||
+               frame_F.rows() != F.rows() || frame_F != F) {
+      std::cerr << "Error: " << path << " does not match the topology of the first frame" << std::endl;
+      frames.clear();
+      times.clear();
+      return false;
+    }
+    times.push_back(frames.size() / frames_per_second);
+    frames.push_back(std::move(V));
+  }
+  return !frames.empty();
+}
+
+void MeshAnimation::sample(const double time, Eigen::MatrixXd & V) const
+{
+  if (frames.size() == 1 || duration() <= 0) {
+    V = frames.front();
+    return;
+  }
+
+  double t = time;
+  if (loop) {
+    t = std::fmod(t, duration());
+    if (t < 0) t += duration();
+  }
+  t = std::clamp(t, times.front(), times.back());
+
+  // Keyframe k is the last one at or before t
+  const int k = std::min<int>(
+    std::upper_bound(times.begin(), times.end(), t) - times.begin() - 1,
+    frames.size() - 2);
+  if (!interpolate) {
+    V = frames[t >= times[k + 1] ? k + 1 : k];
+    return;
+  }
+  const double alpha = (t - times[k]) / (times[k + 1] - times[k]);
+  V = (1.0 - alpha) * frames[k] + alpha * frames[k + 1];
+}
@@ -0,0 +1,58 @@
+#include "SceneLoader.h"
+#include "TraceZones.h"
+#include <iostream>
+
+SceneLoader::~SceneLoader() {
+    cancel();
+    if (worker.joinable()) worker.join();
+}
+
+void SceneLoader::load(const SceneLoadRequest& request) {
+    cancel();
+    if (worker.joinable()) worker.join();
+    // A scene finished by the cancelled load must not be taken afterwards
+    std::atomic_store(&result, std::shared_ptr<Scene>());
+
+    current_progress = std::make_shared<LoadProgress>();
+    current_filename = request.filename;
+    running.store(true, std::memory_order_release);
+    worker = std::thread([this, request, progress = current_progress] {
+        TRACE_THREAD_NAME("scene loader");
+        TRACE_ZONE("SceneLoader::load");
+        std::cout << "Loading: " << request.filename << std::endl;
+
+        auto scene = std::make_shared<Scene>();
+        scene->bvh_options = request.bvh_options;
+        scene->use_cache = request.use_cache;
+        scene->cache_dir = request.cache_dir;
+        scene->progress = progress.get();
+        if (request.filename.find('%') != std::string::npos) {
+            scene->load_animation(request.filename, request.animation_fps);
+        } else {
+            scene->load_mesh(request.filename);
+        }
+        // The scene outlives this load's progress
+        scene->progress = nullptr;
+
+        if (progress->cancelled()) {
+            progress->stage = LoadStage::CANCELLED;
+            std::cout << "Cancelled loading " << request.filename << std::endl;
+        } else if (scene->bvh.empty()) {
+            progress->stage = LoadStage::FAILED;
+            std::cerr << "Failed to load model or model is empty." << std::endl;
+        } else {
+            progress->stage = LoadStage::DONE;
+            std::atomic_store(&result, scene);
+        }
+        running.store(false, std::memory_order_release);
+    });
+}
+
+void SceneLoader::cancel() {
+    if (loading()) current_progress->cancel();
+}
+
+std::shared_ptr<Scene> SceneLoader::take() {
+    if (!std::atomic_load(&result)) return nullptr;
+    return std::atomic_exchange(&result, std::shared_ptr<Scene>());
+}
@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+#include "TraceZones.h"
+#include <algorithm>
+#include <string>
+
+namespace {
+    // Pool and deque index of the calling worker thread
+    thread_local const ThreadPool* current_pool = nullptr;
+    thread_local int current_index = -1;
+}
+
+ThreadPool::ThreadPool(int num_threads)
+    : queued(0)
+    , stopping(false)
+{
+    if (num_threads <= 0) {
+        num_threads = hardware_threads();
+    }
+    for (int i = 0; i < num_threads; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 1; i < num_threads; i++) {
+        workers.emplace_back([this, i] { worker_loop(i - 1); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::hardware_threads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+int ThreadPool::queue_index() const {
+    return current_pool == this ? current_index : static_cast<int>(workers.size());
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    WorkQueue& queue = *queues[queue_index()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    queued.fetch_add(1);
+    // Taking the lock orders the increment before a sleeping worker's check
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    condition.notify_one();
+}
+
+bool ThreadPool::pop_task(int index, std::function<void()>& task) {
+    if (queued.load() == 0) return false;
+    {
+        WorkQueue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    const int num_queues = static_cast<int>(queues.size());
+    for (int k = 1; k < num_queues; k++) {
+        WorkQueue& victim = *queues[(index + k) % num_queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_pending_task() {
+    std::function<void()> task;
+    if (!pop_task(queue_index(), task)) return false;
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(int index) {
+    current_pool = this;
+    current_index = index;
+    TRACE_THREAD_NAME("pool worker " + std::to_string(index + 1));
+    while (true) {
+        std::function<void()> task;
+        if (pop_task(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        condition.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) return;
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, int grain,
+                              const std::function<void(int, int)>& fn) {
+    if (end <= begin) return;
+    const int n = end - begin;
+    // A few chunks per thread so uneven chunks balance out
+    const int num_chunks = std::max(1, std::min(n / std::max(grain, 1), 4 * size()));
+    if (num_chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    TaskGroup group(*this);
+    for (int c = 0; c < num_chunks; c++) {
+        const int chunk_begin = begin + static_cast<int>(static_cast<long long>(n) * c / num_chunks);
+        const int chunk_end = begin + static_cast<int>(static_cast<long long>(n) * (c + 1) / num_chunks);
+        group.run([&fn, chunk_begin, chunk_end] { fn(chunk_begin, chunk_end); });
+    }
+    group.wait();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    pending.fetch_add(1, std::memory_order_relaxed);
+    pool.submit([this, task = std::move(task)] {
+        task();
+        pending.fetch_sub(1, std::memory_order_release);
+    });
+}
+
+void TaskGroup::wait() {
+    while (pending.load(std::memory_order_acquire) > 0) {
+        if (!pool.run_pending_task()) {
+            std::this_thread::yield();
+        }
+    }
+}
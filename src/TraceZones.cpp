@@ -0,0 +1,158 @@
+#include "TraceZones.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    struct TraceEvent {
+        const char* name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    // Ring buffer of one thread. Only its thread appends; the mutex is
+    // uncontended except while write_chrome_trace reads the buffer.
+    struct ThreadTrace {
+        static constexpr size_t CAPACITY = 1 << 16;
+
+        std::mutex mutex;
+        int id = 0;
+        std::string name;
+        std::vector<TraceEvent> events;
+        // Events ever appended (the newest min(count, CAPACITY) are kept)
+        uint64_t count = 0;
+    };
+
+    std::atomic<bool> recording(false);
+
+    // Buffers of every thread that recorded a zone, kept after the thread
+    // exits so its events can still be written
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<ThreadTrace>> registry;
+
+    std::chrono::steady_clock::time_point epoch() {
+        static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return start;
+    }
+
+    // Nanoseconds since the first zone, at least 1 (0 marks unrecorded zones)
+    uint64_t now_ns() {
+        const auto elapsed = std::chrono::steady_clock::now() - epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() + 1;
+    }
+
+    ThreadTrace& thread_trace() {
+        thread_local std::shared_ptr<ThreadTrace> trace;
+        if (!trace) {
+            trace = std::make_shared<ThreadTrace>();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            trace->id = static_cast<int>(registry.size()) + 1;
+            registry.push_back(trace);
+        }
+        return *trace;
+    }
+
+    // `text` as the contents of a JSON string
+    void write_json_string(FILE* file, const char* text) {
+        std::fputc('"', file);
+        for (const char* c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                std::fputc('\\', file);
+                std::fputc(*c, file);
+            } else if (static_cast<unsigned char>(*c) < 0x20) {
+                std::fprintf(file, "\\u%04x", *c);
+            } else {
+                std::fputc(*c, file);
+            }
+        }
+        std::fputc('"', file);
+    }
+}
+
+void set_trace_recording(bool enabled) {
+    epoch();
+    recording.store(enabled, std::memory_order_relaxed);
+}
+
+bool trace_recording() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+void set_trace_thread_name(const std::string& name) {
+    ThreadTrace& trace = thread_trace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.name = name;
+}
+
+TraceZone::TraceZone(const char* name, bool active)
+    : name(name)
+    , start_ns(active && recording.load(std::memory_order_relaxed) ? now_ns() : 0)
+{
+}
+
+void TraceZone::end() {
+    if (start_ns == 0) return;
+    const uint64_t end_ns = now_ns();
+    ThreadTrace& trace = thread_trace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    const TraceEvent event = {name, start_ns, end_ns};
+    if (trace.events.size() < ThreadTrace::CAPACITY) {
+        trace.events.push_back(event);
+    } else {
+        trace.events[trace.count % ThreadTrace::CAPACITY] = event;
+    }
+    trace.count++;
+    start_ns = 0;
+}
+
+size_t trace_event_count() {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    size_t count = 0;
+    for (const auto& trace : registry) {
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        count += trace->events.size();
+    }
+    return count;
+}
+
+bool write_chrome_trace(const std::string& filename) {
+    FILE* file = std::fopen(filename.c_str(), "w");
+    if (!file) return false;
+
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    auto separator = [&] {
+        if (!first) std::fprintf(file, ",\n");
+        first = false;
+    };
+    for (const auto& trace : registry) {
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        if (!trace->name.empty()) {
+            separator();
+            std::fprintf(file, "{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", "
+                               "\"args\": {\"name\": ", trace->id);
+            write_json_string(file, trace->name.c_str());
+            std::fprintf(file, "}}");
+        }
+        // Oldest first: once the ring wrapped, it starts at the next slot
+        const size_t size = trace->events.size();
+        const size_t first_event = size < ThreadTrace::CAPACITY ? 0 : trace->count % size;
+        for (size_t k = 0; k < size; k++) {
+            const TraceEvent& event = trace->events[(first_event + k) % size];
+            separator();
+            std::fprintf(file, "{\"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"name\": ", trace->id);
+            write_json_string(file, event.name);
+            // Microseconds
+            std::fprintf(file, ", \"ts\": %.3f, \"dur\": %.3f}",
+                         event.start_ns * 1e-3, (event.end_ns - event.start_ns) * 1e-3);
+        }
+        trace->events.clear();
+        trace->count = 0;
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
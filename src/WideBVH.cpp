@@ -0,0 +1,690 @@
+#include "WideBVH.h"
+#include "insert_box_into_box.h"
+#include "parallel_refit.h"
+#include "ray_intersect_triangle_block.h"
+#include "MeshTriangle.h"
+#include "TraceZones.h"
+#include "TraversalStats.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define WIDE_BVH_SSE 1
+#endif
+#if defined(__AVX__)
+#define WIDE_BVH_AVX 1
+#endif
+
+namespace
+{
+  // Index of the lowest set bit of a non-zero mask
+  inline int lowest_set_bit(const unsigned mask)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+  // Order the `count` child indices of `order` by decreasing key[i], so
+  // pushing them in turn leaves the nearest child on top. Insertion sort:
+  // a node has at most 8 children.
+  inline void sort_far_to_near(int * order, const int count, const float * key)
+  {
+    for (int k = 1; k < count; k++) {
+      const int child = order[k];
+      int j = k;
+      for (; j > 0 && key[order[j - 1]] < key[child]; j--)
+        order[j] = order[j - 1];
+      order[j] = child;
+    }
+  }
+
+  float binary_node_area(const LinearBVHNode & node)
+  {
+    const float dx = node.max_corner[0] - node.min_corner[0];
+    const float dy = node.max_corner[1] - node.min_corner[1];
+    const float dz = node.max_corner[2] - node.min_corner[2];
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+  }
+
+  // Collapse the binary subtree rooted at `binary_index` into a wide node and
+  // return its index in wide.nodes.
+  template <int N>
+  int collapse_recursive(
+    const LinearBVH & binary,
+    const int binary_index,
+    const int depth,
+    WideBVH<N> & wide)
+  {
+    wide.max_depth = std::max(wide.max_depth, depth);
+    const int wide_index = wide.nodes.size();
+    wide.nodes.emplace_back();
+
+    // Open up the largest internal child until there are N children
+    std::vector<int> children;
+    const LinearBVHNode & root = binary.nodes[binary_index];
+    if (root.count > 0) {
+      children.push_back(binary_index);
+    } else {
+      children.push_back(binary_index + 1);
+      children.push_back(root.offset);
+    }
+    while ((int)children.size() < N) {
+      int best = -1;
+      float best_area = -1;
+      for (int i = 0; i < (int)children.size(); i++) {
+        const LinearBVHNode & node = binary.nodes[children[i]];
+        if (node.count == 0 && binary_node_area(node) > best_area) {
+          best = i;
+          best_area = binary_node_area(node);
+        }
+      }
+      if (best < 0)
+        break;
+      const int opened = children[best];
+      children[best] = opened + 1;
+      children.push_back(binary.nodes[opened].offset);
+    }
+
+    // Fill slots; recursing may reallocate wide.nodes so write via index
+    for (int i = 0; i < N; i++) {
+      WideBVHNode<N> & node = wide.nodes[wide_index];
+      if (i >= (int)children.size()) {
+        for (int k = 0; k < 3; k++) {
+          node.bounds[k][i] = std::numeric_limits<float>::infinity();
+          node.bounds[k + 3][i] = -std::numeric_limits<float>::infinity();
+        }
+        node.child[i] = -1;
+        node.count[i] = 0;
+        continue;
+      }
+      const LinearBVHNode & source = binary.nodes[children[i]];
+      for (int k = 0; k < 3; k++) {
+        node.bounds[k][i] = source.min_corner[k];
+        node.bounds[k + 3][i] = source.max_corner[k];
+      }
+      if (source.count > 0) {
+        node.child[i] = source.offset;
+        node.count[i] = source.count;
+      } else {
+        node.count[i] = 0;
+        const int child = collapse_recursive(binary, children[i], depth + 1, wide);
+        wide.nodes[wide_index].child[i] = child;
+      }
+    }
+    return wide_index;
+  }
+
+  // Store the current corners of a MeshTriangle in a block lane
+  void bake_triangle(
+    const Object * primitive,
+    const int id,
+    TriangleBlock & block,
+    const int lane)
+  {
+    const MeshTriangle * tri = static_cast<const MeshTriangle *>(primitive);
+    block.set(
+      lane,
+      tri->V.row(tri->F(tri->f, 0)),
+      tri->V.row(tri->F(tri->f, 1)),
+      tri->V.row(tri->F(tri->f, 2)),
+      id);
+  }
+
+  // Ray data shared by all box tests of one traversal
+  struct WideRay
+  {
+    float origin[3];
+    // Origin rounded to float towards the side that can only lower the
+    // near-plane (raise the far-plane) distances, so the slab test stays
+    // conservative for the double-precision ray
+    float origin_near[3];
+    float origin_far[3];
+    float inv_direction[3];
+    // Offsets into WideBVHNode::bounds of the near and far plane per axis
+    int near_plane[3];
+    int far_plane[3];
+  };
+
+  inline WideRay make_wide_ray(const PreparedRay & ray)
+  {
+    WideRay r;
+    for (int a = 0; a < 3; a++) {
+      const double o = ray.ray.origin[a];
+      r.origin[a] = static_cast<float>(o);
+      const float o_up = r.origin[a] >= o
+        ? r.origin[a] : std::nextafter(r.origin[a], std::numeric_limits<float>::infinity());
+      const float o_down = r.origin[a] <= o
+        ? r.origin[a] : std::nextafter(r.origin[a], -std::numeric_limits<float>::infinity());
+      r.origin_near[a] = ray.is_negative[a] ? o_down : o_up;
+      r.origin_far[a] = ray.is_negative[a] ? o_up : o_down;
+      r.inv_direction[a] = static_cast<float>(ray.inv_direction[a]);
+      r.near_plane[a] = ray.is_negative[a] ? a + 3 : a;
+      r.far_plane[a] = ray.is_negative[a] ? a : a + 3;
+    }
+    return r;
+  }
+
+  // Slab test of a ray against the N child boxes of a node. The far distance
+  // is padded by a few ulps to absorb the rounding of the subtraction and
+  // product.
+  //
+  // Outputs:
+  //   t_near  entry distance of every child (valid for hit children)
+  // Returns bitmask of the children hit within [min_t, max_t]
+  template <int N>
+  inline unsigned intersect_children(
+    const WideBVHNode<N> & node,
+    const WideRay & r,
+    const float min_t,
+    const float max_t,
+    float * t_near)
+  {
+    const float pad = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+    unsigned mask = 0;
+    for (int i = 0; i < N; i++) {
+      float t0 = min_t;
+      float t1 = max_t;
+      for (int a = 0; a < 3; a++) {
+        const float tn = (node.bounds[r.near_plane[a]][i] - r.origin_near[a]) * r.inv_direction[a];
+        const float tf = (node.bounds[r.far_plane[a]][i] - r.origin_far[a]) * r.inv_direction[a] * pad;
+        t0 = tn > t0 ? tn : t0;
+        t1 = tf < t1 ? tf : t1;
+      }
+      t_near[i] = t0;
+      mask |= (t0 <= t1 ? 1u : 0u) << i;
+    }
+    return mask;
+  }
+
+#ifdef WIDE_BVH_SSE
+  template <>
+  inline unsigned intersect_children<4>(
+    const WideBVHNode<4> & node,
+    const WideRay & r,
+    const float min_t,
+    const float max_t,
+    float * t_near)
+  {
+    const __m128 pad = _mm_set1_ps(1.0f + 4.0f * std::numeric_limits<float>::epsilon());
+    __m128 t0 = _mm_set1_ps(min_t);
+    __m128 t1 = _mm_set1_ps(max_t);
+    for (int a = 0; a < 3; a++) {
+      const __m128 o_near = _mm_set1_ps(r.origin_near[a]);
+      const __m128 o_far = _mm_set1_ps(r.origin_far[a]);
+      const __m128 inv = _mm_set1_ps(r.inv_direction[a]);
+      const __m128 tn = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[r.near_plane[a]]), o_near), inv);
+      const __m128 tf = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[r.far_plane[a]]), o_far), inv), pad);
+      // max/min return the second operand when the first is NaN
+      t0 = _mm_max_ps(tn, t0);
+      t1 = _mm_min_ps(tf, t1);
+    }
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+  }
+#endif
+
+#ifdef WIDE_BVH_AVX
+  template <>
+  inline unsigned intersect_children<8>(
+    const WideBVHNode<8> & node,
+    const WideRay & r,
+    const float min_t,
+    const float max_t,
+    float * t_near)
+  {
+    const __m256 pad = _mm256_set1_ps(1.0f + 4.0f * std::numeric_limits<float>::epsilon());
+    __m256 t0 = _mm256_set1_ps(min_t);
+    __m256 t1 = _mm256_set1_ps(max_t);
+    for (int a = 0; a < 3; a++) {
+      const __m256 o_near = _mm256_set1_ps(r.origin_near[a]);
+      const __m256 o_far = _mm256_set1_ps(r.origin_far[a]);
+      const __m256 inv = _mm256_set1_ps(r.inv_direction[a]);
+      const __m256 tn = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[r.near_plane[a]]), o_near), inv);
+      const __m256 tf = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[r.far_plane[a]]), o_far), inv), pad);
+      t0 = _mm256_max_ps(tn, t0);
+      t1 = _mm256_min_ps(tf, t1);
+    }
+    _mm256_storeu_ps(t_near, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+  }
+#endif
+}
+
+template <int N>
+WideBVH<N>::WideBVH(const LinearBVH & bvh)
+: primitives(bvh.primitives),
+  primitive_indices(bvh.primitive_indices)
+{
+  if (bvh.empty())
+    return;
+  TRACE_ZONE("WideBVH collapse");
+  nodes.reserve(bvh.nodes.size() / (N - 1) + 1);
+  collapse_recursive(bvh, 0, 0, *this);
+  nodes.shrink_to_fit();
+
+  for (const Object * primitive : primitives) {
+    if (!dynamic_cast<const MeshTriangle *>(primitive))
+      return;
+  }
+  // Re-point leaves from primitive ranges to block ranges
+  for (WideBVHNode<N> & node : nodes.owned()) {
+    for (int c = 0; c < N; c++) {
+      if (node.count[c] == 0)
+        continue;
+      const int first_block = blocks.size();
+      const int num_blocks =
+        (node.count[c] + TriangleBlock::WIDTH - 1) / TriangleBlock::WIDTH;
+      blocks.resize(first_block + num_blocks);
+      for (int i = 0; i < node.count[c]; i++) {
+        const int p = node.child[c] + i;
+        bake_triangle(primitives[p], p,
+          blocks[first_block + i / TriangleBlock::WIDTH], i % TriangleBlock::WIDTH);
+      }
+      node.child[c] = first_block;
+      node.count[c] = num_blocks;
+    }
+  }
+}
+
+template <int N>
+size_t WideBVH<N>::memory_bytes() const
+{
+  return nodes.capacity() * sizeof(WideBVHNode<N>) +
+    primitives.capacity() * sizeof(const Object *) +
+    primitive_indices.capacity() * sizeof(int) +
+    blocks.capacity() * sizeof(TriangleBlock);
+}
+
+template <int N>
+void WideBVH<N>::refit(ThreadPool & pool)
+{
+  // Own nodes and blocks (copying mapped ones) before the threads write them
+  std::vector<WideBVHNode<N> > & nodes = this->nodes.owned();
+  std::vector<TriangleBlock> & blocks = this->blocks.owned();
+  parallel_refit(
+    pool,
+    nodes.size(),
+    [&](const int i, std::vector<int> & kids) {
+      for (int c = 0; c < N; c++) {
+        if (nodes[i].count[c] == 0 && nodes[i].child[c] >= 0)
+          kids.push_back(nodes[i].child[c]);
+      }
+    },
+    [&](const int i) {
+      WideBVHNode<N> & node = nodes[i];
+      for (int c = 0; c < N; c++) {
+        if (node.child[c] < 0)
+          continue;
+        float lo[3] = {
+          std::numeric_limits<float>::infinity(),
+          std::numeric_limits<float>::infinity(),
+          std::numeric_limits<float>::infinity()};
+        float hi[3] = {-lo[0], -lo[1], -lo[2]};
+        if (node.count[c] > 0) {
+          BoundingBox box;
+          if (blocks.empty()) {
+            for (int p = node.child[c]; p < node.child[c] + node.count[c]; p++) {
+              insert_box_into_box(primitives[p]->box, box);
+            }
+          } else {
+            for (int b = node.child[c]; b < node.child[c] + node.count[c]; b++) {
+              for (int lane = 0; lane < TriangleBlock::WIDTH; lane++) {
+                const int p = blocks[b].id[lane];
+                if (p < 0)
+                  continue;
+                insert_box_into_box(primitives[p]->box, box);
+                bake_triangle(primitives[p], p, blocks[b], lane);
+              }
+            }
+          }
+          LinearBVHNode rounded;
+          rounded.set_box(box);
+          for (int k = 0; k < 3; k++) {
+            lo[k] = rounded.min_corner[k];
+            hi[k] = rounded.max_corner[k];
+          }
+        } else {
+          const WideBVHNode<N> & child = nodes[node.child[c]];
+          for (int g = 0; g < N; g++) {
+            for (int k = 0; k < 3; k++) {
+              lo[k] = std::min(lo[k], child.bounds[k][g]);
+              hi[k] = std::max(hi[k], child.bounds[k + 3][g]);
+            }
+          }
+        }
+        for (int k = 0; k < 3; k++) {
+          node.bounds[k][c] = lo[k];
+          node.bounds[k + 3][c] = hi[k];
+        }
+      }
+      return 0.0;
+    });
+}
+
+namespace
+{
+  // Traversal shared by all single-ray queries; candidate leaf objects are
+  // tested with leaf_ray (a Ray or the PreparedRay itself). With any_hit it
+  // returns at the first object hit, leaving hit_record unset.
+  template <bool any_hit, int N, typename RayType>
+  bool traverse(
+    const WideBVH<N> & bvh,
+    const PreparedRay & ray,
+    const RayType & leaf_ray,
+    const double min_t,
+    const double max_t,
+    HitRecord & hit_record)
+  {
+    if (bvh.nodes.empty())
+      return false;
+    const WideBVHNode<N> * nodes = bvh.nodes.data();
+    const TriangleBlock * blocks = bvh.blocks.data();
+    const bool baked = !bvh.blocks.empty();
+    const std::vector<const Object *> & primitives = bvh.primitives;
+    const int * primitive_indices = bvh.primitive_indices.data();
+    const int max_depth = bvh.max_depth;
+
+    const WideRay r = make_wide_ray(ray);
+
+    struct StackEntry
+    {
+      int node;
+      float t;
+    };
+    // Every visited node pushes at most N-1 more entries than it pops
+    StackEntry fixed_stack[256];
+    std::vector<StackEntry> dynamic_stack;
+    StackEntry * stack = fixed_stack;
+    const int stack_capacity = (max_depth + 1) * (N - 1) + 1;
+    if (stack_capacity > 256) {
+      dynamic_stack.resize(stack_capacity);
+      stack = dynamic_stack.data();
+    }
+    int stack_size = 0;
+    stack[stack_size++] = {0, static_cast<float>(min_t)};
+
+    bool hit = false;
+    double closest = max_t;
+    HitRecord candidate;
+    const float min_t_f = static_cast<float>(min_t);
+    const float direction_f[3] = {
+      static_cast<float>(ray.ray.direction[0]),
+      static_cast<float>(ray.ray.direction[1]),
+      static_cast<float>(ray.ray.direction[2])};
+    alignas(32) float t_near[N];
+
+    while (stack_size > 0) {
+      const StackEntry entry = stack[--stack_size];
+      if (entry.t > closest)
+        continue;
+      const WideBVHNode<N> & node = nodes[entry.node];
+      TRAVERSAL_STATS_ADD(nodes_visited, 1);
+      TRAVERSAL_STATS_ADD(box_tests, N);
+      unsigned mask = intersect_children(
+        node, r, min_t_f, static_cast<float>(closest), t_near);
+
+      // Intersect leaf children right away; collect internal ones
+      int order[N];
+      int num_internal = 0;
+      while (mask) {
+        const int i = lowest_set_bit(mask);
+        mask &= mask - 1;
+        if (node.count[i] > 0 && baked) {
+          // Float SIMD filter, then the exact test on the few candidates
+          for (int b = node.child[i]; b < node.child[i] + node.count[i]; b++) {
+            TRAVERSAL_STATS_ADD(triangle_tests, TriangleBlock::WIDTH);
+            unsigned candidates = ray_intersect_triangle_block(
+              blocks[b], r.origin, direction_f, min_t_f, static_cast<float>(closest));
+            while (candidates) {
+              const int p = blocks[b].id[lowest_set_bit(candidates)];
+              candidates &= candidates - 1;
+              if (any_hit) {
+                if (primitives[p]->ray_occluded(leaf_ray, min_t, max_t))
+                  return true;
+                continue;
+              }
+              if (primitives[p]->ray_intersect(leaf_ray, min_t, closest, candidate)) {
+                hit = true;
+                closest = candidate.t;
+                hit_record = candidate;
+                hit_record.primitive = primitive_indices[p];
+              }
+            }
+          }
+        } else if (node.count[i] > 0) {
+          for (int p = node.child[i]; p < node.child[i] + node.count[i]; p++) {
+            if (any_hit) {
+              if (primitives[p]->ray_occluded(leaf_ray, min_t, max_t))
+                return true;
+              continue;
+            }
+            if (primitives[p]->ray_intersect(leaf_ray, min_t, closest, candidate)) {
+              hit = true;
+              closest = candidate.t;
+              hit_record = candidate;
+              hit_record.primitive = primitive_indices[p];
+            }
+          }
+        } else {
+          order[num_internal++] = i;
+        }
+      }
+
+      // Push far to near so the nearest child is popped first (any order
+      // will do for any_hit, which never shrinks closest)
+      if (!any_hit)
+        sort_far_to_near(order, num_internal, t_near);
+      for (int k = 0; k < num_internal; k++) {
+        stack[stack_size++] = {node.child[order[k]], t_near[order[k]]};
+      }
+    }
+
+    return hit;
+  }
+}
+
+template <int N>
+bool WideBVH<N>::ray_intersect(
+  const Ray & ray,
+  const double min_t,
+  const double max_t,
+  HitRecord & hit) const
+{
+  return traverse<false>(*this, PreparedRay(ray), ray, min_t, max_t, hit);
+}
+
+template <int N>
+bool WideBVH<N>::ray_intersect(
+  const PreparedRay & ray,
+  const double min_t,
+  const double max_t,
+  HitRecord & hit) const
+{
+  return traverse<false>(*this, ray, ray, min_t, max_t, hit);
+}
+
+template <int N>
+bool WideBVH<N>::ray_occluded(
+  const Ray & ray,
+  const double min_t,
+  const double max_t) const
+{
+  HitRecord hit;
+  return traverse<true>(*this, PreparedRay(ray), ray, min_t, max_t, hit);
+}
+
+template <int N>
+bool WideBVH<N>::ray_occluded(
+  const PreparedRay & ray,
+  const double min_t,
+  const double max_t) const
+{
+  HitRecord hit;
+  return traverse<true>(*this, ray, ray, min_t, max_t, hit);
+}
+
+template <int N>
+unsigned WideBVH<N>::ray_intersect_packet(
+  const RayPacket & packet,
+  const double min_t,
+  const double max_t,
+  HitRecord * hits) const
+{
+  if (nodes.empty() || packet.size == 0)
+    return 0;
+
+  WideRay r[RAY_PACKET_MAX_SIZE];
+  float direction_f[RAY_PACKET_MAX_SIZE][3];
+  double closest[RAY_PACKET_MAX_SIZE];
+  for (int k = 0; k < packet.size; k++) {
+    r[k] = make_wide_ray(packet.rays[k]);
+    for (int a = 0; a < 3; a++)
+      direction_f[k][a] = static_cast<float>(packet.rays[k].ray.direction[a]);
+    closest[k] = max_t;
+  }
+  const float min_t_f = static_cast<float>(min_t);
+
+  struct StackEntry
+  {
+    int node;
+    unsigned rays;
+  };
+  StackEntry fixed_stack[256];
+  std::vector<StackEntry> dynamic_stack;
+  StackEntry * stack = fixed_stack;
+  const int stack_capacity = (max_depth + 1) * (N - 1) + 1;
+  if (stack_capacity > 256) {
+    dynamic_stack.resize(stack_capacity);
+    stack = dynamic_stack.data();
+  }
+  int stack_size = 0;
+  stack[stack_size++] = {0, packet.all()};
+
+  unsigned hit = 0;
+  HitRecord candidate;
+  alignas(32) float t_near[N];
+
+  // Test ray k against the objects of leaf child i
+  auto intersect_leaf = [&](const WideBVHNode<N> & node, const int i, const int k) {
+    if (!blocks.empty()) {
+      for (int b = node.child[i]; b < node.child[i] + node.count[i]; b++) {
+        TRAVERSAL_STATS_ADD(triangle_tests, TriangleBlock::WIDTH);
+        unsigned candidates = ray_intersect_triangle_block(
+          blocks[b], r[k].origin, direction_f[k], min_t_f, static_cast<float>(closest[k]));
+        while (candidates) {
+          const int p = blocks[b].id[lowest_set_bit(candidates)];
+          candidates &= candidates - 1;
+          if (primitives[p]->ray_intersect(packet.rays[k], min_t, closest[k], candidate)) {
+            hit |= 1u << k;
+            closest[k] = candidate.t;
+            hits[k] = candidate;
+            hits[k].primitive = primitive_indices[p];
+          }
+        }
+      }
+    } else {
+      for (int p = node.child[i]; p < node.child[i] + node.count[i]; p++) {
+        if (primitives[p]->ray_intersect(packet.rays[k], min_t, closest[k], candidate)) {
+          hit |= 1u << k;
+          closest[k] = candidate.t;
+          hits[k] = candidate;
+          hits[k].primitive = primitive_indices[p];
+        }
+      }
+    }
+  };
+
+  while (stack_size > 0) {
+    const StackEntry entry = stack[--stack_size];
+    const WideBVHNode<N> & node = nodes[entry.node];
+    TRAVERSAL_STATS_ADD(nodes_visited, 1);
+
+    double max_t_lo = std::numeric_limits<double>::infinity();
+    double max_t_hi = -std::numeric_limits<double>::infinity();
+    int num_rays = 0;
+    for (unsigned m = entry.rays; m; m &= m - 1) {
+      const int k = lowest_set_bit(m);
+      max_t_lo = std::min(max_t_lo, closest[k]);
+      max_t_hi = std::max(max_t_hi, closest[k]);
+      num_rays++;
+    }
+
+    // Rays hitting each child and the nearest distance at which one enters
+    // it. The frustum decides children for the whole packet when it can;
+    // the rest get one SIMD test of all children per ray. Packets down to a
+    // couple of rays skip the frustum and go straight to the per-ray tests.
+    unsigned child_rays[N];
+    float child_t[N];
+    unsigned undecided = 0;
+    for (int i = 0; i < N; i++) {
+      child_rays[i] = 0;
+      child_t[i] = std::numeric_limits<float>::infinity();
+      if (node.child[i] < 0)
+        continue;
+      if (num_rays <= 2) {
+        undecided |= 1u << i;
+        continue;
+      }
+      const float lo[3] = {node.bounds[0][i], node.bounds[1][i], node.bounds[2][i]};
+      const float hi[3] = {node.bounds[3][i], node.bounds[4][i], node.bounds[5][i]};
+      double t_enter;
+      TRAVERSAL_STATS_ADD(box_tests, 1);
+      const RayPacket::BoxHit box_hit =
+        packet.classify_box(lo, hi, min_t, max_t_lo, max_t_hi, t_enter);
+      if (box_hit == RayPacket::BoxHit::ALL) {
+        child_rays[i] = entry.rays;
+        child_t[i] = static_cast<float>(t_enter);
+      } else if (box_hit == RayPacket::BoxHit::SOME) {
+        undecided |= 1u << i;
+      }
+    }
+    if (undecided) {
+      for (unsigned m = entry.rays; m; m &= m - 1) {
+        const int k = lowest_set_bit(m);
+        TRAVERSAL_STATS_ADD(box_tests, N);
+        unsigned mask = intersect_children(
+          node, r[k], min_t_f, static_cast<float>(closest[k]), t_near) & undecided;
+        for (; mask; mask &= mask - 1) {
+          const int i = lowest_set_bit(mask);
+          child_rays[i] |= 1u << k;
+          child_t[i] = std::min(child_t[i], t_near[i]);
+        }
+      }
+    }
+
+    int order[N];
+    int num_internal = 0;
+    for (int i = 0; i < N; i++) {
+      if (!child_rays[i])
+        continue;
+      if (node.count[i] > 0) {
+        for (unsigned m = child_rays[i]; m; m &= m - 1)
+          intersect_leaf(node, i, lowest_set_bit(m));
+      } else {
+        order[num_internal++] = i;
+      }
+    }
+
+    // Push far to near so the nearest child is popped first
+    sort_far_to_near(order, num_internal, child_t);
+    for (int k = 0; k < num_internal; k++) {
+      const int i = order[k];
+      stack[stack_size++] = {node.child[i], child_rays[i]};
+    }
+  }
+
+  return hit;
+}
+
+template struct WideBVH<4>;
+template struct WideBVH<8>;
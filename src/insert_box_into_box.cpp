@@ -1,8 +1,10 @@
 #include "insert_box_into_box.h"
+#include <algorithm>
 
+template <typename Scalar>
 void insert_box_into_box(
-  const BoundingBox & A,
-  BoundingBox & B)
+  const BoundingBoxT<Scalar> & A,
+  BoundingBoxT<Scalar> & B)
 {
   for (int i = 0; i < 3; i++) {
     B.min_corner[i] = std::min(B.min_corner[i], A.min_corner[i]);
@@ -10,3 +12,6 @@ void insert_box_into_box(
   }
 }
 
+// Explicit template instantiations
+template void insert_box_into_box<double>(const BoundingBox &, BoundingBox &);
+template void insert_box_into_box<float>(const BoundingBoxf &, BoundingBoxf &);
@@ -1,10 +1,12 @@
 #include "insert_triangle_into_box.h"
+#include <algorithm>
 
+template <typename Scalar>
 void insert_triangle_into_box(
-  const Eigen::RowVector3d & a,
-  const Eigen::RowVector3d & b,
-  const Eigen::RowVector3d & c,
-  BoundingBox & B)
+  const Eigen::Matrix<Scalar, 1, 3> & a,
+  const Eigen::Matrix<Scalar, 1, 3> & b,
+  const Eigen::Matrix<Scalar, 1, 3> & c,
+  BoundingBoxT<Scalar> & B)
 {
   for (int i = 0; i < 3; i++) {
     B.min_corner[i] = std::min({B.min_corner[i], a[i], b[i], c[i]});
@@ -12,4 +14,10 @@ void insert_triangle_into_box(
   }
 }
 
-
+// Explicit template instantiations
+template void insert_triangle_into_box<double>(
+  const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  const Eigen::RowVector3d &, BoundingBox &);
+template void insert_triangle_into_box<float>(
+  const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  const Eigen::RowVector3f &, BoundingBoxf &);
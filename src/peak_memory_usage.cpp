@@ -0,0 +1,23 @@
+#include "peak_memory_usage.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+size_t peak_memory_usage()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  // bytes on macOS
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  // kilobytes on Linux
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
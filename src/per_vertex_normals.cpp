@@ -1,40 +1,119 @@
 #include "per_vertex_normals.h"
 #include "triangle_area_normal.h"
-#include "vertex_triangle_adjacency.h"
-#include <vector>
+#include <algorithm>
 
-void per_vertex_normals(
-  const Eigen::MatrixXd & V,
-  const Eigen::MatrixXi & F,
-  Eigen::MatrixXd & N)
+namespace
 {
-  N = Eigen::MatrixXd::Zero(V.rows(), 3);
+  // Faces or vertices per parallel_for task, and per thread of the pool the
+  // adjacency-free version creates
+  const int grain = 4096;
+  const int min_faces_per_thread = 16 * grain;
 
-  Eigen::MatrixXd FN;
-  FN.resize(F.rows(), 3);
-  for(int i = 0; i < F.rows(); i++)
+  template <typename Scalar>
+  void face_normals(
+    const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & V,
+    const Eigen::MatrixXi & F,
+    ThreadPool & pool,
+    Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & FN)
   {
-    FN.row(i) = triangle_area_normal(
-      V.row(F(i,0)), V.row(F(i,1)), V.row(F(i,2)));
+    FN.resize(F.rows(), 3);
+    pool.parallel_for(0, F.rows(), grain, [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+      {
+        FN.row(i) = triangle_area_normal<Scalar>(
+          V.row(F(i,0)), V.row(F(i,1)), V.row(F(i,2)));
+      }
+    });
   }
 
-  std::vector<std::vector<int>> VF;
-  vertex_triangle_adjacency(F, V.rows(), VF);
-
-  for (int i = 0; i < V.rows(); ++i)
+  // Normalize the summed face normals in rows [begin, end) of N
+  template <typename Scalar>
+  void normalize_rows(
+    Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & N,
+    const int begin,
+    const int end)
   {
-    Eigen::RowVector3d sum_normal(0, 0, 0);
+    for (int i = begin; i < end; i++)
+    {
+      const Eigen::Matrix<Scalar, 1, 3> sum_normal = N.row(i);
+      if (sum_normal.norm() > Scalar(1e-10))
+      {
+        N.row(i) = sum_normal.normalized();
+      }
+      else
+      {
+        N.row(i).setZero();
+      }
+    }
+  }
+}
+
+template <typename Scalar>
+void per_vertex_normals(
+  const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & V,
+  const Eigen::MatrixXi & F,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & N)
+{
+  using MatrixX = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
 
-    const std::vector<int>& adjacent_faces = VF[i];
+  ThreadPool pool(std::max(1, std::min(
+    static_cast<int>(F.rows() / min_faces_per_thread), ThreadPool::hardware_threads())));
+  MatrixX FN;
+  face_normals(V, F, pool, FN);
 
-    for (int face_index : adjacent_faces)
+  // Scatter in face order: every vertex sums its faces in the same order as
+  // a gather over the (sorted) adjacency would
+  N = MatrixX::Zero(V.rows(), 3);
+  for (int i = 0; i < F.rows(); i++)
+  {
+    for (int k = 0; k < 3; k++)
     {
-      sum_normal += FN.row(face_index);
+      N.row(F(i,k)) += FN.row(i);
     }
+  }
+
+  pool.parallel_for(0, V.rows(), grain, [&](int begin, int end) {
+    normalize_rows(N, begin, end);
+  });
+}
 
-    if (sum_normal.norm() > 1e-10)
+template <typename Scalar>
+void per_vertex_normals(
+  const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & V,
+  const Eigen::MatrixXi & F,
+  const Eigen::VectorXi & VF,
+  const Eigen::VectorXi & NI,
+  ThreadPool & pool,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & FN,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & N)
+{
+  face_normals(V, F, pool, FN);
+
+  N.resize(V.rows(), 3);
+  pool.parallel_for(0, V.rows(), grain, [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
     {
-      N.row(i) = sum_normal.normalized();
+      Eigen::Matrix<Scalar, 1, 3> sum_normal(0, 0, 0);
+      for (int j = NI(i); j < NI(i + 1); j++)
+      {
+        sum_normal += FN.row(VF(j));
+      }
+      N.row(i) = sum_normal;
     }
-  }
-}
\ No newline at end of file
+    normalize_rows(N, begin, end);
+  });
+}
+
+// Explicit template instantiations
+template void per_vertex_normals<double>(
+  const Eigen::MatrixXd &, const Eigen::MatrixXi &, Eigen::MatrixXd &);
+template void per_vertex_normals<float>(
+  const Eigen::MatrixXf &, const Eigen::MatrixXi &, Eigen::MatrixXf &);
+template void per_vertex_normals<double>(
+  const Eigen::MatrixXd &, const Eigen::MatrixXi &,
+  const Eigen::VectorXi &, const Eigen::VectorXi &, ThreadPool &,
+  Eigen::MatrixXd &, Eigen::MatrixXd &);
+template void per_vertex_normals<float>(
+  const Eigen::MatrixXf &, const Eigen::MatrixXi &,
+  const Eigen::VectorXi &, const Eigen::VectorXi &, ThreadPool &,
+  Eigen::MatrixXf &, Eigen::MatrixXf &);
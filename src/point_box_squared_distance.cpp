@@ -0,0 +1,21 @@
+#include "point_box_squared_distance.h"
+#include <algorithm>
+
+template <typename Scalar>
+Scalar point_box_squared_distance(
+  const Eigen::Matrix<Scalar, 1, 3> & query,
+  const BoundingBoxT<Scalar> & box)
+{
+  Scalar sqrd = 0;
+  for (int i = 0; i < 3; i++) {
+    const Scalar d = std::max({box.min_corner[i] - query[i], Scalar(0), query[i] - box.max_corner[i]});
+    sqrd += d * d;
+  }
+  return sqrd;
+}
+
+// Explicit template instantiations
+template double point_box_squared_distance<double>(
+  const Eigen::RowVector3d &, const BoundingBox &);
+template float point_box_squared_distance<float>(
+  const Eigen::RowVector3f &, const BoundingBoxf &);
@@ -0,0 +1,90 @@
+#include "point_triangle_squared_distance.h"
+#include <algorithm>
+
+namespace
+{
+  // Point of the segment [a, b] closest to query
+  template <typename Scalar>
+  Eigen::Matrix<Scalar, 1, 3> closest_point_on_segment(
+    const Eigen::Matrix<Scalar, 1, 3> & query,
+    const Eigen::Matrix<Scalar, 1, 3> & a,
+    const Eigen::Matrix<Scalar, 1, 3> & b)
+  {
+    const Eigen::Matrix<Scalar, 1, 3> ab = b - a;
+    const Scalar length2 = ab.squaredNorm();
+    if (!(length2 > 0))
+      return a;
+    const Scalar s = std::clamp((query - a).dot(ab) / length2, Scalar(0), Scalar(1));
+    return a + s * ab;
+  }
+}
+
+template <typename Scalar>
+void point_triangle_squared_distance(
+  const Eigen::Matrix<Scalar, 1, 3> & query,
+  const Eigen::Matrix<Scalar, 1, 3> & a,
+  const Eigen::Matrix<Scalar, 1, 3> & b,
+  const Eigen::Matrix<Scalar, 1, 3> & c,
+  Scalar & sqrd,
+  Eigen::Matrix<Scalar, 1, 3> & p)
+{
+  using RowVector3 = Eigen::Matrix<Scalar, 1, 3>;
+  const RowVector3 ab = b - a;
+  const RowVector3 ac = c - a;
+
+  // Corner regions, then edge regions, tested with the projections of query
+  // onto the edges
+  const RowVector3 ap = query - a;
+  const Scalar d1 = ab.dot(ap);
+  const Scalar d2 = ac.dot(ap);
+  if (d1 <= 0 && d2 <= 0) {
+    p = a;
+  } else {
+    const RowVector3 bp = query - b;
+    const Scalar d3 = ab.dot(bp);
+    const Scalar d4 = ac.dot(bp);
+    const RowVector3 cp = query - c;
+    const Scalar d5 = ab.dot(cp);
+    const Scalar d6 = ac.dot(cp);
+    const Scalar vc = d1 * d4 - d3 * d2;
+    const Scalar vb = d5 * d2 - d1 * d6;
+    const Scalar va = d3 * d6 - d5 * d4;
+    if (d3 >= 0 && d4 <= d3) {
+      p = b;
+    } else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+      p = a + (d1 / (d1 - d3)) * ab;
+    } else if (d6 >= 0 && d5 <= d6) {
+      p = c;
+    } else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+      p = a + (d2 / (d2 - d6)) * ac;
+    } else if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+      p = b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    } else if (va + vb + vc > 0) {
+      // Inside the face region: barycentric coordinates (v, w) of the
+      // projection
+      const Scalar denom = Scalar(1) / (va + vb + vc);
+      p = a + (vb * denom) * ab + (vc * denom) * ac;
+    } else {
+      // Zero-area triangle that rounding kept out of every region above:
+      // closest of its three edges
+      p = closest_point_on_segment<Scalar>(query, a, b);
+      for (const RowVector3 & e : {
+          closest_point_on_segment<Scalar>(query, b, c),
+          closest_point_on_segment<Scalar>(query, c, a)}) {
+        if ((query - e).squaredNorm() < (query - p).squaredNorm())
+          p = e;
+      }
+    }
+  }
+  sqrd = (query - p).squaredNorm();
+}
+
+// Explicit template instantiations
+template void point_triangle_squared_distance<double>(
+  const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  double &, Eigen::RowVector3d &);
+template void point_triangle_squared_distance<float>(
+  const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  float &, Eigen::RowVector3f &);
@@ -1,29 +1,32 @@
 #include "ray_intersect_box.h"
+#include "TraversalStats.h"
 #include <algorithm>   
 #include <cmath>      
 #include <limits>     
 
+template <typename Scalar>
 bool ray_intersect_box(
-  const Ray & ray,
-  const BoundingBox& box,
-  const double min_t,
-  const double max_t)
+  const RayT<Scalar> & ray,
+  const BoundingBoxT<Scalar> & box,
+  const Scalar min_t,
+  const Scalar max_t)
 {
-  double tmin = -std::numeric_limits<double>::infinity();
-  double tmax =  std::numeric_limits<double>::infinity();
+  TRAVERSAL_STATS_ADD(box_tests, 1);
+  Scalar tmin = -std::numeric_limits<Scalar>::infinity();
+  Scalar tmax =  std::numeric_limits<Scalar>::infinity();
 
   for (int i = 0; i < 3; i++) {
-    double origin = ray.origin[i];
-    double direction = ray.direction[i];
-    double min_c = box.min_corner[i];
-    double max_c = box.max_corner[i];
+    Scalar origin = ray.origin[i];
+    Scalar direction = ray.direction[i];
+    Scalar min_c = box.min_corner[i];
+    Scalar max_c = box.max_corner[i];
 
-    if (std::abs(direction) < 1e-8) {
+    if (std::abs(direction) < Scalar(1e-8)) {
       if (origin < min_c || origin > max_c)
         return false;
     } else {
-      double t1 = (min_c - origin) / direction;
-      double t2 = (max_c - origin) / direction;
+      Scalar t1 = (min_c - origin) / direction;
+      Scalar t2 = (max_c - origin) / direction;
       if (t1 > t2) std::swap(t1, t2);
 
       tmin = std::max(tmin, t1);
@@ -37,3 +40,36 @@ bool ray_intersect_box(
   return (tmax >= min_t) && (tmin <= max_t);
 }
 
+template <typename Scalar>
+bool ray_intersect_box(
+  const PreparedRayT<Scalar> & ray,
+  const BoundingBoxT<Scalar> & box,
+  const Scalar min_t,
+  const Scalar max_t)
+{
+  TRAVERSAL_STATS_ADD(box_tests, 1);
+  const Eigen::Matrix<Scalar, 1, 3> * corners[2] = {&box.min_corner, &box.max_corner};
+  const Scalar pad = Scalar(1) + 4 * std::numeric_limits<Scalar>::epsilon();
+  Scalar t_near = min_t;
+  Scalar t_far = max_t;
+  for (int i = 0; i < 3; i++) {
+    const Scalar near_c = (*corners[ray.is_negative[i]])[i];
+    const Scalar far_c = (*corners[1 - ray.is_negative[i]])[i];
+    const Scalar t1 = (near_c - ray.ray.origin[i]) * ray.inv_direction[i];
+    const Scalar t2 = (far_c - ray.ray.origin[i]) * ray.inv_direction[i] * pad;
+    // Written so a NaN (0 * inf on a slab boundary) leaves the interval as is
+    t_near = t1 > t_near ? t1 : t_near;
+    t_far = t2 < t_far ? t2 : t_far;
+  }
+  return t_near <= t_far;
+}
+
+// Explicit template instantiations
+template bool ray_intersect_box<double>(
+  const Ray &, const BoundingBox &, const double, const double);
+template bool ray_intersect_box<float>(
+  const Rayf &, const BoundingBoxf &, const float, const float);
+template bool ray_intersect_box<double>(
+  const PreparedRay &, const BoundingBox &, const double, const double);
+template bool ray_intersect_box<float>(
+  const PreparedRayf &, const BoundingBoxf &, const float, const float);
@@ -1,44 +1,193 @@
 #include "ray_intersect_triangle.h"
+#include "TraversalStats.h"
 #include <Eigen/Dense>
 #include <cmath>
 
+namespace
+{
+  // a*b - c*d with a correctly signed result. Where FMA is available the
+  // compiler may fuse one of the two products but not the other, and the edge
+  // functions of two triangles sharing an edge stop being exact negations of
+  // each other; Kahan's algorithm evaluates the difference almost exactly
+  // instead.
+  template <typename Scalar>
+  inline Scalar difference_of_products(
+    const Scalar a, const Scalar b, const Scalar c, const Scalar d)
+  {
+#ifdef __FMA__
+    const Scalar cd = c * d;
+    const Scalar error = std::fma(-c, d, cd);
+    return std::fma(a, b, -cd) + error;
+#else
+    return a * b - c * d;
+#endif
+  }
+}
+
+template <typename Scalar>
 bool ray_intersect_triangle(
-  const Ray & ray,
-  const Eigen::RowVector3d & A,
-  const Eigen::RowVector3d & B,
-  const Eigen::RowVector3d & C,
-  const double min_t,
-  const double max_t,
-  double & t)
+  const RayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t,
+  Scalar & u,
+  Scalar & v)
 {
-  Eigen::Vector3d e1 = (B - A).transpose();
-  Eigen::Vector3d e2 = (C - A).transpose();
+  TRAVERSAL_STATS_ADD(triangle_tests, 1);
+  using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
 
-  Eigen::Matrix3d M;
-  M.col(0) = e1;
-  M.col(1) = e2;
-  M.col(2) = -ray.direction;
+  // Solve A + u e1 + v e2 = origin + t direction by Cramer's rule
+  // (Möller–Trumbore), sharing the cross products between u, v and t
+  const Vector3 e1 = (B - A).transpose();
+  const Vector3 e2 = (C - A).transpose();
 
-  double det = M.determinant();
-  const double epsilon = 1e-8;
+  const Vector3 p = ray.direction.cross(e2);
+  const Scalar det = e1.dot(p);
+  const Scalar epsilon = Scalar(1e-8);
 
   if (std::abs(det) < epsilon)
   {
     return false;
   }
+  const Scalar inv_det = Scalar(1) / det;
+
+  const Vector3 s = ray.origin - A.transpose();
+  const Scalar uu = s.dot(p) * inv_det;
+  if (uu < 0 || uu > 1)
+  {
+    return false;
+  }
+
+  const Vector3 q = s.cross(e1);
+  const Scalar vv = ray.direction.dot(q) * inv_det;
+  const Scalar tt = e2.dot(q) * inv_det;
+
+  if (vv >= 0 && uu + vv <= 1 && tt >= min_t && tt <= max_t)
+  {
+    t = tt;
+    u = uu;
+    v = vv;
+    TRAVERSAL_STATS_ADD(triangle_hits, 1);
+    return true;
+  }
+
+  return false;
+}
 
-  Eigen::Vector3d rhs = ray.origin - A.transpose();
-  Eigen::Vector3d x = M.inverse() * rhs;
+template <typename Scalar>
+bool ray_intersect_triangle(
+  const PreparedRayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t,
+  Scalar & u,
+  Scalar & v)
+{
+  TRAVERSAL_STATS_ADD(triangle_tests, 1);
+  using RowVector3 = Eigen::Matrix<Scalar, 1, 3>;
+  const RowVector3 origin = ray.ray.origin.transpose();
+  const RowVector3 a = A - origin;
+  const RowVector3 b = B - origin;
+  const RowVector3 c = C - origin;
 
-  double u = x(0);
-  double v = x(1);
-  double tt = x(2);
+  // Shear and scale the corners so the ray runs along +z from the origin
+  const Scalar ax = a[ray.kx] - ray.Sx * a[ray.kz];
+  const Scalar ay = a[ray.ky] - ray.Sy * a[ray.kz];
+  const Scalar bx = b[ray.kx] - ray.Sx * b[ray.kz];
+  const Scalar by = b[ray.ky] - ray.Sy * b[ray.kz];
+  const Scalar cx = c[ray.kx] - ray.Sx * c[ray.kz];
+  const Scalar cy = c[ray.ky] - ray.Sy * c[ray.kz];
 
-  if (u >= 0 && v >= 0 && u + v <= 1 && tt >= min_t && tt <= max_t)
+  // Scaled barycentric coordinates (2D edge functions) of A, B and C
+  Scalar ea = difference_of_products(cx, by, cy, bx);
+  Scalar eb = difference_of_products(ax, cy, ay, cx);
+  Scalar ec = difference_of_products(bx, ay, by, ax);
+  if (sizeof(Scalar) < sizeof(double) && (ea == 0 || eb == 0 || ec == 0)) {
+    ea = Scalar((double)cx * (double)by - (double)cy * (double)bx);
+    eb = Scalar((double)ax * (double)cy - (double)ay * (double)cx);
+    ec = Scalar((double)bx * (double)ay - (double)by * (double)ax);
+  }
+
+  // Inside iff the edge functions do not have mixed signs
+  const bool outside = ((ea < 0) | (eb < 0) | (ec < 0)) & ((ea > 0) | (eb > 0) | (ec > 0));
+  const Scalar det = ea + eb + ec;
+  if (outside | (det == 0))
+  {
+    return false;
+  }
+
+  const Scalar scaled_t =
+    ray.Sz * (ea * a[ray.kz] + eb * b[ray.kz] + ec * c[ray.kz]);
+  const Scalar tt = scaled_t / det;
+  if ((tt >= min_t) & (tt <= max_t))
   {
     t = tt;
+    u = eb / det;
+    v = ec / det;
+    TRAVERSAL_STATS_ADD(triangle_hits, 1);
     return true;
   }
 
   return false;
 }
+
+template <typename Scalar>
+bool ray_intersect_triangle(
+  const RayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t)
+{
+  Scalar u, v;
+  return ray_intersect_triangle(ray, A, B, C, min_t, max_t, t, u, v);
+}
+
+template <typename Scalar>
+bool ray_intersect_triangle(
+  const PreparedRayT<Scalar> & ray,
+  const Eigen::Matrix<Scalar, 1, 3> & A,
+  const Eigen::Matrix<Scalar, 1, 3> & B,
+  const Eigen::Matrix<Scalar, 1, 3> & C,
+  const Scalar min_t,
+  const Scalar max_t,
+  Scalar & t)
+{
+  Scalar u, v;
+  return ray_intersect_triangle(ray, A, B, C, min_t, max_t, t, u, v);
+}
+
+// Explicit template instantiations
+template bool ray_intersect_triangle<double>(
+  const Ray &, const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  const Eigen::RowVector3d &, const double, const double, double &);
+template bool ray_intersect_triangle<float>(
+  const Rayf &, const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  const Eigen::RowVector3f &, const float, const float, float &);
+template bool ray_intersect_triangle<double>(
+  const PreparedRay &, const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  const Eigen::RowVector3d &, const double, const double, double &);
+template bool ray_intersect_triangle<float>(
+  const PreparedRayf &, const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  const Eigen::RowVector3f &, const float, const float, float &);
+
+template bool ray_intersect_triangle<double>(
+  const Ray &, const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  const Eigen::RowVector3d &, const double, const double, double &, double &, double &);
+template bool ray_intersect_triangle<float>(
+  const Rayf &, const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  const Eigen::RowVector3f &, const float, const float, float &, float &, float &);
+template bool ray_intersect_triangle<double>(
+  const PreparedRay &, const Eigen::RowVector3d &, const Eigen::RowVector3d &,
+  const Eigen::RowVector3d &, const double, const double, double &, double &, double &);
+template bool ray_intersect_triangle<float>(
+  const PreparedRayf &, const Eigen::RowVector3f &, const Eigen::RowVector3f &,
+  const Eigen::RowVector3f &, const float, const float, float &, float &, float &);
@@ -0,0 +1,188 @@
+#include "ray_intersect_triangle_block.h"
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define TRIANGLE_BLOCK_SSE 1
+#endif
+
+namespace
+{
+  // Only (near-)zero determinants are rejected: the watertight
+  // ray_intersect_triangle overload has no threshold and accepts arbitrarily
+  // small triangles
+  const float determinant_epsilon = std::numeric_limits<float>::min();
+  // Slack on barycentric coordinates and t. Float rounding of u and v grows
+  // with the ray-origin distance over the triangle size; this covers ratios
+  // up to ~10^4.
+  const float tolerance = 1e-3f;
+}
+
+#if defined(__AVX__)
+
+unsigned ray_intersect_triangle_block(
+  const TriangleBlock & block,
+  const float origin[3],
+  const float direction[3],
+  const float min_t,
+  const float max_t)
+{
+  const float direction_norm = std::sqrt(
+    direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+  static_assert(TriangleBlock::WIDTH == 8, "AVX path expects 8 lanes");
+  const __m256 dx = _mm256_set1_ps(direction[0]);
+  const __m256 dy = _mm256_set1_ps(direction[1]);
+  const __m256 dz = _mm256_set1_ps(direction[2]);
+  const __m256 e1x = _mm256_load_ps(block.e1[0]);
+  const __m256 e1y = _mm256_load_ps(block.e1[1]);
+  const __m256 e1z = _mm256_load_ps(block.e1[2]);
+  const __m256 e2x = _mm256_load_ps(block.e2[0]);
+  const __m256 e2y = _mm256_load_ps(block.e2[1]);
+  const __m256 e2z = _mm256_load_ps(block.e2[2]);
+
+  // p = direction x e2, det = e1 . p
+  const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+  const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+  const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+  const __m256 det = _mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+  const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+  // s = origin - v0, q = s x e1
+  const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(origin[0]), _mm256_load_ps(block.v0[0]));
+  const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(origin[1]), _mm256_load_ps(block.v0[1]));
+  const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(origin[2]), _mm256_load_ps(block.v0[2]));
+  const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+  const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+  const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+
+  const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inv_det);
+  const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+  const __m256 tt = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+
+  const __m256 lo = _mm256_set1_ps(-tolerance);
+  const __m256 abs_det = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+  const __m256 abs_t = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), tt);
+  const __m256 t_slack = _mm256_mul_ps(abs_t, _mm256_set1_ps(tolerance));
+  __m256 valid = _mm256_cmp_ps(abs_det, _mm256_set1_ps(determinant_epsilon), _CMP_GE_OQ);
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, lo, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, lo, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f + tolerance), _CMP_LE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(tt, t_slack), _mm256_set1_ps(min_t), _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_sub_ps(tt, t_slack), _mm256_set1_ps(max_t), _CMP_LE_OQ));
+  const __m256 grazing = _mm256_cmp_ps(abs_det,
+    _mm256_mul_ps(_mm256_load_ps(block.grazing_det), _mm256_set1_ps(direction_norm)), _CMP_LT_OQ);
+  return _mm256_movemask_ps(_mm256_or_ps(valid, grazing)) | block.exact_lanes;
+}
+
+#elif defined(TRIANGLE_BLOCK_SSE)
+
+unsigned ray_intersect_triangle_block(
+  const TriangleBlock & block,
+  const float origin[3],
+  const float direction[3],
+  const float min_t,
+  const float max_t)
+{
+  const float direction_norm = std::sqrt(
+    direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+  static_assert(TriangleBlock::WIDTH == 4, "SSE path expects 4 lanes");
+  const __m128 dx = _mm_set1_ps(direction[0]);
+  const __m128 dy = _mm_set1_ps(direction[1]);
+  const __m128 dz = _mm_set1_ps(direction[2]);
+  const __m128 e1x = _mm_load_ps(block.e1[0]);
+  const __m128 e1y = _mm_load_ps(block.e1[1]);
+  const __m128 e1z = _mm_load_ps(block.e1[2]);
+  const __m128 e2x = _mm_load_ps(block.e2[0]);
+  const __m128 e2y = _mm_load_ps(block.e2[1]);
+  const __m128 e2z = _mm_load_ps(block.e2[2]);
+
+  // p = direction x e2, det = e1 . p
+  const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+  const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+  const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+  const __m128 det = _mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+  const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+  // s = origin - v0, q = s x e1
+  const __m128 sx = _mm_sub_ps(_mm_set1_ps(origin[0]), _mm_load_ps(block.v0[0]));
+  const __m128 sy = _mm_sub_ps(_mm_set1_ps(origin[1]), _mm_load_ps(block.v0[1]));
+  const __m128 sz = _mm_sub_ps(_mm_set1_ps(origin[2]), _mm_load_ps(block.v0[2]));
+  const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+  const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+  const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+  const __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+  const __m128 lo = _mm_set1_ps(-tolerance);
+  const __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+  const __m128 abs_t = _mm_andnot_ps(_mm_set1_ps(-0.0f), tt);
+  const __m128 t_slack = _mm_mul_ps(abs_t, _mm_set1_ps(tolerance));
+  __m128 valid = _mm_cmpge_ps(abs_det, _mm_set1_ps(determinant_epsilon));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, lo));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, lo));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f + tolerance)));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(_mm_add_ps(tt, t_slack), _mm_set1_ps(min_t)));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_sub_ps(tt, t_slack), _mm_set1_ps(max_t)));
+  const __m128 grazing = _mm_cmplt_ps(abs_det,
+    _mm_mul_ps(_mm_load_ps(block.grazing_det), _mm_set1_ps(direction_norm)));
+  return _mm_movemask_ps(_mm_or_ps(valid, grazing)) | block.exact_lanes;
+}
+
+#else
+
+unsigned ray_intersect_triangle_block(
+  const TriangleBlock & block,
+  const float origin[3],
+  const float direction[3],
+  const float min_t,
+  const float max_t)
+{
+  const float direction_norm = std::sqrt(
+    direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+  unsigned mask = 0;
+  for (int i = 0; i < TriangleBlock::WIDTH; i++) {
+    const float e1[3] = {block.e1[0][i], block.e1[1][i], block.e1[2][i]};
+    const float e2[3] = {block.e2[0][i], block.e2[1][i], block.e2[2][i]};
+    const float p[3] = {
+      direction[1] * e2[2] - direction[2] * e2[1],
+      direction[2] * e2[0] - direction[0] * e2[2],
+      direction[0] * e2[1] - direction[1] * e2[0]};
+    const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (std::abs(det) < block.grazing_det[i] * direction_norm) {
+      mask |= 1u << i;
+      continue;
+    }
+    if (!(std::abs(det) >= determinant_epsilon))
+      continue;
+    const float inv_det = 1.0f / det;
+    const float s[3] = {
+      origin[0] - block.v0[0][i],
+      origin[1] - block.v0[1][i],
+      origin[2] - block.v0[2][i]};
+    const float q[3] = {
+      s[1] * e1[2] - s[2] * e1[1],
+      s[2] * e1[0] - s[0] * e1[2],
+      s[0] * e1[1] - s[1] * e1[0]};
+    const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+    const float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inv_det;
+    const float tt = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+    const float t_slack = std::abs(tt) * tolerance;
+    if (u >= -tolerance && v >= -tolerance && u + v <= 1 + tolerance &&
+        tt + t_slack >= min_t && tt - t_slack <= max_t)
+      mask |= 1u << i;
+  }
+  return mask | block.exact_lanes;
+}
+
+#endif
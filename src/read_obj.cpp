@@ -1,64 +1,268 @@
 #include "read_obj.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
 
+namespace
+{
+  // Bytes of input per parallel chunk at least (smaller files are parsed on
+  // the calling thread)
+  const size_t min_chunk_bytes = 4 << 20;
+  // Bytes of lines between progress updates and cancellation checks
+  const size_t progress_bytes = 1 << 20;
+
+  inline bool is_blank(const char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  inline const char * skip_blanks(const char * p, const char * end)
+  {
+    while (p < end && is_blank(*p))
+      p++;
+    return p;
+  }
+
+  inline const char * skip_token(const char * p, const char * end)
+  {
+    while (p < end && !is_blank(*p))
+      p++;
+    return p;
+  }
+
+  // Kind of the OBJ statement starting at `line` (only the ones read here)
+  enum class Statement { VERTEX, FACE, OTHER };
+
+  inline Statement statement(const char * line, const char * end)
+  {
+    if (end - line >= 2 && is_blank(line[1])) {
+      if (line[0] == 'v') return Statement::VERTEX;
+      if (line[0] == 'f') return Statement::FACE;
+    }
+    return Statement::OTHER;
+  }
+
+  // Parse the number at p (after blanks), advancing p past it
+  inline bool parse_double(const char * & p, const char * end, double & value)
+  {
+    p = skip_blanks(p, end);
+    if (p < end && *p == '+')
+      p++;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    const std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+      return false;
+    p = result.ptr;
+    return true;
+#else
+    // No floating-point from_chars: strtod on a terminated copy of the token
+    // (the mapping itself is not terminated)
+    char buffer[64];
+    const size_t length = std::min<size_t>(skip_token(p, end) - p, sizeof(buffer) - 1);
+    std::memcpy(buffer, p, length);
+    buffer[length] = '\0';
+    char * parsed_end;
+    value = std::strtod(buffer, &parsed_end);
+    if (parsed_end == buffer)
+      return false;
+    p += parsed_end - buffer;
+    return true;
+#endif
+  }
+
+  // Lines [begin, end) of a file, parsed in two passes
+  struct Chunk
+  {
+    const char * begin;
+    const char * end;
+    // Pass 1: statements in the chunk
+    int num_vertices = 0;
+    int num_triangles = 0;
+    // Rows of V and F the chunk writes from (prefix sums of the counts)
+    int first_vertex = 0;
+    int first_triangle = 0;
+    bool ok = true;
+  };
+
+  // Call fn(line, line_end) for every line of the chunk, line_end excluding
+  // the '\n'. With a progress, stops (marking the chunk not ok) once the load
+  // is cancelled and, if `report`, adds the bytes done to bytes_parsed.
+  template <typename Fn>
+  void for_each_line(Chunk & chunk, LoadProgress * progress, const bool report, const Fn & fn)
+  {
+    const char * line = chunk.begin;
+    const char * reported = line;
+    while (line < chunk.end) {
+      if (progress && static_cast<size_t>(line - reported) >= progress_bytes) {
+        if (report)
+          progress->add_bytes_parsed(line - reported);
+        reported = line;
+        if (progress->cancelled()) {
+          chunk.ok = false;
+          return;
+        }
+      }
+      const char * newline = static_cast<const char *>(
+        std::memchr(line, '\n', chunk.end - line));
+      const char * line_end = newline ? newline : chunk.end;
+      fn(skip_blanks(line, line_end), line_end);
+      line = line_end + 1;
+    }
+    if (progress && report)
+      progress->add_bytes_parsed(chunk.end - reported);
+  }
+
+  // Pass 1: count vertices and the triangles of the faces' fans
+  void count_chunk(Chunk & chunk, LoadProgress * progress)
+  {
+    for_each_line(chunk, progress, false, [&](const char * line, const char * end) {
+      const Statement kind = statement(line, end);
+      if (kind == Statement::VERTEX) {
+        chunk.num_vertices++;
+      } else if (kind == Statement::FACE) {
+        int corners = 0;
+        for (const char * p = skip_blanks(line + 1, end); p < end && *p != '#'; p = skip_blanks(p, end)) {
+          p = skip_token(p, end);
+          corners++;
+        }
+        chunk.num_triangles += std::max(corners - 2, 0);
+      }
+    });
+  }
+
+  // Pass 2: parse vertices and faces into their rows of V and F, resolving
+  // relative indices against the vertices read before the face
+  void parse_chunk(
+    Chunk & chunk,
+    const int total_vertices,
+    LoadProgress * progress,
+    Eigen::MatrixXd & V,
+    Eigen::MatrixXi & F)
+  {
+    int vertex = chunk.first_vertex;
+    int triangle = chunk.first_triangle;
+    for_each_line(chunk, progress, true, [&](const char * line, const char * end) {
+      if (!chunk.ok)
+        return;
+      const Statement kind = statement(line, end);
+      const char * p = line + 1;
+      if (kind == Statement::VERTEX) {
+        double x, y, z;
+        if (!parse_double(p, end, x) || !parse_double(p, end, y) || !parse_double(p, end, z)) {
+          chunk.ok = false;
+          return;
+        }
+        V(vertex, 0) = x;
+        V(vertex, 1) = y;
+        V(vertex, 2) = z;
+        vertex++;
+      } else if (kind == Statement::FACE) {
+        // Fan (c0, c_k, c_k+1) around the first corner
+        int first = -1, previous = -1;
+        for (p = skip_blanks(p, end); p < end && *p != '#'; p = skip_blanks(p, end)) {
+          // Position index of "v", "v/vt", "v//vn" or "v/vt/vn"
+          int index;
+          const std::from_chars_result result = std::from_chars(p, end, index);
+          if (result.ec != std::errc() || index == 0) {
+            chunk.ok = false;
+            return;
+          }
+          p = skip_token(result.ptr, end);
+          index = index < 0 ? vertex + index : index - 1;
+          if (index < 0 || index >= total_vertices) {
+            chunk.ok = false;
+            return;
+          }
+          if (first < 0) {
+            first = index;
+            continue;
+          }
+          if (previous >= 0) {
+            F(triangle, 0) = first;
+            F(triangle, 1) = previous;
+            F(triangle, 2) = index;
+            triangle++;
+          }
+          previous = index;
+        }
+      }
+    });
+  }
+}
+
 bool read_obj(
   const std::string & filename,
   Eigen::MatrixXd & V,
-  Eigen::MatrixXi & F)
+  Eigen::MatrixXi & F,
+  LoadProgress * progress)
 {
-  std::ifstream file(filename);
+  const MappedFile file(filename);
   if (!file.is_open()) {
     std::cerr << "Error: Cannot open file " << filename << std::endl;
     return false;
   }
+  if (progress) {
+    progress->bytes_parsed = 0;
+    progress->bytes_total = file.size();
+  }
 
-  std::vector<Eigen::RowVector3d> v_list;
-  std::vector<Eigen::RowVector3i> f_list;
-
-  std::string line;
-  while (std::getline(file, line)) {
-    std::stringstream ss(line);
-    std::string type;
-    ss >> type;
-
-    if (type == "v") {
-      double x, y, z;
-      ss >> x >> y >> z;
-      v_list.emplace_back(x, y, z);
-    } 
-    else if (type == "f") {
-      std::string v_str;
-      std::vector<int> face_indices;
-      
-      while (ss >> v_str) {
-        size_t slash_pos = v_str.find('/');
-        int v_idx = std::stoi(v_str.substr(0, slash_pos));
-        if (v_idx < 0) {
-          v_idx = v_list.size() + v_idx;
-        } else {
-          v_idx = v_idx - 1;
-        }
-        
-        face_indices.push_back(v_idx);
-      }
-
-      if (face_indices.size() == 3) {
-        f_list.emplace_back(face_indices[0], face_indices[1], face_indices[2]);
-      } else if (face_indices.size() == 4) {
-        f_list.emplace_back(face_indices[0], face_indices[1], face_indices[2]);
-        f_list.emplace_back(face_indices[0], face_indices[2], face_indices[3]);
-      }
+  // Newline-aligned chunks
+  const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(
+    file.size() / min_chunk_bytes, ThreadPool::hardware_threads()));
+  std::vector<Chunk> chunks(num_chunks);
+  const char * const end = file.data() + file.size();
+  const char * begin = file.data();
+  for (size_t i = 0; i < num_chunks; i++) {
+    const char * chunk_end = end;
+    if (i + 1 < num_chunks) {
+      chunk_end = std::max(begin, file.data() + file.size() / num_chunks * (i + 1));
+      const char * newline = static_cast<const char *>(
+        std::memchr(chunk_end, '\n', end - chunk_end));
+      chunk_end = newline ? newline + 1 : end;
     }
+    chunks[i].begin = begin;
+    chunks[i].end = chunk_end;
+    begin = chunk_end;
   }
 
-  V.resize(v_list.size(), 3);
-  for (size_t i = 0; i < v_list.size(); i++) V.row(i) = v_list[i];
+  ThreadPool pool(static_cast<int>(num_chunks));
+  pool.parallel_for(0, static_cast<int>(num_chunks), 1, [&](int chunk_begin, int chunk_end) {
+    for (int i = chunk_begin; i < chunk_end; i++)
+      count_chunk(chunks[i], progress);
+  });
+  // (A cancelled count leaves the rows of later chunks wrong)
+  if (progress && progress->cancelled())
+    return false;
 
-  F.resize(f_list.size(), 3);
-  for (size_t i = 0; i < f_list.size(); i++) F.row(i) = f_list[i];
+  int num_vertices = 0, num_triangles = 0;
+  for (Chunk & chunk : chunks) {
+    chunk.first_vertex = num_vertices;
+    chunk.first_triangle = num_triangles;
+    num_vertices += chunk.num_vertices;
+    num_triangles += chunk.num_triangles;
+  }
+  V.resize(num_vertices, 3);
+  F.resize(num_triangles, 3);
+
+  pool.parallel_for(0, static_cast<int>(num_chunks), 1, [&](int chunk_begin, int chunk_end) {
+    for (int i = chunk_begin; i < chunk_end; i++)
+      parse_chunk(chunks[i], num_vertices, progress, V, F);
+  });
 
+  for (const Chunk & chunk : chunks) {
+    if (!chunk.ok) {
+      V.resize(0, 3);
+      F.resize(0, 3);
+      if (progress && progress->cancelled())
+        return false;
+      std::cerr << "Error: Malformed vertex or face index out of range in " << filename << std::endl;
+      return false;
+    }
+  }
   return true;
-}
\ No newline at end of file
+}
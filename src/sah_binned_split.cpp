@@ -0,0 +1,123 @@
+#include "sah_binned_split.h"
+#include "insert_box_into_box.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+template <typename Scalar>
+bool sah_binned_split(
+  const std::vector<BoundingBoxT<Scalar> > & boxes,
+  const int num_bins,
+  const double traversal_cost,
+  const int block_size,
+  int & axis,
+  double & split,
+  double & cost)
+{
+  std::vector<int> indices(boxes.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  return sah_binned_split(
+    boxes, indices.data(), indices.size(), num_bins, traversal_cost,
+    block_size, axis, split, cost);
+}
+
+template <typename Scalar>
+bool sah_binned_split(
+  const std::vector<BoundingBoxT<Scalar> > & boxes,
+  const int * indices,
+  const int num_indices,
+  const int num_bins,
+  const double traversal_cost,
+  const int block_size,
+  int & axis,
+  double & split,
+  double & cost)
+{
+  const int nb = std::max(num_bins, 2);
+  const int bs = std::max(block_size, 1);
+  const auto blocks = [bs](const int count) { return (count + bs - 1) / bs; };
+
+  using BoundingBox = BoundingBoxT<Scalar>;
+  BoundingBox bounds;
+  BoundingBox centroid_bounds;
+  for (int i = 0; i < num_indices; i++) {
+    const BoundingBox & box = boxes[indices[i]];
+    insert_box_into_box(box, bounds);
+    const typename BoundingBox::RowVector3 c = box.center();
+    insert_box_into_box(BoundingBox(c, c), centroid_bounds);
+  }
+
+  const double parent_area = bounds.surface_area();
+  const double inv_parent_area = parent_area > 0 ? 1.0 / parent_area : 0.0;
+
+  bool found = false;
+  cost = std::numeric_limits<double>::infinity();
+
+  std::vector<BoundingBox> bin_boxes(nb);
+  std::vector<int> bin_counts(nb);
+  std::vector<double> right_area(nb);
+  std::vector<int> right_count(nb);
+
+  for (int a = 0; a < 3; a++) {
+    const double lo = centroid_bounds.min_corner[a];
+    const double extent = centroid_bounds.max_corner[a] - lo;
+    if (!(extent > 0))
+      continue;
+    const double scale = nb / extent;
+
+    std::fill(bin_boxes.begin(), bin_boxes.end(), BoundingBox());
+    std::fill(bin_counts.begin(), bin_counts.end(), 0);
+    for (int i = 0; i < num_indices; i++) {
+      const BoundingBox & box = boxes[indices[i]];
+      int b = static_cast<int>((box.center()[a] - lo) * scale);
+      b = std::clamp(b, 0, nb - 1);
+      bin_counts[b]++;
+      insert_box_into_box(box, bin_boxes[b]);
+    }
+
+    // Sweep from the right to get the area and count right of every plane
+    BoundingBox right_box;
+    int count = 0;
+    for (int b = nb - 1; b > 0; b--) {
+      insert_box_into_box(bin_boxes[b], right_box);
+      count += bin_counts[b];
+      right_area[b] = right_box.surface_area();
+      right_count[b] = count;
+    }
+
+    // Sweep from the left evaluating the plane between bin b-1 and bin b
+    BoundingBox left_box;
+    int left_count = 0;
+    for (int b = 1; b < nb; b++) {
+      insert_box_into_box(bin_boxes[b - 1], left_box);
+      left_count += bin_counts[b - 1];
+      if (left_count == 0 || right_count[b] == 0)
+        continue;
+      const double c = traversal_cost +
+        (left_box.surface_area() * blocks(left_count) +
+         right_area[b] * blocks(right_count[b])) * inv_parent_area;
+      if (c < cost) {
+        cost = c;
+        axis = a;
+        split = lo + b / scale;
+        found = true;
+      }
+    }
+  }
+
+  return found;
+}
+
+// Explicit template instantiations
+template bool sah_binned_split<double>(
+  const std::vector<BoundingBox> &, const int, const double, const int,
+  int &, double &, double &);
+template bool sah_binned_split<float>(
+  const std::vector<BoundingBoxf> &, const int, const double, const int,
+  int &, double &, double &);
+template bool sah_binned_split<double>(
+  const std::vector<BoundingBox> &, const int *, const int, const int,
+  const double, const int, int &, double &, double &);
+template bool sah_binned_split<float>(
+  const std::vector<BoundingBoxf> &, const int *, const int, const int,
+  const double, const int, int &, double &, double &);
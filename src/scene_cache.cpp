@@ -0,0 +1,510 @@
+#include "scene_cache.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+  // Bump whenever the layout of the header or a section changes
+  const uint32_t format_version = 2;
+  const char format_magic[8] = {'A', 'S', 'C', 'I', 'I', 'S', 'C', '\0'};
+  // Read back as another value on a machine of the other endianness
+  const uint32_t byte_order_mark = 0x01020304;
+  const size_t section_alignment = 64;
+
+  // Start of a cache file. Fields are ordered so the struct has no padding
+  // (all of its bytes are checksummed).
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // Source file the cache was made from, as it was then
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    // BVH build options that change the BVHs
+    int32_t method;
+    int32_t num_bins;
+    int32_t max_leaf_size;
+    int32_t leaf_block_size;
+    int32_t branching_factor;
+    // Element sizes of the BVH sections (0 for an absent wide BVH)
+    uint32_t node_size;
+    uint32_t wide_node_size;
+    uint32_t block_size;
+    double traversal_cost;
+    double max_reference_growth;
+    double spatial_split_alpha;
+    uint64_t num_vertices;
+    uint64_t num_faces;
+    uint64_t num_nodes;
+    uint64_t num_primitives;
+    uint64_t num_wide_nodes;
+    uint64_t num_blocks;
+    int32_t max_depth;
+    int32_t wide_max_depth;
+    // BVHStats of the LinearBVH not implied by the counts above
+    uint64_t num_leaf_nodes;
+    double sah_cost;
+    // Of the header (with checksum = 0) followed by all sections
+    uint64_t checksum;
+  };
+  static_assert(std::is_trivially_copyable<Header>::value, "Header is written as raw bytes");
+  static_assert(sizeof(Header) == 168, "Header should have no padding");
+
+  // Byte ranges of the sections, in file order
+  enum Section
+  {
+    VERTICES, FACES, NORMALS, NODES, PRIMITIVES, WIDE_NODES, BLOCKS, NUM_SECTIONS
+  };
+
+  struct Layout
+  {
+    uint64_t offset[NUM_SECTIONS];
+    uint64_t size[NUM_SECTIONS];
+    uint64_t file_size;
+  };
+
+  uint64_t align_up(const uint64_t offset)
+  {
+    return (offset + section_alignment - 1) / section_alignment * section_alignment;
+  }
+
+  Layout layout(const Header & header)
+  {
+    Layout result;
+    result.size[VERTICES] = header.num_vertices * 3 * sizeof(double);
+    result.size[FACES] = header.num_faces * 3 * sizeof(int32_t);
+    result.size[NORMALS] = header.num_vertices * 3 * sizeof(double);
+    result.size[NODES] = header.num_nodes * sizeof(LinearBVHNode);
+    result.size[PRIMITIVES] = header.num_primitives * sizeof(int32_t);
+    result.size[WIDE_NODES] = header.num_wide_nodes * header.wide_node_size;
+    result.size[BLOCKS] = header.num_blocks * sizeof(TriangleBlock);
+    uint64_t offset = align_up(sizeof(Header));
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+      result.offset[s] = offset;
+      offset = align_up(offset + result.size[s]);
+    }
+    result.file_size = offset;
+    return result;
+  }
+
+  inline uint64_t rotate_left(const uint64_t x, const int r)
+  {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+  const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+
+  inline uint64_t mix(const uint64_t lane, const uint64_t word)
+  {
+    return rotate_left(lane + word * prime2, 31) * prime1;
+  }
+
+  // 64-bit checksum of `size` bytes, continuing from `seed`. Four
+  // independent lanes of 8-byte words keep it well above the speed of
+  // reading the file.
+  uint64_t checksum(const char * data, const size_t size, const uint64_t seed)
+  {
+    uint64_t lanes[4] = {seed + prime1, seed ^ prime2, seed, seed - prime1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      for (int k = 0; k < 4; k++) {
+        uint64_t word;
+        std::memcpy(&word, data + i + 8 * k, sizeof(word));
+        lanes[k] = mix(lanes[k], word);
+      }
+    }
+    uint64_t hash = size * prime1;
+    for (int k = 0; k < 4; k++)
+      hash = mix(hash, lanes[k]);
+    for (; i < size; i++)
+      hash = mix(hash, static_cast<unsigned char>(data[i]));
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    return hash;
+  }
+
+  // Size and modification time of a file
+  bool source_stamp(const std::string & source, uint64_t & size, int64_t & mtime_ns)
+  {
+    std::error_code error;
+    size = std::filesystem::file_size(source, error);
+    if (error)
+      return false;
+    const auto mtime = std::filesystem::last_write_time(source, error);
+    if (error)
+      return false;
+    mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      mtime.time_since_epoch()).count();
+    return true;
+  }
+
+  void set_options(Header & header, const BVHBuildOptions & options)
+  {
+    header.method = static_cast<int32_t>(options.method);
+    header.num_bins = options.num_bins;
+    header.max_leaf_size = options.max_leaf_size;
+    header.leaf_block_size = options.leaf_block_size;
+    header.traversal_cost = options.traversal_cost;
+    header.max_reference_growth = options.max_reference_growth;
+    header.spatial_split_alpha = options.spatial_split_alpha;
+    header.branching_factor = options.branching_factor;
+  }
+
+  bool same_options(const Header & a, const Header & b)
+  {
+    return a.method == b.method && a.num_bins == b.num_bins &&
+      a.max_leaf_size == b.max_leaf_size && a.leaf_block_size == b.leaf_block_size &&
+      a.traversal_cost == b.traversal_cost &&
+      a.max_reference_growth == b.max_reference_growth &&
+      a.spatial_split_alpha == b.spatial_split_alpha &&
+      a.branching_factor == b.branching_factor;
+  }
+
+  // Whether the indices of the sections stay in range, so a cache that
+  // passes the checksum but was written by a broken build cannot send
+  // traversal out of bounds
+  bool valid_indices(
+    const Header & header,
+    const int32_t * faces,
+    const LinearBVHNode * nodes,
+    const int32_t * primitives)
+  {
+    for (uint64_t i = 0; i < header.num_faces * 3; i++)
+      if (faces[i] < 0 || static_cast<uint64_t>(faces[i]) >= header.num_vertices)
+        return false;
+    for (uint64_t i = 0; i < header.num_primitives; i++)
+      if (primitives[i] < 0 || static_cast<uint64_t>(primitives[i]) >= header.num_faces)
+        return false;
+    // Children always follow their parent, so depths resolve in one pass
+    std::vector<int> depth(header.num_nodes, 0);
+    int max_depth = 0;
+    for (uint64_t i = 0; i < header.num_nodes; i++) {
+      const LinearBVHNode & node = nodes[i];
+      if (node.count > 0) {
+        if (node.offset < 0 ||
+            static_cast<uint64_t>(node.offset) + node.count > header.num_primitives)
+          return false;
+      } else {
+        if (node.offset <= 0 || static_cast<uint64_t>(node.offset) <= i + 1 ||
+            static_cast<uint64_t>(node.offset) >= header.num_nodes)
+          return false;
+        depth[i + 1] = depth[node.offset] = depth[i] + 1;
+      }
+      max_depth = std::max(max_depth, depth[i]);
+    }
+    return max_depth == header.max_depth;
+  }
+
+  // Same as valid_indices for the wide BVH's nodes and blocks
+  template <int N>
+  bool valid_wide_indices(
+    const Header & header,
+    const WideBVHNode<N> * nodes,
+    const TriangleBlock * blocks)
+  {
+    // Leaf children index blocks when the triangles are baked
+    const uint64_t num_leaf_items = header.num_blocks > 0 ? header.num_blocks : header.num_primitives;
+    // Children always follow their parent here too
+    std::vector<int> depth(header.num_wide_nodes, 0);
+    int max_depth = 0;
+    for (uint64_t i = 0; i < header.num_wide_nodes; i++) {
+      for (int c = 0; c < N; c++) {
+        const int32_t child = nodes[i].child[c];
+        const int32_t count = nodes[i].count[c];
+        if (child < 0) {
+          if (child != -1 || count != 0)
+            return false;
+        } else if (count > 0) {
+          if (static_cast<uint64_t>(child) + count > num_leaf_items)
+            return false;
+        } else {
+          if (count < 0 || static_cast<uint64_t>(child) <= i ||
+              static_cast<uint64_t>(child) >= header.num_wide_nodes)
+            return false;
+          depth[child] = depth[i] + 1;
+        }
+      }
+      max_depth = std::max(max_depth, depth[i]);
+    }
+    for (uint64_t b = 0; b < header.num_blocks; b++)
+      for (int lane = 0; lane < TriangleBlock::WIDTH; lane++)
+        if (blocks[b].id[lane] < -1 ||
+            blocks[b].id[lane] >= static_cast<int64_t>(header.num_primitives))
+          return false;
+    return max_depth == header.wide_max_depth;
+  }
+
+  // Arrays of the wide BVH of the given branching factor (none for 2)
+  struct WideSections
+  {
+    const char * nodes = nullptr;
+    const char * blocks = nullptr;
+    uint64_t num_nodes = 0;
+    uint64_t num_blocks = 0;
+    uint32_t node_size = 0;
+    int max_depth = 0;
+    size_t num_primitives = 0;
+  };
+
+  template <int N>
+  WideSections wide_sections(const WideBVH<N> & wide)
+  {
+    WideSections sections;
+    sections.nodes = reinterpret_cast<const char *>(wide.nodes.data());
+    sections.blocks = reinterpret_cast<const char *>(wide.blocks.data());
+    sections.num_nodes = wide.nodes.size();
+    sections.num_blocks = wide.blocks.size();
+    sections.node_size = sizeof(WideBVHNode<N>);
+    sections.max_depth = wide.max_depth;
+    sections.num_primitives = wide.primitive_indices.size();
+    return sections;
+  }
+
+  // Point a wide BVH at the mapped sections (sharing the LinearBVH's
+  // primitive indices, which are the same)
+  template <int N>
+  void view_wide(
+    const Header & header,
+    const char * const * data,
+    const LinearBVH & bvh,
+    WideBVH<N> & wide)
+  {
+    wide = WideBVH<N>();
+    wide.nodes.view(reinterpret_cast<const WideBVHNode<N> *>(data[WIDE_NODES]), header.num_wide_nodes);
+    wide.blocks.view(reinterpret_cast<const TriangleBlock *>(data[BLOCKS]), header.num_blocks);
+    wide.primitive_indices = bvh.primitive_indices;
+    wide.max_depth = header.wide_max_depth;
+  }
+
+  // Name for writing `filename` next to it, unique to this writer
+  std::string temporary_name(const std::string & filename)
+  {
+    std::random_device device;
+    const uint64_t salt = (static_cast<uint64_t>(device()) << 32) ^ device() ^
+      static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp", static_cast<unsigned long long>(salt));
+    return filename + suffix;
+  }
+}
+
+std::string scene_cache_path(
+  const std::string & source,
+  const std::string & cache_dir)
+{
+  if (cache_dir.empty())
+    return source + ".cache";
+  std::error_code error;
+  std::filesystem::create_directories(cache_dir, error);
+  const std::filesystem::path source_path(source);
+  const std::string absolute = std::filesystem::absolute(source_path, error).string();
+  char hash[17];
+  std::snprintf(hash, sizeof(hash), "%016llx",
+    static_cast<unsigned long long>(checksum(absolute.data(), absolute.size(), 0)));
+  return (std::filesystem::path(cache_dir) /
+    (source_path.filename().string() + "." + hash + ".cache")).string();
+}
+
+bool write_scene_cache(
+  const std::string & filename,
+  const std::string & source,
+  const BVHBuildOptions & options,
+  const Eigen::Ref<const Eigen::MatrixXd> & V,
+  const Eigen::Ref<const Eigen::MatrixXi> & F,
+  const Eigen::Ref<const Eigen::MatrixXd> & N,
+  const LinearBVH & bvh,
+  const BVHStats & bvh_stats,
+  const BVH4 & bvh4,
+  const BVH8 & bvh8)
+{
+  static_assert(sizeof(Eigen::MatrixXi::Scalar) == sizeof(int32_t), "F is stored as int32");
+  if (V.cols() != 3 || F.cols() != 3 || N.rows() != V.rows() || N.cols() != 3)
+    return false;
+  // Sections are written as one block each
+  if (V.outerStride() != V.rows() || F.outerStride() != F.rows() || N.outerStride() != N.rows())
+    return false;
+  const WideSections wide =
+    options.branching_factor == 4 ? wide_sections(bvh4) :
+    options.branching_factor == 8 ? wide_sections(bvh8) : WideSections();
+  if (options.branching_factor != 2 &&
+      (wide.num_nodes == 0 || wide.num_primitives != bvh.primitive_indices.size()))
+    return false;
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, format_magic, sizeof(format_magic));
+  header.version = format_version;
+  header.byte_order = byte_order_mark;
+  if (!source_stamp(source, header.source_size, header.source_mtime_ns))
+    return false;
+  set_options(header, options);
+  header.max_depth = bvh.max_depth;
+  header.node_size = sizeof(LinearBVHNode);
+  header.wide_node_size = wide.node_size;
+  header.block_size = sizeof(TriangleBlock);
+  header.num_vertices = V.rows();
+  header.num_faces = F.rows();
+  header.num_nodes = bvh.nodes.size();
+  header.num_primitives = bvh.primitive_indices.size();
+  header.num_wide_nodes = wide.num_nodes;
+  header.num_blocks = wide.num_blocks;
+  header.wide_max_depth = wide.max_depth;
+  header.num_leaf_nodes = bvh_stats.num_leaf_nodes;
+  header.sah_cost = bvh_stats.sah_cost;
+
+  const Layout sections = layout(header);
+  const char * data[NUM_SECTIONS] = {
+    reinterpret_cast<const char *>(V.data()),
+    reinterpret_cast<const char *>(F.data()),
+    reinterpret_cast<const char *>(N.data()),
+    reinterpret_cast<const char *>(bvh.nodes.data()),
+    reinterpret_cast<const char *>(bvh.primitive_indices.data()),
+    wide.nodes,
+    wide.blocks};
+  uint64_t sum = checksum(reinterpret_cast<const char *>(&header), sizeof(header), 0);
+  for (int s = 0; s < NUM_SECTIONS; s++)
+    sum = checksum(data[s], sections.size[s], sum);
+  header.checksum = sum;
+
+  const std::string temporary = temporary_name(filename);
+  std::error_code error;
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    const char padding[section_alignment] = {};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+      file.write(padding, sections.offset[s] - offset);
+      file.write(data[s], sections.size[s]);
+      offset = sections.offset[s] + sections.size[s];
+    }
+    file.write(padding, sections.file_size - offset);
+    if (!file.good()) {
+      file.close();
+      std::filesystem::remove(temporary, error);
+      return false;
+    }
+  }
+  std::filesystem::rename(temporary, filename, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+bool read_scene_cache(
+  const std::string & filename,
+  const std::string & source,
+  const BVHBuildOptions & options,
+  SceneCache & cache)
+{
+  std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(filename, false);
+  if (!file->is_open())
+    return false;
+  auto reject = [&](const char * reason) {
+    std::cout << "Ignoring scene cache " << filename << ": " << reason << std::endl;
+    return false;
+  };
+
+  Header header;
+  if (file->size() < sizeof(header))
+    return reject("truncated");
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, format_magic, sizeof(format_magic)) != 0)
+    return reject("not a scene cache");
+  const uint32_t wide_node_size =
+    options.branching_factor == 4 ? sizeof(WideBVHNode<4>) :
+    options.branching_factor == 8 ? sizeof(WideBVHNode<8>) : 0;
+  if (header.version != format_version || header.byte_order != byte_order_mark ||
+      header.node_size != sizeof(LinearBVHNode) || header.block_size != sizeof(TriangleBlock))
+    return reject("written by another version or platform");
+  // The sections are used in place, so they must be aligned in memory too
+  if (reinterpret_cast<uintptr_t>(file->data()) % section_alignment != 0)
+    return reject("mapping is not aligned");
+
+  Header expected = header;
+  if (!source_stamp(source, expected.source_size, expected.source_mtime_ns) ||
+      expected.source_size != header.source_size ||
+      expected.source_mtime_ns != header.source_mtime_ns)
+    return reject("source file changed");
+  set_options(expected, options);
+  if (!same_options(header, expected) || header.wide_node_size != wide_node_size ||
+      (wide_node_size != 0) != (header.num_wide_nodes != 0))
+    return reject("built with other BVH options");
+
+  // Every element takes at least 4 bytes, so larger counts cannot fit (and
+  // would overflow the layout)
+  for (const uint64_t count : {header.num_vertices, header.num_faces, header.num_nodes,
+                               header.num_primitives, header.num_wide_nodes, header.num_blocks})
+    if (count > file->size() / 4 || count > static_cast<uint64_t>(INT_MAX))
+      return reject("truncated");
+  const Layout sections = layout(header);
+  if (sections.file_size != file->size())
+    return reject("truncated");
+
+  const char * data[NUM_SECTIONS];
+  for (int s = 0; s < NUM_SECTIONS; s++)
+    data[s] = file->data() + sections.offset[s];
+  Header zeroed = header;
+  zeroed.checksum = 0;
+  uint64_t sum = checksum(reinterpret_cast<const char *>(&zeroed), sizeof(zeroed), 0);
+  for (int s = 0; s < NUM_SECTIONS; s++)
+    sum = checksum(data[s], sections.size[s], sum);
+  if (sum != header.checksum)
+    return reject("checksum mismatch");
+  const TriangleBlock * blocks = reinterpret_cast<const TriangleBlock *>(data[BLOCKS]);
+  if (!valid_indices(header,
+        reinterpret_cast<const int32_t *>(data[FACES]),
+        reinterpret_cast<const LinearBVHNode *>(data[NODES]),
+        reinterpret_cast<const int32_t *>(data[PRIMITIVES])) ||
+      (options.branching_factor == 4 && !valid_wide_indices(header,
+        reinterpret_cast<const WideBVHNode<4> *>(data[WIDE_NODES]), blocks)) ||
+      (options.branching_factor == 8 && !valid_wide_indices(header,
+        reinterpret_cast<const WideBVHNode<8> *>(data[WIDE_NODES]), blocks)))
+    return reject("index out of range");
+
+  // Maps are re-pointed by constructing them in place
+  using MatrixXdMap = Eigen::Map<const Eigen::MatrixXd>;
+  using MatrixXiMap = Eigen::Map<const Eigen::MatrixXi>;
+  new (&cache.V) MatrixXdMap(
+    reinterpret_cast<const double *>(data[VERTICES]), header.num_vertices, 3);
+  new (&cache.F) MatrixXiMap(
+    reinterpret_cast<const int *>(data[FACES]), header.num_faces, 3);
+  new (&cache.N) MatrixXdMap(
+    reinterpret_cast<const double *>(data[NORMALS]), header.num_vertices, 3);
+  cache.bvh = LinearBVH();
+  cache.bvh.nodes.view(reinterpret_cast<const LinearBVHNode *>(data[NODES]), header.num_nodes);
+  cache.bvh.primitive_indices.view(
+    reinterpret_cast<const int *>(data[PRIMITIVES]), header.num_primitives);
+  cache.bvh.max_depth = header.max_depth;
+  cache.bvh_stats.num_nodes = header.num_nodes;
+  cache.bvh_stats.num_leaf_nodes = header.num_leaf_nodes;
+  cache.bvh_stats.max_depth = header.max_depth;
+  cache.bvh_stats.sah_cost = header.sah_cost;
+  cache.bvh4 = BVH4();
+  cache.bvh8 = BVH8();
+  if (options.branching_factor == 4)
+    view_wide(header, data, cache.bvh, cache.bvh4);
+  else if (options.branching_factor == 8)
+    view_wide(header, data, cache.bvh, cache.bvh8);
+  cache.file = std::move(file);
+  return true;
+}
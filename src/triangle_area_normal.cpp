@@ -1,19 +1,26 @@
 #include "triangle_area_normal.h"
 
-Eigen::RowVector3d triangle_area_normal(
-  const Eigen::RowVector3d & a, 
-  const Eigen::RowVector3d & b, 
-  const Eigen::RowVector3d & c)
+template <typename Scalar>
+Eigen::Matrix<Scalar, 1, 3> triangle_area_normal(
+  const Eigen::Matrix<Scalar, 1, 3> & a, 
+  const Eigen::Matrix<Scalar, 1, 3> & b, 
+  const Eigen::Matrix<Scalar, 1, 3> & c)
 {
-  // Compute two edges (keep as RowVector3d)
-  Eigen::RowVector3d edge1 = b - a;
-  Eigen::RowVector3d edge2 = c - a;
+  // Compute two edges (keep as row vectors)
+  Eigen::Matrix<Scalar, 1, 3> edge1 = b - a;
+  Eigen::Matrix<Scalar, 1, 3> edge2 = c - a;
   
-  // Manual cross product for RowVector3d
-  Eigen::RowVector3d area_normal;
+  // Manual cross product for row vectors
+  Eigen::Matrix<Scalar, 1, 3> area_normal;
   area_normal(0) = edge1(1) * edge2(2) - edge1(2) * edge2(1);
   area_normal(1) = edge1(2) * edge2(0) - edge1(0) * edge2(2);
   area_normal(2) = edge1(0) * edge2(1) - edge1(1) * edge2(0);
   
   return area_normal;
 }
+
+// Explicit template instantiations
+template Eigen::RowVector3d triangle_area_normal<double>(
+  const Eigen::RowVector3d &, const Eigen::RowVector3d &, const Eigen::RowVector3d &);
+template Eigen::RowVector3f triangle_area_normal<float>(
+  const Eigen::RowVector3f &, const Eigen::RowVector3f &, const Eigen::RowVector3f &);
@@ -0,0 +1,52 @@
+#include "update_per_vertex_normals.h"
+#include "triangle_area_normal.h"
+#include <algorithm>
+
+void update_per_vertex_normals(
+  const Eigen::MatrixXd & V,
+  const Eigen::MatrixXi & F,
+  const Eigen::VectorXi & VF,
+  const Eigen::VectorXi & NI,
+  const std::vector<int> & moved,
+  Eigen::MatrixXd & FN,
+  Eigen::MatrixXd & N)
+{
+  std::vector<int> faces;
+  for (int v : moved)
+  {
+    faces.insert(faces.end(), VF.data() + NI(v), VF.data() + NI(v + 1));
+  }
+  std::sort(faces.begin(), faces.end());
+  faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+
+  std::vector<int> vertices;
+  vertices.reserve(3 * faces.size());
+  for (int f : faces)
+  {
+    FN.row(f) = triangle_area_normal<double>(
+      V.row(F(f,0)), V.row(F(f,1)), V.row(F(f,2)));
+    for (int k = 0; k < 3; k++)
+    {
+      vertices.push_back(F(f,k));
+    }
+  }
+  std::sort(vertices.begin(), vertices.end());
+  vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+  for (int i : vertices)
+  {
+    Eigen::RowVector3d sum_normal(0, 0, 0);
+    for (int j = NI(i); j < NI(i + 1); j++)
+    {
+      sum_normal += FN.row(VF(j));
+    }
+    if (sum_normal.norm() > 1e-10)
+    {
+      N.row(i) = sum_normal.normalized();
+    }
+    else
+    {
+      N.row(i).setZero();
+    }
+  }
+}
@@ -3,16 +3,32 @@
 void vertex_triangle_adjacency(
   const Eigen::MatrixXi & F,
   const int num_vertices,
-  std::vector<std::vector<int> > & VF)
+  Eigen::VectorXi & VF,
+  Eigen::VectorXi & NI)
 {
-  VF.resize(num_vertices);
+  // Count the faces of every vertex in NI(i+1), then turn the counts into
+  // run offsets
+  NI = Eigen::VectorXi::Zero(num_vertices + 1);
+  for (int j = 0; j < F.cols(); ++j)
+  {
+    for (int i = 0; i < F.rows(); ++i)
+    {
+      NI(F(i, j) + 1)++;
+    }
+  }
+  for (int i = 0; i < num_vertices; ++i)
+  {
+    NI(i + 1) += NI(i);
+  }
+
+  // Fill in face order so every run is sorted
+  Eigen::VectorXi next = NI.head(num_vertices);
+  VF.resize(NI(num_vertices));
   for (int i = 0; i < F.rows(); ++i)
   {
     for (int j = 0; j < F.cols(); ++j)
     {
-      int vertex_index = F(i, j);
-      VF[vertex_index].push_back(i);
+      VF(next(F(i, j))++) = i;
     }
   }
 }
-
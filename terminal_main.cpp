@@ -0,0 +1,221 @@
+// Headless front-end: renders a turntable of a mesh into the terminal it runs
+// in, redrawing only the cells that change between frames (AnsiFrameWriter).
+// The view follows the size of the terminal (SIGWINCH); the last row shows
+// frame statistics.
+//
+// Usage: ascii_terminal mesh.obj [--frames N] [--fps F] [--size WxH]
+//                       [--glyphs charset|shapes|braille|blocks] [--shadows]
+//                       [--trace trace.json] [--cache-dir DIR | --no-cache]
+//
+// --frames 0 (the default) runs until interrupted; --fps 0 renders as fast as
+// possible; --size overrides the terminal size (e.g. when stdout is a file).
+// --trace records trace zones from loading to exit and writes them as Chrome
+// trace-event JSON (needs the TRACE_ZONES build option). The mesh is loaded
+// through a scene cache kept next to it, or in --cache-dir; --no-cache always
+// parses the OBJ and builds the BVH.
+
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <Eigen/Core>
+
+#ifndef _WIN32
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "AnsiFrameWriter.h"
+#include "ASCIIRenderer.h"
+#include "Camera.h"
+#include "CameraController.h"
+#include "Scene.h"
+#include "TraceZones.h"
+
+namespace {
+    volatile std::sig_atomic_t g_resized = 1;
+    volatile std::sig_atomic_t g_quit = 0;
+
+    void handle_resize(int) { g_resized = 1; }
+    void handle_quit(int) { g_quit = 1; }
+
+    // Columns and rows of the terminal on stdout (the COLUMNS and LINES
+    // variables, or 80x24, if it is not a terminal)
+    void terminal_size(int& columns, int& rows) {
+#ifndef _WIN32
+        winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+            columns = size.ws_col;
+            rows = size.ws_row;
+            return;
+        }
+#endif
+        const char* env_columns = std::getenv("COLUMNS");
+        const char* env_rows = std::getenv("LINES");
+        columns = env_columns ? std::atoi(env_columns) : 0;
+        rows = env_rows ? std::atoi(env_rows) : 0;
+        if (columns <= 0) columns = 80;
+        if (rows <= 0) rows = 24;
+    }
+
+    bool parse_glyph_mode(const char* name, GlyphMode& mode) {
+        const char* names[] = {"charset", "shapes", "braille", "blocks"};
+        for (int i = 0; i < 4; i++) {
+            if (std::strcmp(name, names[i]) == 0) {
+                mode = static_cast<GlyphMode>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void write_all(const std::string& output) {
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " mesh.obj [--frames N] [--fps F] [--size WxH]"
+                  << " [--glyphs charset|shapes|braille|blocks] [--shadows] [--trace trace.json]"
+                  << " [--cache-dir DIR | --no-cache]" << std::endl;
+        return 1;
+    }
+
+    ASCIIRenderer renderer;
+    renderer.ambient_strength = 0.2;
+    renderer.light.intensity = 0.7;
+    long max_frames = 0;
+    double fps = 30.0;
+    int fixed_columns = 0, fixed_rows = 0;
+    std::string trace_path;
+    Scene scene;
+    for (int i = 2; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--frames") == 0 && has_value) {
+            max_frames = std::atol(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fps") == 0 && has_value) {
+            fps = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--size") == 0 && has_value &&
+                   std::sscanf(argv[i + 1], "%dx%d", &fixed_columns, &fixed_rows) == 2) {
+            i++;
+        } else if (std::strcmp(argv[i], "--glyphs") == 0 && has_value &&
+                   parse_glyph_mode(argv[i + 1], renderer.glyph_mode)) {
+            i++;
+        } else if (std::strcmp(argv[i], "--shadows") == 0) {
+            renderer.shadows = true;
+        } else if (std::strcmp(argv[i], "--trace") == 0 && has_value) {
+            trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--cache-dir") == 0 && has_value) {
+            scene.cache_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-cache") == 0) {
+            scene.use_cache = false;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (!trace_path.empty()) {
+        if (!TRACE_ZONES_ENABLED) {
+            std::cerr << "--trace needs a build with TRACE_ZONES" << std::endl;
+            return 1;
+        }
+        TRACE_THREAD_NAME("main");
+        set_trace_recording(true);
+    }
+
+    scene.load_mesh(argv[1]);
+    if (scene.bvh.empty()) {
+        std::cerr << "Failed to load model or model is empty." << std::endl;
+        return 1;
+    }
+    CameraController camera_controller;
+    const BoundingBox box = scene.bvh.box();
+    camera_controller.set_target_and_fit(
+        box.center().transpose(), (box.max_corner - box.min_corner).maxCoeff() * 0.8);
+
+    std::signal(SIGINT, handle_quit);
+    std::signal(SIGTERM, handle_quit);
+#ifdef SIGWINCH
+    std::signal(SIGWINCH, handle_resize);
+#endif
+
+    // Alternate screen, hidden cursor
+    write_all("\x1b[?1049h\x1b[?25l");
+
+    AnsiFrameWriter writer;
+    Camera camera;
+    std::string frame, output;
+    int columns = 0, rows = 0;
+    // Light in camera space, as in the GUI
+    const double light_theta = 120.0 * M_PI / 180.0;
+    const double light_phi = 150.0 * M_PI / 180.0;
+
+    using Clock = std::chrono::steady_clock;
+    auto last_time = Clock::now();
+    for (long frame_index = 0; !g_quit && (max_frames <= 0 || frame_index < max_frames); frame_index++) {
+        TRACE_ZONE_NAMED(frame_zone, "frame");
+        const auto frame_start = Clock::now();
+        if (g_resized) {
+            g_resized = 0;
+            terminal_size(columns, rows);
+            if (fixed_columns > 0 && fixed_rows > 0) {
+                columns = fixed_columns;
+                rows = fixed_rows;
+            }
+            // One row is kept for the statistics
+            renderer.resolution = columns;
+            renderer.grid_rows = std::max(rows - 1, 1);
+            writer.reset();
+        }
+
+        camera_controller.update(std::chrono::duration<double>(frame_start - last_time).count());
+        last_time = frame_start;
+        // Cells twice as tall as they are wide
+        camera_controller.apply_to_camera(camera, 2.0 * renderer.grid_rows / renderer.resolution);
+        renderer.light.direction = (
+            std::sin(light_theta) * std::cos(light_phi) * camera.u +
+            std::cos(light_theta) * camera.v -
+            std::sin(light_theta) * std::sin(light_phi) * camera.w
+        ).normalized();
+
+        renderer.render(scene, camera, frame);
+        const double render_ms =
+            std::chrono::duration<double, std::milli>(Clock::now() - frame_start).count();
+
+        TRACE_ZONE_NAMED(write_zone, "write frame");
+        output.clear();
+        writer.write(frame, output);
+        const size_t frame_bytes = output.size();
+        char status[128];
+        std::snprintf(status, sizeof(status), "\x1b[%d;1H\x1b[K%dx%d  render %.1f ms  %zu bytes  %d cells",
+                      renderer.grid_rows + 1, renderer.resolution, renderer.grid_rows, render_ms,
+                      frame_bytes, writer.changed_cells);
+        output += status;
+        write_all(output);
+        TRACE_ZONE_END(write_zone);
+        TRACE_ZONE_END(frame_zone);
+
+        if (fps > 0.0) {
+            std::this_thread::sleep_until(frame_start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / fps)));
+        }
+    }
+
+    write_all("\x1b[?25h\x1b[?1049l");
+    if (!trace_path.empty()) {
+        set_trace_recording(false);
+        if (!write_chrome_trace(trace_path)) {
+            std::cerr << "Failed to write " << trace_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}